@@ -0,0 +1,315 @@
+//
+// Project: evolution_simulator_2
+// File: Microbenchmarks.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <WorldSingleton.hpp>
+#include <ConfigSingleton.hpp>
+#include <MapSingleton.hpp>
+#include <CreatureCognition.hpp>
+#include <Genome.hpp>
+#include <HeadlessContext.hpp>
+#include <Utils.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+
+namespace {
+
+    enum class Distribution {
+        UNIFORM,
+        CLUSTERED, // single gaussian cluster in the world center
+        EDGE // stacked at the world edge, as creatures clamped by the dynamics
+    };
+
+    const char* distributionNames[] = { "uniform", "clustered", "edge" };
+
+    struct Entities {
+        Vector<Vec2f>   positions;
+        Vector<float>   radii;
+        Vector<float>   directions;
+    };
+
+    struct Options {
+        std::string filter; // run kernels with names containing the filter
+        double      minTime = 0.2; // seconds per measurement
+        bool        quick = false; // smaller sweeps
+        bool        map = true; // MapSingleton kernels, require an OpenGL context
+    };
+
+    FILE*   output = stdout;
+    bool    firstResult = true;
+    float   sink = 0.0f; // results are accumulated here so that the kernels are not optimized out
+
+    Entities generateEntities(Distribution distribution, uint64_t n)
+    {
+        Entities entities;
+        entities.positions.reserve(n);
+        for (uint64_t i=0; i<n; ++i) {
+            Vec2f p;
+            switch (distribution) {
+                case Distribution::UNIFORM:
+                    p << RNDS*ConfigSingleton::defaultWorldSize, RNDS*ConfigSingleton::defaultWorldSize;
+                    break;
+                case Distribution::CLUSTERED:
+                    p << RNDS*ConfigSingleton::defaultWorldSize, RNDS*ConfigSingleton::defaultWorldSize;
+                    while (gauss2(p, 64.0f) < RND)
+                        p << RNDS*ConfigSingleton::defaultWorldSize, RNDS*ConfigSingleton::defaultWorldSize;
+                    break;
+                case Distribution::EDGE:
+                    p << ConfigSingleton::defaultWorldSize, RNDS*ConfigSingleton::defaultWorldSize;
+                    break;
+            }
+            entities.positions.push_back(p);
+            entities.radii.push_back(std::sqrt((float)RNDRANGE(ConfigSingleton::minCreatureMass, 4.0)));
+            entities.directions.push_back(RND*M_PI*2.0f);
+        }
+        return entities;
+    }
+
+    // repeat the kernel until minTime has passed, returns nanoseconds per operation
+    template <typename T_Kernel>
+    double measure(const Options& options, uint64_t opsPerCall, T_Kernel&& kernel)
+    {
+        kernel(); // warm up caches
+        uint64_t nCalls = 0;
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        do {
+            kernel();
+            ++nCalls;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < options.minTime);
+
+        return elapsed*1.0e9 / (double)(nCalls*opsPerCall);
+    }
+
+    bool selected(const Options& options, const char* kernel)
+    {
+        return std::string(kernel).find(options.filter) != std::string::npos;
+    }
+
+    // index is the spatial index type, cellSize is 0 for the quadtree
+    void report(const char* kernel, const char* distribution, const char* index, uint64_t nEntities,
+        float cellSize, double nsPerOp)
+    {
+        fprintf(output, "%s    {\"kernel\": \"%s\", \"distribution\": \"%s\", \"index\": \"%s\", "
+            "\"entities\": %lu, \"cellSize\": %.1f, \"nsPerOp\": %.3f}", firstResult ? "" : ",\n",
+            kernel, distribution, index, nEntities, cellSize, nsPerOp);
+        fprintf(stderr, "%-20s %-10s %-8s %8lu entities, cell %5.1f: %10.3f ns/op\n",
+            kernel, distribution, index, nEntities, cellSize, nsPerOp);
+        firstResult = false;
+    }
+
+    void fillWorld(WorldSingleton& world, const Entities& entities)
+    {
+        world.reset();
+        for (uint64_t i=0; i<entities.positions.size(); ++i)
+            world.addEntity(i, entities.positions[i], WorldSingleton::EntityType::CREATURE);
+    }
+
+    // WorldSingleton::reset, addEntity and getEntities, raycast and collision candidates with either index
+    void benchmarkSpatial(const Options& options, Distribution distribution, uint64_t n, float cellSize,
+        WorldSingleton::IndexType indexType)
+    {
+        const char* distributionName = distributionNames[(int)distribution];
+        const char* indexName = indexType == WorldSingleton::IndexType::GRID ? "grid" : "quadtree";
+        if (indexType == WorldSingleton::IndexType::QUADTREE)
+            cellSize = 0.0f;
+        Entities entities = generateEntities(distribution, n);
+        WorldSingleton world(cellSize > 0.0f ? cellSize : WorldSingleton::defaultCellSize);
+        world.setIndexType(indexType);
+        Vector<fug::EntityId> found;
+
+        if (selected(options, "worldRebuild")) {
+            report("worldRebuild", distributionName, indexName, n, cellSize, measure(options, n, [&]() {
+                fillWorld(world, entities);
+            }));
+        }
+
+        fillWorld(world, entities);
+
+        if (selected(options, "worldQuery")) {
+            // box of the size used by collision detection of a unit mass creature
+            Vec2f box(ConfigSingleton::spriteRadius/8.0f + ConfigSingleton::maxObjectRadius,
+                ConfigSingleton::spriteRadius/8.0f + ConfigSingleton::maxObjectRadius);
+            report("worldQuery", distributionName, indexName, n, cellSize, measure(options, n, [&]() {
+                for (auto& p : entities.positions) {
+                    found.clear();
+                    world.getEntities(found, p-box, p+box);
+                    sink += (float)found.size();
+                }
+            }));
+        }
+
+        if (selected(options, "whiskerRaycast")) {
+            // as in CreatureSystem::processInputs
+            report("whiskerRaycast", distributionName, indexName, n, cellSize, measure(options, n, [&]() {
+                for (uint64_t i=0; i<n; ++i) {
+                    float r = entities.radii[i];
+                    float t = 5.0f+5.0f*r;
+                    Vec2f wv(cosf(entities.directions[i]), sinf(entities.directions[i]));
+                    Vec2f wBegin = entities.positions[i]+r*wv;
+                    Vec2f wEnd = entities.positions[i]+(r+t)*wv;
+
+                    found.clear();
+                    world.getEntitiesAlongRay(found, entities.positions[i], wEnd, ConfigSingleton::maxObjectRadius);
+
+                    for (auto& j : found) {
+                        if (j == (fug::EntityId)i)
+                            continue;
+                        float tCand = rayCircleIntersection(wBegin, wv, entities.positions[j], entities.radii[j]);
+                        if (tCand >= -r && tCand < t)
+                            t = tCand;
+                    }
+                    sink += t;
+                }
+            }));
+        }
+
+        if (selected(options, "collisionCandidates")) {
+            // as in CollisionSystem
+            report("collisionCandidates", distributionName, indexName, n, cellSize, measure(options, n, [&]() {
+                uint64_t nCollisions = 0;
+                for (uint64_t i=0; i<n; ++i) {
+                    float radius = entities.radii[i];
+                    Vec2f collisionBoxVec(
+                        radius+ConfigSingleton::maxObjectRadius, radius+ConfigSingleton::maxObjectRadius);
+                    auto& p = entities.positions[i];
+
+                    found.clear();
+                    world.getEntities(found, p-collisionBoxVec, p+collisionBoxVec);
+                    for (auto& j : found) {
+                        if (j != (fug::EntityId)i && (p-entities.positions[j]).norm() < radius+entities.radii[j])
+                            ++nCollisions;
+                    }
+                }
+                sink += (float)nCollisions;
+            }));
+        }
+    }
+
+    void benchmarkCognition(const Options& options)
+    {
+        if (selected(options, "cognitionForward")) {
+            constexpr uint64_t n = 1024;
+            Vector<CreatureCognition> cognitions;
+            cognitions.reserve(n);
+            for (uint64_t i=0; i<n; ++i)
+                cognitions.emplace_back(Genome());
+
+            report("cognitionForward", "-", "-", n, 0.0f, measure(options, n, [&]() {
+                for (auto& cognition : cognitions)
+                    sink += cognition.forward()(0);
+            }));
+        }
+
+        if (selected(options, "genomeMutate")) {
+            // child genome creation as in CreatureSystem::reproduction
+            ConfigSingleton config;
+            Genome parent;
+            report("genomeMutate", "-", "-", 1, 0.0f, measure(options, 1, [&]() {
+                Genome child = parent;
+                for (auto& stage : config.mutationStages)
+                    child.mutate(stage.probability, stage.amplitude, stage.mode);
+                if (!config.genomeDeltaStorage || child.deltaSize() > config.genomeDeltaCompactionThreshold)
+                    child.compact();
+                sink += child[Genome::COLOR_R];
+            }));
+        }
+    }
+
+    void benchmarkMap(const Options& options)
+    {
+        if (!options.map || !selected(options, "sampleFertility"))
+            return;
+
+        // Hidden window for the OpenGL context required by the map
+        HeadlessContext context;
+        if (!context.init("evolution_simulator_microbench")) {
+            fprintf(stderr, "Skipping map benchmarks\n");
+            return;
+        }
+
+        MapSingleton map;
+        map.prefetch();
+        map.map();
+        Vector<Vec2f> samples;
+        for (int n : { 10, 1000, 100000 }) {
+            report("sampleFertility", "-", "-", n, 0.0f, measure(options, n, [&]() {
+                map.sampleFertility(samples, n);
+                sink += samples.back()(0);
+            }));
+        }
+        map.unmap();
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i=1; i<argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i+1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--min-time" && i+1 < argc)
+            options.minTime = strtod(argv[++i], nullptr);
+        else if (arg == "--output" && i+1 < argc) {
+            output = fopen(argv[++i], "w");
+            if (output == nullptr) {
+                printf("Error: Could not open %s for writing\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (arg == "--quick")
+            options.quick = true;
+        else if (arg == "--no-map")
+            options.map = false;
+        else {
+            printf("Usage: %s [--filter SUBSTRING] [--min-time SECONDS] [--output FILE] [--quick] [--no-map]\n"
+                "Kernels: worldRebuild worldQuery whiskerRaycast collisionCandidates cognitionForward "
+                "genomeMutate sampleFertility\n", argv[0]);
+            return 2;
+        }
+    }
+
+    randomEngine().seed(1);
+
+    Vector<uint64_t> entityCounts = options.quick ?
+        Vector<uint64_t>{ 2000, 20000 } : Vector<uint64_t>{ 2000, 20000, 100000 };
+    Vector<float> cellSizes = options.quick ?
+        Vector<float>{ WorldSingleton::defaultCellSize } :
+        Vector<float>{ 8.0f, WorldSingleton::defaultCellSize, 32.0f, 64.0f };
+
+    fprintf(output, "{\n  \"results\": [\n");
+
+    for (int d=0; d<3; ++d) {
+        for (auto n : entityCounts) {
+            for (auto cellSize : cellSizes)
+                benchmarkSpatial(options, (Distribution)d, n, cellSize, WorldSingleton::IndexType::GRID);
+            benchmarkSpatial(options, (Distribution)d, n, 0.0f, WorldSingleton::IndexType::QUADTREE);
+        }
+    }
+    benchmarkCognition(options);
+    benchmarkMap(options);
+
+    fprintf(output, "\n  ]\n}\n");
+    if (output != stdout)
+        fclose(output);
+
+    // print the sink so that it cannot be optimized out
+    fprintf(stderr, "(%g)\n", (double)sink);
+
+    return 0;
+}
@@ -0,0 +1,460 @@
+//
+// Project: evolution_simulator_2
+// File: ThroughputBenchmark.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Simulation.hpp>
+#include <HeadlessContext.hpp>
+#include <Profiler.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <TelemetrySingleton.hpp>
+#include <Utils.hpp>
+
+#include <glad/glad.h>
+#include <graphics/SpriteSingleton.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace {
+
+    struct Scenario {
+        const char* name;
+        uint64_t    nCreatures;
+        uint64_t    nFood;
+        float       spread; // std. dev. of the initial creature placement
+        double      foodPerTick;
+        float       worldSize;
+        float       metabolicConstant; // initial metabolic constant gene of all creatures, negative for random genomes
+    };
+
+    const Scenario scenarios[] = {
+        { "default",    2000,   5000,   256.0f,     10.0,   1024.0f,    -1.0f }, // same as the application
+        { "sparse20k",  20000,  20000,  8192.0f,    10.0,   4096.0f,    -1.0f }, // 16x the default area, nearly uniform
+        { "dense100k",  100000, 5000,   128.0f,     10.0,   1024.0f,    -1.0f }, // single dense gaussian cluster
+        // starved of plants, creatures start with a metabolism that gets 90% of the meat energy
+        { "carnivore",  5000,   0,      128.0f,     0.1,    1024.0f,    0.1f },
+        { "largeWorld", 50000,  50000,  16384.0f,   100.0,  10240.0f,   -1.0f }, // 100x the default area, sparse grid
+    };
+
+    // stages that must not allocate in a steady-state tick, checked when allocation tracking is enabled
+    const Simulation::Stage allocationFreeStages[] = { Simulation::COGNITION, Simulation::TELEMETRY };
+
+    struct Options {
+        uint64_t            ticks = 500;
+        uint64_t            warmupTicks = 50;
+        uint64_t            seed = 1;
+        Vector<std::string> scenarios; // empty for all
+        std::string         outputFileName; // empty for stdout
+        std::string         baselineFileName;
+        double              tolerance = 0.05; // allowed relative throughput regression
+        WorldSingleton::IndexType   spatialIndex = WorldSingleton::IndexType::GRID;
+        uint64_t            indexRebuildInterval = 0; // 0 to rebuild the index twice per tick
+    };
+
+    // written by the scenario process to the pipe
+    struct ScenarioResult {
+        bool        success;
+        double      ticksPerSecond;
+        double      stageTimes[Simulation::N_STAGES]; // average per tick, seconds
+        double      hotPathCounters[HotPathCounters::N_COUNTERS]; // average per tick
+        double      stageAllocations[Simulation::N_STAGES]; // average per tick
+        double      stageAllocatedBytes[Simulation::N_STAGES];
+        uint64_t    nCreatures; // after the last tick
+        uint64_t    nFood;
+    };
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options]\n"
+            "  --ticks N          timed ticks per scenario (default 500)\n"
+            "  --warmup N         untimed ticks before measurement (default 50)\n"
+            "  --seed N           random seed (default 1)\n"
+            "  --scenario NAME    run only the given scenario, can be repeated\n"
+            "  --output FILE      write the JSON results to a file instead of stdout\n"
+            "  --baseline FILE    compare against results stored by an earlier run\n"
+            "  --tolerance X      relative slowdown reported as a regression (default 0.05)\n"
+            "  --spatial-index I  grid or quadtree (default grid)\n"
+            "  --index-rebuild-interval N\n"
+            "                     ticks between full index rebuilds, incremental updates in between\n"
+            "                     (default 0, rebuild twice per tick)\n"
+            "Scenarios:", program);
+        for (auto& scenario : scenarios)
+            printf(" %s", scenario.name);
+        printf("\n");
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i+1 < argc;
+            if (arg == "--ticks" && hasValue)
+                options.ticks = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--warmup" && hasValue)
+                options.warmupTicks = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--seed" && hasValue)
+                options.seed = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--scenario" && hasValue)
+                options.scenarios.emplace_back(argv[++i]);
+            else if (arg == "--output" && hasValue)
+                options.outputFileName = argv[++i];
+            else if (arg == "--baseline" && hasValue)
+                options.baselineFileName = argv[++i];
+            else if (arg == "--tolerance" && hasValue)
+                options.tolerance = strtod(argv[++i], nullptr);
+            else if (arg == "--index-rebuild-interval" && hasValue)
+                options.indexRebuildInterval = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--spatial-index" && hasValue && std::string(argv[i+1]) == "grid") {
+                options.spatialIndex = WorldSingleton::IndexType::GRID;
+                ++i;
+            }
+            else if (arg == "--spatial-index" && hasValue && std::string(argv[i+1]) == "quadtree") {
+                options.spatialIndex = WorldSingleton::IndexType::QUADTREE;
+                ++i;
+            }
+            else {
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+
+        for (auto& name : options.scenarios) {
+            bool found = false;
+            for (auto& scenario : scenarios)
+                found |= name == scenario.name;
+            if (!found) {
+                printf("Error: Unknown scenario %s\n", name.c_str());
+                return false;
+            }
+        }
+
+        return options.ticks > 0;
+    }
+
+    // Same placement as Simulation::populate, with the metabolic constant gene overridden
+    void populateWithMetabolism(Simulation& simulation, const Scenario& scenario)
+    {
+        auto& ecs = simulation.getEcs();
+        Genome::Genes genes;
+        for (uint64_t i=0; i<scenario.nCreatures; ++i) {
+            Vec2f p(RNDS*scenario.worldSize, RNDS*scenario.worldSize);
+            while (gauss2(p, scenario.spread) < RND)
+                p << RNDS*scenario.worldSize, RNDS*scenario.worldSize;
+
+            double mass = ConfigSingleton::minCreatureMass + RND*(
+                ConfigSingleton::maxCreatureMass-ConfigSingleton::minCreatureMass);
+
+            Genome().copyTo(genes.data());
+            genes[Genome::METABOLIC_CONSTANT] = scenario.metabolicConstant;
+            createCreature(ecs, Genome(genes.data()), mass, 1.0, p, RND*M_PI*2.0f, RND);
+        }
+
+        simulation.addEntitiesToWorld();
+        simulation.processInputs();
+    }
+
+    // Run a scenario in the current process, requires a fresh process since the systems
+    // cache singleton references of the first Ecs they are used with
+    ScenarioResult runScenario(const Scenario& scenario, const Options& options)
+    {
+        ScenarioResult result {};
+
+        HeadlessContext context;
+        if (!context.init("evolution_simulator_bench"))
+            return result;
+
+        {
+            Simulation simulation;
+            auto& ecs = simulation.getEcs();
+            auto& world = *ecs.getSingleton<WorldSingleton>();
+            auto& telemetry = *ecs.getSingleton<TelemetrySingleton>();
+
+            randomEngine().seed(options.seed);
+            ecs.getSingleton<ConfigSingleton>()->foodPerTick = scenario.foodPerTick;
+            ecs.getSingleton<ConfigSingleton>()->spatialIndexRebuildInterval = options.indexRebuildInterval;
+
+            ecs.getSingleton<fug::SpriteSingleton>()->init();
+            auto spriteSheetId = ecs.getSingleton<fug::SpriteSingleton>()->addSpriteSheetFromFile(
+                EVOLUTION_SIMULATOR_RES("sprites/sprites.png"), 128, 128);
+            simulation.init(spriteSheetId);
+            simulation.setWorldSize(scenario.worldSize);
+            simulation.setSpatialIndex(options.spatialIndex);
+            if (scenario.metabolicConstant < 0.0f)
+                simulation.populate(scenario.nCreatures, scenario.nFood, scenario.spread);
+            else {
+                simulation.populate(0, scenario.nFood, scenario.spread);
+                populateWithMetabolism(simulation, scenario);
+            }
+
+            auto tick = [&]() {
+                simulation.update();
+                simulation.diffuseMap();
+                PROFILE_FRAME();
+            };
+
+            for (uint64_t i=0; i<options.warmupTicks; ++i)
+                tick();
+            glFinish();
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i=0; i<options.ticks; ++i) {
+                tick();
+                for (int s=0; s<Simulation::N_STAGES; ++s) {
+                    result.stageTimes[s] += simulation.getStageTime((Simulation::Stage)s);
+                    const auto& allocations = simulation.getStageAllocations((Simulation::Stage)s);
+                    result.stageAllocations[s] += (double)allocations.allocations;
+                    result.stageAllocatedBytes[s] += (double)allocations.bytes;
+                }
+                for (int c=0; c<HotPathCounters::N_COUNTERS; ++c)
+                    result.hotPathCounters[c] += telemetry.getLastValue(
+                        TelemetrySingleton::hotPathColumn((HotPathCounters::Counter)c));
+            }
+            glFinish();
+            double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            result.success = true;
+            result.ticksPerSecond = (double)options.ticks / duration;
+            for (int s=0; s<Simulation::N_STAGES; ++s) {
+                result.stageTimes[s] /= (double)options.ticks;
+                result.stageAllocations[s] /= (double)options.ticks;
+                result.stageAllocatedBytes[s] /= (double)options.ticks;
+            }
+            for (auto& counter : result.hotPathCounters)
+                counter /= (double)options.ticks;
+            result.nCreatures = world.getNumberOf(WorldSingleton::EntityType::CREATURE);
+            result.nFood = world.getNumberOf(WorldSingleton::EntityType::FOOD);
+        }
+
+        return result;
+    }
+
+    // Run a scenario in a child process, peak RSS is measured per scenario
+    bool runScenarioProcess(const Scenario& scenario, const Options& options,
+        ScenarioResult& result, long& peakRss)
+    {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            printf("Error: Could not create a pipe\n");
+            return false;
+        }
+
+        fflush(nullptr); // nothing buffered may be duplicated into the child
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("Error: Could not fork a scenario process\n");
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+
+        if (pid == 0) {
+            close(fds[0]);
+            dup2(STDERR_FILENO, STDOUT_FILENO); // keep the JSON output clean
+            ScenarioResult childResult = runScenario(scenario, options);
+            bool written = write(fds[1], &childResult, sizeof(childResult)) == sizeof(childResult);
+            close(fds[1]);
+            fflush(stdout);
+            _exit(written && childResult.success ? 0 : 1);
+        }
+
+        close(fds[1]);
+        bool received = read(fds[0], &result, sizeof(result)) == sizeof(result);
+        close(fds[0]);
+
+        int status = 0;
+        struct rusage usage {};
+        wait4(pid, &status, 0, &usage);
+        peakRss = usage.ru_maxrss; // KiB
+
+        return received && result.success && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // Raw text of a top-level field of a single-line JSON object, strings without the quotes
+    bool readField(const char* line, const char* key, std::string& value)
+    {
+        size_t keyLength = strlen(key);
+        int depth = 0;
+        const char* c = line;
+        while (*c != '\0') {
+            if (*c != '"') {
+                if (*c == '{' || *c == '[')
+                    ++depth;
+                else if (*c == '}' || *c == ']')
+                    --depth;
+                ++c;
+                continue;
+            }
+
+            // a string is a key if it's followed by a colon
+            const char* end = strchr(c+1, '"');
+            if (end == nullptr)
+                return false;
+            bool matches = depth == 1 && (size_t)(end-c-1) == keyLength && strncmp(c+1, key, keyLength) == 0;
+            c = end+1;
+            while (*c == ' ')
+                ++c;
+            if (!matches || *c != ':')
+                continue;
+
+            ++c;
+            while (*c == ' ')
+                ++c;
+            if (*c == '"') {
+                end = strchr(c+1, '"');
+                if (end == nullptr)
+                    return false;
+                value.assign(c+1, end);
+            }
+            else
+                value.assign(c, c+strcspn(c, ",}]"));
+            return true;
+        }
+        return false;
+    }
+
+    // Baseline files are earlier outputs, one scenario object per line
+    bool readBaseline(const std::string& fileName, const char* scenarioName, double& ticksPerSecond)
+    {
+        FILE* file = fopen(fileName.c_str(), "r");
+        if (file == nullptr)
+            return false;
+
+        char* line = nullptr;
+        size_t lineCapacity = 0;
+        bool found = false;
+        std::string name, value;
+        while (!found && getline(&line, &lineCapacity, file) != -1) {
+            // the scenario objects are nested in the top-level object of the file
+            const char* object = strchr(line, '{');
+            if (object == nullptr || !readField(object, "name", name) || name != scenarioName ||
+                !readField(object, "ticksPerSecond", value))
+                continue;
+
+            char* valueEnd = nullptr;
+            ticksPerSecond = strtod(value.c_str(), &valueEnd);
+            found = valueEnd != value.c_str() && ticksPerSecond > 0.0;
+        }
+
+        free(line);
+        fclose(file);
+        return found;
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 2;
+
+    if (!options.baselineFileName.empty() && access(options.baselineFileName.c_str(), R_OK) != 0) {
+        printf("Error: Could not open baseline %s\n", options.baselineFileName.c_str());
+        return 2;
+    }
+
+    FILE* output = stdout;
+    if (!options.outputFileName.empty()) {
+        output = fopen(options.outputFileName.c_str(), "w");
+        if (output == nullptr) {
+            printf("Error: Could not open %s for writing\n", options.outputFileName.c_str());
+            return 2;
+        }
+    }
+
+    fprintf(output, "{\n  \"ticks\": %lu,\n  \"warmupTicks\": %lu,\n  \"seed\": %lu,\n  \"scenarios\": [\n",
+        options.ticks, options.warmupTicks, options.seed);
+
+    bool failed = false;
+    bool regressed = false;
+    bool first = true;
+    for (auto& scenario : scenarios) {
+        bool selected = options.scenarios.empty();
+        for (auto& name : options.scenarios)
+            selected |= name == scenario.name;
+        if (!selected)
+            continue;
+
+        fprintf(stderr, "Running %s...\n", scenario.name);
+        ScenarioResult result {};
+        long peakRss = 0;
+        if (!runScenarioProcess(scenario, options, result, peakRss)) {
+            fprintf(stderr, "Error: Scenario %s failed\n", scenario.name);
+            failed = true;
+            continue;
+        }
+
+        // one line per scenario, see readBaseline
+        fprintf(output, "%s    {\"name\": \"%s\", \"spatialIndex\": \"%s\", \"indexRebuildInterval\": %lu, "
+            "\"initialCreatures\": %lu, \"initialFood\": %lu, \"ticksPerSecond\": %.3f, \"peakRssKiB\": %ld, \"finalCreatures\": %lu, "
+            "\"finalFood\": %lu, \"stageMs\": {", first ? "" : ",\n", scenario.name,
+            options.spatialIndex == WorldSingleton::IndexType::GRID ? "grid" : "quadtree",
+            options.indexRebuildInterval, scenario.nCreatures, scenario.nFood, result.ticksPerSecond, peakRss, result.nCreatures, result.nFood);
+        for (int s=0; s<Simulation::N_STAGES; ++s) {
+            fprintf(output, "%s\"%s\": %.4f", s > 0 ? ", " : "",
+                Simulation::getStageName((Simulation::Stage)s), result.stageTimes[s]*1000.0);
+        }
+        if (AllocationTracker::isEnabled()) {
+            fprintf(output, "}, \"stageAllocations\": {");
+            for (int s=0; s<Simulation::N_STAGES; ++s) {
+                fprintf(output, "%s\"%s\": [%.1f, %.0f]", s > 0 ? ", " : "",
+                    Simulation::getStageName((Simulation::Stage)s),
+                    result.stageAllocations[s], result.stageAllocatedBytes[s]);
+            }
+        }
+        fprintf(output, "}, \"countersPerTick\": {");
+        for (int c=0; c<HotPathCounters::N_COUNTERS; ++c) {
+            fprintf(output, "%s\"%s\": %.1f", c > 0 ? ", " : "",
+                HotPathCounters::getName((HotPathCounters::Counter)c), result.hotPathCounters[c]);
+        }
+        fprintf(output, "}");
+
+        double baselineTicksPerSecond;
+        if (!options.baselineFileName.empty() &&
+            readBaseline(options.baselineFileName, scenario.name, baselineTicksPerSecond)) {
+            double speedup = result.ticksPerSecond / baselineTicksPerSecond;
+            fprintf(output, ", \"baselineTicksPerSecond\": %.3f, \"speedup\": %.4f",
+                baselineTicksPerSecond, speedup);
+            fprintf(stderr, "%s: %.1f ticks/s, baseline %.1f ticks/s (%+.1f%%)\n", scenario.name,
+                result.ticksPerSecond, baselineTicksPerSecond, (speedup-1.0)*100.0);
+            if (speedup < 1.0 - options.tolerance) {
+                fprintf(stderr, "Regression: %s is slower than the baseline\n", scenario.name);
+                regressed = true;
+            }
+        }
+        else
+            fprintf(stderr, "%s: %.1f ticks/s\n", scenario.name, result.ticksPerSecond);
+
+        for (auto stage : allocationFreeStages) {
+            if (AllocationTracker::isEnabled() && result.stageAllocations[stage] > 0.0) {
+                fprintf(stderr, "Error: %s allocated %.1f times per tick in the %s stage\n", scenario.name,
+                    result.stageAllocations[stage], Simulation::getStageName(stage));
+                failed = true;
+            }
+        }
+
+        fprintf(output, "}");
+        first = false;
+    }
+
+    fprintf(output, "\n  ]\n}\n");
+    if (output != stdout)
+        fclose(output);
+
+    return failed ? 2 : (regressed ? 1 : 0);
+}
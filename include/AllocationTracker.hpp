@@ -0,0 +1,60 @@
+//
+// Project: evolution_simulator_2
+// File: AllocationTracker.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_ALLOCATIONTRACKER_HPP
+#define EVOLUTION_SIMULATOR_2_ALLOCATIONTRACKER_HPP
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+/** @brief  Heap allocation counting
+ *
+ *  With EVOLUTION_SIMULATOR_ALLOCATION_TRACKING defined the global operator new is
+ *  replaced with one that counts the allocations and allocated bytes of each thread.
+ *  Otherwise the counts stay at zero.
+ */
+class AllocationTracker {
+public:
+    struct Counts {
+        uint64_t    allocations;
+        uint64_t    bytes;
+
+        Counts& operator+=(const Counts& other)
+        {
+            allocations += other.allocations;
+            bytes += other.bytes;
+            return *this;
+        }
+
+        Counts operator-(const Counts& other) const
+        {
+            return Counts{allocations-other.allocations, bytes-other.bytes};
+        }
+    };
+
+    static constexpr bool isEnabled()
+    {
+#ifdef EVOLUTION_SIMULATOR_ALLOCATION_TRACKING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // allocations made by the calling thread since it started
+    static Counts threadCounts();
+
+    static void recordAllocation(size_t bytes);
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_ALLOCATIONTRACKER_HPP
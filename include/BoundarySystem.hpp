@@ -0,0 +1,63 @@
+//
+// Project: evolution_simulator_2
+// File: BoundarySystem.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_BOUNDARYSYSTEM_HPP
+#define EVOLUTION_SIMULATOR_2_BOUNDARYSYSTEM_HPP
+
+
+#include <ecs/System.hpp>
+#include <ecs/Ecs.hpp>
+#include <graphics/Orientation2DComponent.hpp>
+#include <gut_utils/MathUtils.hpp>
+#include <gut_utils/TypeUtils.hpp>
+
+
+/** @brief  Finds the owned entities that concern other regions of a DomainDecomposition
+ *
+ *  The world is split into nRegionsX*nRegionsY equally sized rectangular regions, indexed
+ *  row by row. Ghost entities are skipped.
+ */
+FUG_SYSTEM(BoundarySystem, fug::Orientation2DComponent) {
+public:
+    enum class Stage {
+        EMIGRANTS,  // entities outside the own region, listed under the region containing them
+        HALO        // entities within haloWidth of other regions, listed under each of them
+    };
+
+    BoundarySystem(fug::Ecs& ecs);
+
+    void setStage(Stage stage);
+    void setRegions(uint32_t nRegionsX, uint32_t nRegionsY, uint32_t region, float worldSize, float haloWidth);
+
+    // region containing position, positions outside the world belong to the nearest region
+    uint32_t getRegion(const Vec2f& position) const;
+
+    // clear the entity lists, to be called before running the system
+    void clear();
+    const Vector<fug::EntityId>& getEntities(uint32_t region) const;
+
+    void operator()(const fug::EntityId& eId, fug::Orientation2DComponent& orientationComponent);
+
+private:
+    fug::Ecs&   _ecs;
+    Stage       _stage;
+    uint32_t    _nRegionsX;
+    uint32_t    _nRegionsY;
+    uint32_t    _region;
+    float       _worldSize;
+    float       _haloWidth;
+
+    Vector<Vector<fug::EntityId>>   _entities; // per region
+
+    uint32_t regionCoordinate(float x, uint32_t nRegions) const;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_BOUNDARYSYSTEM_HPP
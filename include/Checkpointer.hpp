@@ -0,0 +1,56 @@
+//
+// Project: evolution_simulator_2
+// File: Checkpointer.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_CHECKPOINTER_HPP
+#define EVOLUTION_SIMULATOR_2_CHECKPOINTER_HPP
+
+
+#include <WorldSnapshot.hpp>
+#include <WorkerThread.hpp>
+#include <atomic>
+#include <string>
+
+
+/** @brief  Periodic autosave of the world
+ *
+ *  The world is captured at a tick boundary into one of two snapshot buffers, after
+ *  which the buffer is written, synced and atomically renamed into place on a
+ *  background thread. While a buffer is being written the other one is available
+ *  for the next capture; if both are busy the checkpoint is skipped.
+ */
+class Checkpointer {
+public:
+    Checkpointer();
+
+    // capture and queue a checkpoint in case the checkpoint interval has been reached
+    void update(fug::Ecs& ecs, SnapshotSystem& snapshotSystem);
+
+    // block until all queued checkpoints have been written
+    void wait();
+
+    uint64_t getLastCheckpointTick() const;
+    double getLastCaptureTime() const; // seconds spent in the tick loop
+    double getLastWriteTime() const; // seconds spent in the background
+
+private:
+    static constexpr int    nBuffers = 2;
+
+    WorldSnapshot           _snapshots[nBuffers];
+    std::atomic<bool>       _snapshotBusy[nBuffers];
+
+    std::atomic<uint64_t>   _lastCheckpointTick;
+    double                  _lastCaptureTime;
+    std::atomic<double>     _lastWriteTime;
+
+    WorkerThread            _writer; // destroyed first so that pending writes finish
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_CHECKPOINTER_HPP
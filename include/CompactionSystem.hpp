@@ -0,0 +1,89 @@
+//
+// Project: evolution_simulator_2
+// File: CompactionSystem.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_COMPACTIONSYSTEM_HPP
+#define EVOLUTION_SIMULATOR_2_COMPACTIONSYSTEM_HPP
+
+
+#include <ecs/System.hpp>
+#include <ecs/Ecs.hpp>
+#include <graphics/Orientation2DComponent.hpp>
+#include <gut_utils/TypeUtils.hpp>
+#include <utility>
+
+
+/** @brief  Incremental reordering of creature and food storage along a Z-order curve
+ *
+ *  A pass collects the ids of all creatures and food and sorts them by the Morton
+ *  code of their position. The entities are then permuted within the (ascending) id
+ *  set of their type by swapping component contents, so that the ECS storage and
+ *  iteration order follows the curve and spatial neighbours end up close in memory.
+ *  The swaps are spread over ticks with a budget. Entities created or removed during
+ *  a pass are skipped, which only makes the order less perfect until the next pass.
+ *
+ *  Entity ids of the swapped entities change, getRelocated() follows an id over the
+ *  swaps of the last update. Not to be called with events pending.
+ */
+FUG_SYSTEM(CompactionSystem, fug::Orientation2DComponent) {
+public:
+    CompactionSystem(fug::Ecs& ecs);
+
+    // start a pass in case the interval has passed and perform at most maxSwaps swaps
+    void update(uint64_t tick, uint64_t interval, uint64_t maxSwaps);
+
+    // abandon the current pass (after the entities have been replaced)
+    void reset();
+
+    // id of an entity after the swaps of the last update
+    fug::EntityId getRelocated(fug::EntityId eId) const;
+
+    // portion of the current pass done, 1 when there's no pass in progress
+    double getProgress() const;
+
+    // collects the entities and their Morton codes
+    void operator()(const fug::EntityId& eId, fug::Orientation2DComponent& orientationComponent);
+
+private:
+    struct Entry {
+        uint32_t        code;
+        fug::EntityId   eId;
+    };
+
+    // permutation applied in place, slot by slot
+    struct Permutation {
+        Vector<fug::EntityId>   slots; // ids in ascending order
+        Vector<uint32_t>        target; // original slot of the entity to be placed into each slot
+        Vector<uint32_t>        where; // current slot of each original entity
+        Vector<uint32_t>        who; // original entity in each slot
+        size_t                  cursor;
+
+        void build(Vector<Entry>& entries);
+        bool finished() const;
+    };
+
+    fug::Ecs&                   _ecs;
+    Vector<Entry>               _creatures; // scratch for collection
+    Vector<Entry>               _food;
+    float                       _worldSize; // of the current pass
+    Permutation                 _creaturePermutation;
+    Permutation                 _foodPermutation;
+    uint64_t                    _passTick; // tick on which the last pass was started
+    bool                        _passStarted;
+    Vector<std::pair<fug::EntityId, fug::EntityId>>    _swaps; // of the last update
+
+    void startPass();
+
+    // advance the permutation by one slot, T_TypeComponent identifies the entity type
+    template <typename T_TypeComponent>
+    void step(Permutation& permutation);
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_COMPACTIONSYSTEM_HPP
@@ -16,16 +16,20 @@
 
 #include "MutationStage.hpp"
 
+#include <string>
+
 
 struct ConfigSingleton {
-    static constexpr float  worldSize = 1024.0f; // world size (ranges from -worldSize to worldSize)
+    static constexpr float  defaultWorldSize = 1024.0f;
     static constexpr float  spriteRadius = 64.0f; // sprite radius in pixels
     static constexpr double minCreatureMass = 0.1;
     static constexpr double maxCreatureMass = 64.0; // maximum mass a creature can grow to
     static constexpr double minFoodMass = 0.01; // food starting mass
     static constexpr double maxFoodMass = 64.0; // maximum mass a food can grow to
     static constexpr float  maxObjectRadius = 8.0f; // square root of max(maxCreatureMass, maxFoodMass)
+    static constexpr float  spawnSpread = 0.25f; // std. dev. of initial and respawned creature placement relative to worldSize
 
+    float   worldSize = defaultWorldSize; // world size (ranges from -worldSize to worldSize), see Simulation::setWorldSize
     double  creatureEnergyUseConstant = 0.1; // energy used every tick, relative to sqrt of mass
     double  creatureAccelerationEnergyUseConstant = 0.2; // multiplier for energy used in acceleration
     double  creatureTurnEnergyUseConstant = 0.2; // multiplier for energy used in turning (relative to square of the turn amount)
@@ -41,8 +45,27 @@ struct ConfigSingleton {
     double  foodSpoilRate = 0.005; // amount of mass reduced from each rotting food (meat) entity each tick
 
     Vector<MutationStage>   mutationStages;
+    bool                    genomeDeltaStorage = false; // store child genomes as a delta to the parent genome
+    uint64_t                genomeDeltaCompactionThreshold = 256; // delta size (genes) after which a dense genome is created
+
+    uint64_t    checkpointInterval = 0; // ticks between automatic checkpoints, 0 to disable
+    std::string checkpointFileName = "checkpoint.snapshot";
+
+    float       speciesDistanceThreshold = 0.1f; // RMS gene difference at which a genome founds a new species
+    uint64_t    speciesSamplesPerTick = 256; // creatures (re)assigned to species every tick
+
+    uint64_t    gridCellSizeTuningInterval = 64; // ticks between spatial grid cell size adjustments, 0 to keep the size fixed
+    // ticks between full spatial index rebuilds with incremental updates in between, 0 to rebuild twice per tick
+    uint64_t    spatialIndexRebuildInterval = 0;
+
+    uint64_t    compactionInterval = 256; // ticks between the starts of spatial compaction passes, 0 to disable
+    uint64_t    compactionSwapsPerTick = 2048; // entity swaps performed per tick during a compaction pass
 
     ConfigSingleton();
+
+    // set a tunable parameter by its member name, mutation stages are addressed with
+    // "mutationStage<i>.probability" / "mutationStage<i>.amplitude"
+    bool setParameter(const std::string& name, double value);
 };
 
 
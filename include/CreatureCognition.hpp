@@ -13,6 +13,7 @@
 
 
 #include <Eigen/Dense>
+#include <memory>
 
 
 class Genome;
@@ -66,12 +67,17 @@ public:
     using AttackOutput = Eigen::Matrix<float, attackOutputSize, 1>;
 
     CreatureCognition(const Genome& genome);
+    CreatureCognition(const CreatureCognition& other);
+    CreatureCognition(CreatureCognition&&) noexcept = default;
+    CreatureCognition& operator=(const CreatureCognition& other);
+    CreatureCognition& operator=(CreatureCognition&&) noexcept = default;
 
     const Output& forward();
 
     AttackOutput attack(AttackInput& input) const;
 
     const Memory& getMemory() const;
+    void setMemory(const Memory& memory);
 
     static constexpr uint64_t totalSize =
         Dims<Layer1>::total +
@@ -88,19 +94,31 @@ public:
     friend class CreatureSystem;
 
 private:
-    Layer1              _layer1 = Layer1::Zero();
-    Layer2              _layer2 = Layer2::Zero();
-    Layer3              _layer3 = Layer3::Zero();
-    Layer3MemoryValue   _layer3MemoryValue = Layer3MemoryValue::Zero();
-    Layer3MemoryGate    _layer3MemoryGate = Layer3MemoryGate::Zero();
-    Layer4              _layer4 = Layer4::Zero();
-    Layer5              _layer5 = Layer5::Zero();
-    AttackLayer1        _attackLayer1 = AttackLayer1::Zero();
-    AttackLayer2        _attackLayer2 = AttackLayer2::Zero();
+    // network weights, stored out of the component in a slab pool slot
+    struct Weights {
+        Layer1              layer1;
+        Layer2              layer2;
+        Layer3              layer3;
+        Layer3MemoryValue   layer3MemoryValue;
+        Layer3MemoryGate    layer3MemoryGate;
+        Layer4              layer4;
+        Layer5              layer5;
+        AttackLayer1        attackLayer1;
+        AttackLayer2        attackLayer2;
+    };
+
+    struct WeightsDeleter {
+        void operator()(Weights* weights) const;
+    };
 
+    using WeightsPointer = std::unique_ptr<Weights, WeightsDeleter>;
+
+    WeightsPointer      _weights;
     Input               _input = Input::Zero();
     Output              _output = Output::Zero();
     Memory              _memory = Memory::Zero();
+
+    static WeightsPointer allocateWeights(const Weights* source = nullptr);
 };
 
 
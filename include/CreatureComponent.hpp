@@ -15,6 +15,7 @@
 #include <gut_utils/MathUtils.hpp>
 #include <Genome.hpp>
 #include <CreatureCognition.hpp>
+#include <SpeciesSingleton.hpp>
 
 
 struct CreatureComponent {
@@ -34,6 +35,9 @@ public:
     float               speed;
     double              age;
     double              agingFactor;
+    uint32_t            lineageSlot; // node in PhylogenySingleton
+    SpeciesSingleton::Membership    species;
+    bool                ghost; // replica of a creature owned by another process, not simulated
 
     CreatureCognition   cognition;
 };
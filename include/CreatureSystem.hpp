@@ -25,7 +25,10 @@ public:
         DYNAMICS,
         REPRODUCTION,
         ADD_TO_WORLD,
-        PROCESS_INPUTS
+        PROCESS_INPUTS,
+        DRAW_LINES, // whiskers from the inputs of PROCESS_INPUTS, no raycasts
+        TELEMETRY,
+        SPECIES
     };
 
     CreatureSystem(fug::Ecs& ecs);
@@ -60,6 +63,18 @@ private:
     void processInputs(const fug::EntityId& eId,
         CreatureComponent& creatureComponent,
         fug::Orientation2DComponent& orientationComponent);
+
+    void drawLines(const fug::EntityId& eId,
+        CreatureComponent& creatureComponent,
+        fug::Orientation2DComponent& orientationComponent);
+
+    void telemetry(const fug::EntityId& eId,
+        CreatureComponent& creatureComponent,
+        fug::Orientation2DComponent& orientationComponent);
+
+    void species(const fug::EntityId& eId,
+        CreatureComponent& creatureComponent,
+        fug::Orientation2DComponent& orientationComponent);
 };
 
 
@@ -0,0 +1,123 @@
+//
+// Project: evolution_simulator_2
+// File: DomainDecomposition.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_DOMAINDECOMPOSITION_HPP
+#define EVOLUTION_SIMULATOR_2_DOMAINDECOMPOSITION_HPP
+
+
+#include <Simulation.hpp>
+#include <BoundarySystem.hpp>
+#include <Transport.hpp>
+#include <Genome.hpp>
+
+
+/** @brief  Simulates one rectangular region of a world split between processes
+ *
+ *  Each process owns the creatures and food inside its region. On every update, entities
+ *  that have left the region are migrated to the owner of their new position, and entities
+ *  near another region are sent to it as ghosts: replicas that are seen by its collision
+ *  detection and whiskers, but not simulated. Collisions only move and feed the local
+ *  creature, the energy attacked ghosts lose and the mass eaten from ghost food is sent back
+ *  to their owners.
+ */
+class DomainDecomposition {
+public:
+    // regions form a nRegionsX*nRegionsY grid over the world, one per rank of the transport
+    DomainDecomposition(Simulation& simulation, Transport& transport, uint32_t nRegionsX, uint32_t nRegionsY);
+    ~DomainDecomposition();
+
+    DomainDecomposition(const DomainDecomposition&) = delete;
+    DomainDecomposition(DomainDecomposition&&) = delete;
+    DomainDecomposition& operator=(const DomainDecomposition&) = delete;
+    DomainDecomposition& operator=(DomainDecomposition&&) = delete;
+
+    // attach to the simulation, to be called after setting the world size
+    bool init();
+    // remove the entities outside the own region, for starting from a population that is
+    // identical on all ranks
+    void claimRegion();
+
+    uint32_t getRegion() const;
+    // owned entities, ghosts excluded
+    uint64_t getNumberOfCreatures();
+    uint64_t getNumberOfFood();
+    uint64_t getNumberOfGhosts() const;
+    // entities migrated since init
+    uint64_t getNumberOfEmigrants() const;
+    uint64_t getNumberOfImmigrants() const;
+    // an exchange has failed, the region no longer takes part in the simulation
+    bool hasFailed() const;
+
+private:
+    enum class Kind : uint32_t {
+        CREATURE,
+        FOOD
+    };
+
+    // the owner id is valid on the owning rank until its next compaction
+    struct GhostRecord {
+        int64_t     owner;
+        uint32_t    kind;
+        uint32_t    foodType;
+        float       position[2];
+        float       scale;
+        float       direction;
+        float       color[3];
+        double      mass;
+        double      energy;
+    };
+
+    struct EffectRecord {
+        int64_t     owner;
+        uint32_t    kind;
+        double      delta; // creature energy or food mass
+    };
+
+    struct Ghost {
+        fug::EntityId   eId;
+        fug::EntityId   owner;
+        uint32_t        region;
+        Kind            kind;
+        double          value; // creature energy or food mass on creation
+    };
+
+    Simulation&     _simulation;
+    fug::Ecs&       _ecs;
+    Transport&      _transport;
+    uint32_t        _nRegionsX;
+    uint32_t        _nRegionsY;
+    float           _haloWidth;
+    BoundarySystem  _boundarySystem;
+    Genome          _ghostGenome; // ghosts don't think, they share a genome
+
+    Vector<Ghost>           _ghosts;
+    uint64_t                _nGhostCreatures;
+    uint64_t                _nGhostFood; // ghost food still in the world
+    Vector<Vector<char>>    _outgoing;
+    Vector<Vector<char>>    _incoming;
+    Vector<float>           _genes; // scratch
+    uint64_t                _nEmigrants;
+    uint64_t                _nImmigrants;
+    bool                    _failed;
+
+    void beforeCollisions();
+    void afterCollisions();
+
+    void migrate();
+    void sendGhosts();
+    // remove an owned creature or food
+    void removeEntity(fug::EntityId eId);
+    // let the world exclude the ghosts from the owned entity counts
+    void updateGhostCounts();
+    bool exchange();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_DOMAINDECOMPOSITION_HPP
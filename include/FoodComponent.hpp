@@ -23,6 +23,7 @@ struct FoodComponent {
 
     Type    type;
     double  mass;
+    bool    ghost; // replica of food owned by another process, not simulated
 
     FoodComponent(Type type = Type::PLANT, double mass = ConfigSingleton::minFoodMass);
 };
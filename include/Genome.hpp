@@ -14,13 +14,26 @@
 
 #include <gut_utils/TypeUtils.hpp>
 #include <CreatureCognition.hpp>
+#include <SlabPool.hpp>
+#include <array>
+#include <memory>
 
 
-class Genome : protected Vector<float> {
+/** @brief  Creature genome
+ *
+ *  The genes are stored as a dense, immutable gene array shared (reference counted)
+ *  between copies of the genome, plus a sparse delta of genes changed since. Copying
+ *  a genome therefore only copies the delta. Mutations are recorded into the delta,
+ *  compact() merges it into a fresh dense gene array. Both the gene arrays and the
+ *  deltas are allocated from slab pools.
+ */
+class Genome {
 public:
     static constexpr size_t genomeHeaderSize = 8;
     static constexpr size_t genomeSize = genomeHeaderSize+CreatureCognition::totalSize;
 
+    using Genes = std::array<float, genomeSize>;
+
     enum { // indices for addressing the genome
         CREATURE_SIZE = 0,
         METABOLIC_CONSTANT = 1,
@@ -39,19 +52,40 @@ public:
         MULTIPLICATIVE = 1
     };
 
-    // methods exposed from Vector
-    using Vector<float>::operator[];
-    using Vector<float>::begin;
-    using Vector<float>::end;
-
     Genome(float amplitude = 1.0f, float cognitionAmplitude = 0.001f);
     Genome(Vector<float>&& vector);
+    Genome(const float* genes); // copy genomeSize genes from a raw buffer
+
+    float operator[](size_t i) const;
 
     void mutate(float probability, float amplitude, MutationMode mode);
 
+    // write all genomeSize genes to a buffer
+    void copyTo(float* genes) const;
+
+    // merge the delta into a fresh dense gene array
+    void compact();
+
+    // number of genes stored in the delta
+    size_t deltaSize() const;
+
     // Minimum and maximum values the genome can get
     static const Genome minGenome;
     static const Genome maxGenome;
+
+private:
+    struct GeneDelta {
+        uint32_t    index;
+        float       value;
+    };
+
+    using Delta = std::vector<GeneDelta, PoolAllocator<GeneDelta>>;
+
+    std::shared_ptr<const Genes>    _genes;
+    Delta                           _delta; // sorted by index
+
+    static float mutateGene(size_t i, float value, float amplitude, MutationMode mode);
+    static std::shared_ptr<Genes> allocateGenes();
 };
 
 
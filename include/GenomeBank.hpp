@@ -0,0 +1,95 @@
+//
+// Project: evolution_simulator_2
+// File: GenomeBank.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_GENOMEBANK_HPP
+#define EVOLUTION_SIMULATOR_2_GENOMEBANK_HPP
+
+
+#include <Genome.hpp>
+#include <ecs/Ecs.hpp>
+#include <gut_utils/TypeUtils.hpp>
+#include <string>
+
+
+/** @brief  Compressed archive of genomes
+ *
+ *  Genes are quantized to 16 bits over the per-gene value range of the archived
+ *  population and stored as zigzag varint deltas against a reference genome
+ *  (per-gene mean). The file consists of a header, per-gene minimums and maximums,
+ *  the quantized reference genome, an offset index with one entry per genome (plus
+ *  an end offset) and the encoded genome data, so that any genome can be decoded
+ *  directly from a memory mapping.
+ */
+class GenomeBank {
+public:
+    static constexpr char       magic[8] = { 'E', 'V', 'O', 'G', 'B', 'A', 'N', 'K' };
+    static constexpr uint32_t   version = 1;
+    static constexpr uint32_t   quantizationBits = 16;
+    static constexpr uint32_t   quantizationMax = (1u << quantizationBits) - 1;
+
+    struct Header {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    headerSize;
+        uint32_t    genomeSize;
+        uint32_t    quantizationBits;
+        uint64_t    nGenomes;
+
+        // block offsets from the beginning of the file
+        uint64_t    minimumsOffset;
+        uint64_t    maximumsOffset;
+        uint64_t    referenceOffset;
+        uint64_t    indexOffset;
+        uint64_t    dataOffset;
+        uint64_t    fileSize;
+    };
+
+    GenomeBank();
+    ~GenomeBank();
+
+    GenomeBank(const GenomeBank&) = delete;
+    GenomeBank(GenomeBank&&) = delete;
+    GenomeBank& operator=(const GenomeBank&) = delete;
+    GenomeBank& operator=(GenomeBank&&) = delete;
+
+    // export: collect genomes and write them into a file
+    void clear();
+    void addGenome(const Genome& genome);
+    bool write(const std::string& fileName) const;
+
+    // import: map a file and decode genomes from it
+    bool load(const std::string& fileName);
+    void decode(uint64_t genomeId, float* genes) const;
+    Genome getGenome(uint64_t genomeId) const;
+
+    // create nCreatures creatures with genomes drawn in order from the (loaded) bank,
+    // positioned like in the initial world population
+    void populate(fug::Ecs& ecs, uint64_t nCreatures) const;
+
+    uint64_t size() const; // number of genomes in the bank
+
+private:
+    Vector<float>       _genes; // collected, not yet encoded genomes
+
+    Header              _header;
+    const float*        _minimums;
+    const float*        _maximums;
+    const uint16_t*     _reference;
+    const uint64_t*     _index;
+    const uint8_t*      _data;
+
+    void*               _mapping;
+    size_t              _mappingSize;
+
+    void releaseMapping();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_GENOMEBANK_HPP
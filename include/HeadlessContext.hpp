@@ -0,0 +1,43 @@
+//
+// Project: evolution_simulator_2
+// File: HeadlessContext.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_HEADLESSCONTEXT_HPP
+#define EVOLUTION_SIMULATOR_2_HEADLESSCONTEXT_HPP
+
+
+#include <SDL.h>
+
+
+/** @brief  Hidden window with the OpenGL context required by the map and sprite resources
+ *
+ *  For running simulations without a visible window (benchmarks, parameter sweeps).
+ *  SDL is initialized and shut down with the context, so only one may exist per process.
+ */
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext(HeadlessContext&&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(HeadlessContext&&) = delete;
+
+    // create the window and make the context current, name labels the window
+    bool init(const char* name);
+
+private:
+    bool            _sdlInitialized;
+    SDL_Window*     _window;
+    SDL_GLContext   _glContext;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_HEADLESSCONTEXT_HPP
@@ -0,0 +1,77 @@
+//
+// Project: evolution_simulator_2
+// File: HotPathCounters.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_HOTPATHCOUNTERS_HPP
+#define EVOLUTION_SIMULATOR_2_HOTPATHCOUNTERS_HPP
+
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+/** @brief  Per-thread event counters of the spatial query and contact hot paths
+ *
+ *  Each thread only writes its own counter block, so the increments are plain loads
+ *  and stores (relaxed atomics) without any locking. The blocks of all threads are
+ *  summed once per tick. Counters are process-wide, not per simulation.
+ */
+class HotPathCounters {
+public:
+    enum Counter {
+        GRID_QUERIES,
+        GRID_CELLS_VISITED,
+        GRID_CANDIDATES, // entities returned by WorldSingleton::getEntities
+        COLLISION_TESTS, // narrow-phase distance tests
+        COLLISION_HITS,
+        WHISKER_TESTS, // ray-circle intersection tests
+        WHISKER_HITS,
+        EVENTS_DISPATCHED,
+        EVENT_ROUNDS, // event system swaps with pending events
+        ENTITIES_CREATED,
+        ENTITIES_REMOVED,
+        N_COUNTERS
+    };
+
+    using Values = std::array<uint64_t, N_COUNTERS>;
+
+    static void add(Counter counter, uint64_t amount = 1)
+    {
+        auto& value = threadBlock().values[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    // sum of the counters of all threads since the previous call
+    static Values collect();
+
+    static const char* getName(Counter counter);
+
+private:
+    struct Block {
+        std::atomic<uint64_t>   values[N_COUNTERS] {};
+    };
+
+    struct Registry;
+
+    static inline thread_local Block* _threadBlock = nullptr;
+
+    static Block& threadBlock()
+    {
+        if (_threadBlock == nullptr)
+            _threadBlock = registerThread();
+        return *_threadBlock;
+    }
+
+    static Block* registerThread();
+    static Registry& registry();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_HOTPATHCOUNTERS_HPP
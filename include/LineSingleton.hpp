@@ -34,8 +34,16 @@ public:
     void drawLine(const Vec2f& p1, const Vec2f& p2,
         const Vec3f& c1 = Vec3f(1.0f, 1.0f, 1.0f), const Vec3f& c2 = Vec3f(1.0f, 1.0f, 1.0f));
 
+    // append vertex pairs, as in drawLine
+    void drawLines(const Vector<Vec2f>& positions, const Vector<Vec3f>& colors);
+    // replace the contents of positions and colors with the lines drawn so far and clear them
+    void moveLines(Vector<Vec2f>& positions, Vector<Vec3f>& colors);
+
     void render(const Mat3f& viewport = Mat3f::Identity());
 
+    // discard the lines drawn since the last render (render clears them as well)
+    void clear();
+
 private:
     gut::Shader                 _shader;
 
@@ -19,19 +19,38 @@
 #include <gut_opengl/Texture.hpp>
 #include <gut_image/Image.hpp>
 #include <gut_utils/TypeUtils.hpp>
+#include <glad/glad.h>
+#include <mutex>
 
 
+/** @brief  Fertility map, diffused on the GPU
+ *
+ *  The map may be rendered by another thread (and context) than the one stepping the
+ *  simulation. Fences order the diffusion against the rendering in either context.
+ */
 class MapSingleton {
 public:
     MapSingleton();
 
+    // extents of the world the map is stretched over (ranges from -worldSize to worldSize)
+    void setWorldSize(float worldSize);
+
     void prefetch();
     void map();
     void unmap();
     gut::Image& fertilityMap();
 
     void diffuseFertility();
-    Vector<Vec2f> sampleFertility(int nSamples);
+    // replaces the contents of samples, reusing its capacity
+    void sampleFertility(Vector<Vec2f>& samples, int nSamples);
+
+    // fertility map dimensions in pixels
+    int width();
+    int height();
+
+    // copy the fertility map to / from a row-major buffer of width()*height() floats
+    void readFertility(float* data);
+    void writeFertility(const float* data);
 
     void render(const Viewport& viewport);
 
@@ -43,6 +62,16 @@ private:
     gut::Texture    _fertilityMapTexture;
     gut::Image*     _fertilityMapImage;
     float           _averageFertility;
+    float           _worldSize;
+
+    std::mutex      _textureMutex; // guards the texture swap, the fences and the world size
+    GLsync          _diffusionFence; // signaled once the last diffusion has been written
+    GLsync          _renderFence; // signaled once the last render has sampled the texture
+
+    // replace the fence with one signaled after the commands issued so far / make the
+    // current context wait for it, both require _textureMutex
+    static void setFence(GLsync& fence);
+    static void waitForFence(GLsync fence);
 };
 
 
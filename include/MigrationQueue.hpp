@@ -0,0 +1,67 @@
+//
+// Project: evolution_simulator_2
+// File: MigrationQueue.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_MIGRATIONQUEUE_HPP
+#define EVOLUTION_SIMULATOR_2_MIGRATIONQUEUE_HPP
+
+
+#include <Genome.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+
+// creature moving between worlds, trivially copyable for shared memory
+struct Migrant {
+    float   genes[Genome::genomeSize];
+    double  mass;
+    double  energyRatio; // energy relative to the storage capacity
+};
+
+
+/** @brief  Lock-free single producer, single consumer ring buffer of migrants
+ *
+ *  The control block and the slots live in a caller-provided memory block, so the
+ *  two ends can be in different threads or in processes sharing the mapping (an
+ *  anonymous MAP_SHARED mapping created before forking). Neither end ever blocks,
+ *  pushing to a full queue fails instead.
+ */
+class MigrationQueue {
+public:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared queue requires lock-free atomics");
+
+    // bytes of memory required for a queue of the given capacity
+    static size_t requiredSize(uint32_t capacity);
+
+    MigrationQueue();
+
+    // construct an empty queue in memory (aligned to 64 bytes) of requiredSize(capacity) bytes
+    void init(void* memory, uint32_t capacity);
+
+    // producer end
+    bool tryPush(const Migrant& migrant);
+    uint32_t getFreeSlots() const;
+
+    // consumer end
+    bool tryPop(Migrant& migrant);
+
+private:
+    struct Control {
+        alignas(64) std::atomic<uint64_t>   head; // next slot to pop, written by the consumer
+        alignas(64) std::atomic<uint64_t>   tail; // next slot to push, written by the producer
+    };
+
+    Control*    _control;
+    Migrant*    _slots;
+    uint32_t    _capacity;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_MIGRATIONQUEUE_HPP
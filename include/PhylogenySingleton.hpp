@@ -0,0 +1,122 @@
+//
+// Project: evolution_simulator_2
+// File: PhylogenySingleton.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_PHYLOGENYSINGLETON_HPP
+#define EVOLUTION_SIMULATOR_2_PHYLOGENYSINGLETON_HPP
+
+
+#include <WorkerThread.hpp>
+#include <gut_utils/TypeUtils.hpp>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+
+
+/** @brief  Lineage tracker
+ *
+ *  Every creature gets a node in an arena-backed tree. Only nodes needed to connect
+ *  the living population are retained: a dead node without children is removed and
+ *  a dead node with a single child is spliced out of the tree (coalescence), which
+ *  keeps the tree below two nodes per living creature. Removed nodes are written
+ *  to the lineage file in segments on a background thread, so the file contains the
+ *  complete genealogy as (id, parent id, birth tick, death tick) records.
+ */
+class PhylogenySingleton {
+public:
+    static constexpr char       magic[8] = { 'E', 'V', 'O', 'P', 'H', 'Y', 'L', 'O' };
+    static constexpr uint32_t   version = 1;
+    static constexpr uint32_t   invalidSlot = std::numeric_limits<uint32_t>::max();
+    static constexpr uint64_t   noTick = std::numeric_limits<uint64_t>::max(); // creature still alive
+    static constexpr uint32_t   arenaBlockSize = 4096; // nodes per arena block
+    static constexpr uint32_t   segmentSize = 4096; // records per streamed segment
+
+    struct Record {
+        uint64_t    id;
+        uint64_t    parentId; // 0 for creatures without a parent
+        uint64_t    birthTick;
+        uint64_t    deathTick;
+    };
+
+    PhylogenySingleton();
+    ~PhylogenySingleton();
+
+    PhylogenySingleton(const PhylogenySingleton&) = delete;
+    PhylogenySingleton(PhylogenySingleton&&) = delete;
+    PhylogenySingleton& operator=(const PhylogenySingleton&) = delete;
+    PhylogenySingleton& operator=(PhylogenySingleton&&) = delete;
+
+    // start streaming lineage records to a file
+    bool open(const std::string& fileName);
+    // write the retained nodes (living creatures have noTick as death tick) and the pending segment,
+    // and close the file
+    void close();
+    bool isOpen() const;
+
+    // register a creature, returns its slot (stored in CreatureComponent::lineageSlot)
+    uint32_t addBirth(uint32_t parentSlot, uint64_t tick);
+    void addDeath(uint32_t slot, uint64_t tick);
+
+    // write out all retained nodes and clear the tree (used when the world is replaced)
+    void reset();
+
+    uint64_t getId(uint32_t slot) const;
+    uint64_t getNumberOfNodes() const; // retained in memory
+    uint64_t getNumberOfRecordsWritten() const;
+
+private:
+    struct Node {
+        Record      record;
+        uint32_t    parent; // closest retained ancestor
+        uint32_t    firstChild;
+        uint32_t    prevSibling;
+        uint32_t    nextSibling;
+        uint32_t    nChildren;
+        bool        alive;
+    };
+
+    // arena with stable node addresses, freed slots are recycled
+    Vector<std::unique_ptr<Node[]>> _blocks;
+    uint32_t                        _nSlots;
+    Vector<uint32_t>                _freeSlots;
+    uint64_t                        _nNodes;
+
+    uint64_t                        _nextId;
+
+    FILE*                           _file;
+    Vector<Record>                  _segment;
+    uint64_t                        _nRecordsWritten;
+    std::unique_ptr<WorkerThread>   _writer;
+
+    inline Node& node(uint32_t slot);
+    inline const Node& node(uint32_t slot) const;
+
+    uint32_t allocate();
+    void link(uint32_t slot, uint32_t parent);
+    void unlink(uint32_t slot);
+    void remove(uint32_t slot); // emit the record and free the slot
+    void coalesce(uint32_t slot);
+    void emit(const Record& record);
+    void flushSegment();
+};
+
+
+PhylogenySingleton::Node& PhylogenySingleton::node(uint32_t slot)
+{
+    return _blocks[slot / arenaBlockSize][slot % arenaBlockSize];
+}
+
+const PhylogenySingleton::Node& PhylogenySingleton::node(uint32_t slot) const
+{
+    return _blocks[slot / arenaBlockSize][slot % arenaBlockSize];
+}
+
+
+#endif //EVOLUTION_SIMULATOR_2_PHYLOGENYSINGLETON_HPP
@@ -0,0 +1,193 @@
+//
+// Project: evolution_simulator_2
+// File: Profiler.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_PROFILER_HPP
+#define EVOLUTION_SIMULATOR_2_PROFILER_HPP
+
+
+#include <gut_utils/TypeUtils.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+#define PROFILE_CONCAT_IMPL(A, B) A##B
+#define PROFILE_CONCAT(A, B) PROFILE_CONCAT_IMPL(A, B)
+
+#ifdef EVOLUTION_SIMULATOR_PROFILING
+// time the enclosing scope, NAME must be a string literal
+#define PROFILE_SCOPE(NAME) \
+    static const uint32_t PROFILE_CONCAT(profileStage, __LINE__) = Profiler::instance().registerStage(NAME); \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileStage, __LINE__))
+// record a sample of a counter track into the trace, NAME must be a string literal
+#define PROFILE_COUNTER(NAME, VALUE) \
+    do { \
+        static const uint32_t profileCounter = Profiler::instance().registerCounter(NAME); \
+        Profiler::instance().setCounter(profileCounter, (double)(VALUE)); \
+    } while (false)
+// name the calling thread in the trace
+#define PROFILE_THREAD(NAME) Profiler::instance().setThreadName(NAME)
+// close the current frame, to be called once per main loop iteration
+#define PROFILE_FRAME() Profiler::instance().endFrame()
+#else
+#define PROFILE_SCOPE(NAME) ((void)0)
+#define PROFILE_COUNTER(NAME, VALUE) ((void)0)
+#define PROFILE_THREAD(NAME) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#endif
+
+
+/** @brief  Hierarchical scope profiler
+ *
+ *  Scopes are recorded as spans into per-thread buffers. Once per frame the spans
+ *  are collected, the time spent in each stage is summed and stored into a rolling
+ *  history from which percentiles are computed. The spans of the last frame are
+ *  retained for the timeline view.
+ *
+ *  While a trace is being captured, the spans and counter samples are additionally
+ *  stored into a ring buffer, which can be written in the trace event JSON format
+ *  understood by chrome://tracing and Perfetto.
+ */
+class Profiler {
+public:
+    static constexpr uint32_t historySize = 240; // frames
+    static constexpr size_t defaultTraceCapacity = 1 << 18; // events
+
+    struct Span {
+        uint32_t    stage;
+        uint32_t    thread; // index in the order the threads recorded their first span
+        uint32_t    depth;
+        uint64_t    begin; // nanoseconds since the profiler was created
+        uint64_t    end;
+    };
+
+    struct StageStatistics { // in seconds, per frame
+        double  last;
+        double  p50;
+        double  p95;
+        double  p99;
+    };
+
+    static Profiler& instance();
+
+    Profiler(const Profiler&) = delete;
+    Profiler(Profiler&&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    Profiler& operator=(Profiler&&) = delete;
+
+    // stages with the same name share the id
+    uint32_t registerStage(const std::string& name);
+
+    void beginSpan(uint64_t& begin, uint32_t& depth);
+    void endSpan(uint32_t stage, uint64_t begin, uint32_t depth);
+
+    // counters with the same name share the id
+    uint32_t registerCounter(const std::string& name);
+    void setCounter(uint32_t counter, double value);
+
+    // name of the calling thread in the trace
+    void setThreadName(const std::string& name);
+
+    void endFrame();
+
+    uint32_t getNumberOfStages() const;
+    std::string getStageName(uint32_t stage) const;
+    StageStatistics getStatistics(uint32_t stage) const;
+
+    // spans of the last finished frame, sorted by thread and begin time
+    const Vector<Span>& getLastFrameSpans() const;
+    uint64_t getLastFrameBegin() const;
+    uint64_t getLastFrameEnd() const;
+
+    uint64_t now() const;
+
+    // starting an already running capture discards the captured events
+    void startTrace(size_t capacity = defaultTraceCapacity);
+    void stopTrace();
+    bool isTracing() const;
+    size_t getNumberOfTraceEvents() const;
+    // captured events are retained until the next capture is started
+    bool writeTrace(const std::string& fileName) const;
+
+private:
+    struct TraceEvent {
+        enum class Type : uint32_t {
+            SPAN,
+            COUNTER
+        };
+
+        Type        type;
+        uint32_t    id; // stage or counter
+        uint32_t    thread;
+        uint64_t    begin;
+        union {
+            uint64_t    end;
+            double      value;
+        };
+    };
+
+    struct ThreadBuffer {
+        std::mutex      mutex;
+        Vector<Span>    spans;
+        std::string     name;
+        uint32_t        index;
+        uint32_t        depth; // only accessed by the owning thread
+        bool            released; // owning thread has exited, guarded by _mutex
+    };
+
+    Profiler();
+
+    ThreadBuffer& threadBuffer();
+    void pushTraceEvent(const TraceEvent& event); // requires _mutex
+
+    mutable std::mutex                      _mutex;
+    Vector<std::string>                     _stageNames;
+    Vector<std::string>                     _counterNames;
+    Vector<std::unique_ptr<ThreadBuffer>>   _threads;
+
+    Vector<Vector<double>>                  _history; // per stage ring buffer of frame totals
+    uint32_t                                _historyPosition;
+    uint32_t                                _nHistoryFrames;
+
+    Vector<Span>                            _frameSpans;
+    Vector<double>                          _frameTotals;
+    Vector<Span>                            _lastFrameSpans;
+    uint64_t                                _lastFrameBegin;
+    uint64_t                                _lastFrameEnd;
+    uint64_t                                _epoch;
+
+    bool                                    _tracing;
+    Vector<TraceEvent>                      _trace; // ring buffer
+    size_t                                  _tracePosition;
+    size_t                                  _nTraceEvents;
+};
+
+
+class ProfileScope {
+public:
+    explicit ProfileScope(uint32_t stage) :
+        _stage  (stage)
+    {
+        Profiler::instance().beginSpan(_begin, _depth);
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::instance().endSpan(_stage, _begin, _depth);
+    }
+
+private:
+    uint32_t    _stage;
+    uint32_t    _depth;
+    uint64_t    _begin;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_PROFILER_HPP
@@ -0,0 +1,83 @@
+//
+// Project: evolution_simulator_2
+// File: Quadtree.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_QUADTREE_HPP
+#define EVOLUTION_SIMULATOR_2_QUADTREE_HPP
+
+
+#include <utils/Types.hpp>
+#include <gut_utils/MathTypes.hpp>
+#include <gut_utils/TypeUtils.hpp>
+
+
+/** @brief  Region quadtree of entity positions with bucketed leaves
+ *
+ *  Leaves are split once they hold more than leafCapacity entities, so the depth
+ *  follows the local density and crowded areas keep a near-constant query cost.
+ *  The node topology is retained over reset() like the cells of a grid, subtrees
+ *  that stayed under the leaf capacity for a whole rebuild are collapsed.
+ *
+ *  Entries store their position, queries only return the entities inside the AABB
+ *  or within the given distance of the segment.
+ */
+class Quadtree {
+public:
+    static constexpr uint32_t   leafCapacity = 16;
+
+    // root covering the square from -halfSize to halfSize, leaves are not split below minLeafSize
+    explicit Quadtree(float halfSize = 1024.0f, float minLeafSize = 8.0f);
+
+    // changes the bounds, the tree has to be rebuilt afterwards
+    void setHalfSize(float halfSize);
+
+    // remove all entities, positions outside the bounds are clamped to them
+    void reset();
+    void insert(fug::EntityId eId, const Vec2f& position);
+    // position needs to be the one the entity was inserted / last moved with, returns false if not found
+    bool remove(fug::EntityId eId, const Vec2f& position);
+    bool move(fug::EntityId eId, const Vec2f& from, const Vec2f& to);
+
+    // append the entities inside an AABB / within distance radius from the segment,
+    // return the number of nodes visited
+    uint64_t getEntities(Vector<fug::EntityId>& entities, const Vec2f& begin, const Vec2f& end) const;
+    uint64_t getEntitiesAlongRay(Vector<fug::EntityId>& entities,
+        const Vec2f& begin, const Vec2f& end, float radius) const;
+
+    size_t getNumberOfNodes() const;
+
+private:
+    struct Entry {
+        Vec2f           position;
+        fug::EntityId   eId;
+    };
+
+    struct Node {
+        Vector<Entry>   entries; // leaves only
+        uint32_t        firstChild; // four consecutive nodes, 0 for leaves
+        uint32_t        nEntities; // in the subtree since the last reset
+    };
+
+    float               _halfSize;
+    float               _minLeafSize;
+    Vector<Node>        _nodes; // root first
+    Vector<uint32_t>    _freeBlocks; // first nodes of unused child quadruples
+    size_t              _nNodes; // in use
+
+    Vec2f clamp(const Vec2f& position) const;
+    void split(uint32_t node, const Vec2f& center, float halfSize, uint32_t depth);
+    void collapse(uint32_t node);
+    void release(uint32_t node); // releases the children of a node recursively
+
+    template <typename T_Overlaps, typename T_Contains>
+    uint64_t query(Vector<fug::EntityId>& entities, T_Overlaps&& overlaps, T_Contains&& contains) const;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_QUADTREE_HPP
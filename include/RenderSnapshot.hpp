@@ -0,0 +1,76 @@
+//
+// Project: evolution_simulator_2
+// File: RenderSnapshot.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_RENDERSNAPSHOT_HPP
+#define EVOLUTION_SIMULATOR_2_RENDERSNAPSHOT_HPP
+
+
+#include <SpeciesSingleton.hpp>
+#include <AllocationTracker.hpp>
+#include <gut_utils/MathUtils.hpp>
+#include <gut_utils/TypeUtils.hpp>
+#include <ecs/Ecs.hpp>
+
+
+// what's drawn of the world, captured at the end of a tick (Simulation::captureRenderSnapshot)
+struct RenderSnapshot {
+    enum class Type : uint8_t {
+        CREATURE,
+        FOOD
+    };
+
+    uint64_t        tick;
+
+    // one element per entity
+    Vector<Vec2f>   positions;
+    Vector<float>   rotations;
+    Vector<float>   scales;
+    Vector<Vec3f>   colors;
+    Vector<Type>    types;
+
+    // debug lines (whiskers), two vertices per line
+    Vector<Vec2f>   linePositions;
+    Vector<Vec3f>   lineColors;
+
+    // world state shown by the GUI, so that it doesn't need to lock the world (Window::captureStatus)
+    struct Status {
+        uint64_t                            nCreatures = 0;
+        uint64_t                            nFood = 0;
+        Vector<double>                      telemetry; // last row, TelemetrySingleton::nColumns
+        bool                                telemetryRecording = false;
+        Vector<AllocationTracker::Counts>   stageAllocations; // per Simulation::Stage
+        double                              compactionTime = 0.0; // seconds
+        double                              compactionProgress = 0.0;
+        bool                                gridIndex = true; // quadtree otherwise
+        float                               gridCellSize = 0.0f;
+        uint64_t                            nGridChunks = 0;
+        uint64_t                            nQuadtreeNodes = 0;
+        uint64_t                            nSpecies = 0;
+        uint64_t                            nAssigned = 0; // creatures assigned to a species
+        Vector<SpeciesSingleton::Species>   species; // largest first, up to maxListedSpecies
+        uint64_t                            nPhylogenyNodes = 0;
+        uint64_t                            nPhylogenyRecords = 0;
+        bool                                lineageRecording = false;
+        uint64_t                            lastCheckpointTick = 0;
+        double                              checkpointCaptureTime = 0.0;
+        double                              checkpointWriteTime = 0.0;
+        fug::EntityId                       activeCreature = -1; // -1 when none is selected
+        double                              activeCreatureEnergy = 0.0;
+        Vec2f                               activeCreaturePosition = Vec2f(0.0f, 0.0f);
+        Vec3f                               activeCreatureColor = Vec3f(1.0f, 1.0f, 1.0f);
+
+        static constexpr size_t             maxListedSpecies = 16;
+    };
+
+    Status          status;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_RENDERSNAPSHOT_HPP
@@ -0,0 +1,149 @@
+//
+// Project: evolution_simulator_2
+// File: Simulation.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_SIMULATION_HPP
+#define EVOLUTION_SIMULATOR_2_SIMULATION_HPP
+
+
+#include <CreatureSystem.hpp>
+#include <FoodSystem.hpp>
+#include <CollisionSystem.hpp>
+#include <CompactionSystem.hpp>
+#include <WorldSingleton.hpp>
+#include <SnapshotSystem.hpp>
+#include <WorldSnapshot.hpp>
+#include <Checkpointer.hpp>
+#include <GenomeBank.hpp>
+#include <MigrationQueue.hpp>
+#include <RenderSnapshot.hpp>
+#include <AllocationTracker.hpp>
+#include <ecs/Ecs.hpp>
+#include <graphics/SpriteSingleton.hpp>
+#include <functional>
+#include <string>
+
+
+/** @brief  World state and the systems stepping it, without any windowing or rendering
+ *
+ *  The map and sprite resources still require a current OpenGL context.
+ */
+class Simulation {
+public:
+    enum Stage { // timed parts of a tick
+        COGNITION,
+        DYNAMICS,
+        REPRODUCTION,
+        FOOD, // food creation and growth, creature respawning
+        SPATIAL_INDEX, // addEntitiesToWorld, incremental updates are included in the other stages
+        BOUNDARY, // boundary callbacks
+        COLLISION,
+        COMPACTION, // spatial reordering of the entity storage
+        SPECIES,
+        TELEMETRY,
+        CHECKPOINT,
+        INPUTS, // processInputs, the last stage of update
+        MAP, // diffuseMap
+        N_STAGES
+    };
+
+    Simulation();
+
+    Simulation(const Simulation&) = delete;
+    Simulation(Simulation&&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+    Simulation& operator=(Simulation&&) = delete;
+
+    // initialize resources, spriteSheetId must contain the creature and food sprites
+    void init(fug::SpriteSheetId spriteSheetId);
+
+    // world extents (ranges from -worldSize to worldSize), to be called after init and before populating
+    void setWorldSize(float worldSize);
+    // spatial index backend, to be called before populating
+    void setSpatialIndex(WorldSingleton::IndexType indexType);
+
+    // create creatures with gaussian placement (std. dev. spread, negative for ConfigSingleton::spawnSpread
+    // times the world size) around the world center and plant food sampled from the fertility map
+    void populate(uint64_t nCreatures, uint64_t nFood, float spread = -1.0f);
+
+    // called on every update before collision detection and after the collision events have
+    // been handled, for exchanging boundary entities with other processes (DomainDecomposition)
+    void setBoundaryCallbacks(std::function<void()> beforeCollisions, std::function<void()> afterCollisions);
+
+    // world step function (food creation etc.), ends with processInputs
+    void update();
+    // compute creature inputs (vision), to be called after changing the world outside update
+    void processInputs();
+    // fertility map diffusion (GPGPU pass)
+    void diffuseMap();
+
+    // full rebuild of the spatial index
+    void addEntitiesToWorld();
+
+    // capture the entities, the whiskers sensed by the last processInputs and the other lines drawn
+    // since the last capture (or clear) for rendering
+    void captureRenderSnapshot(RenderSnapshot& snapshot);
+
+    // save / load the complete world state, to be called between world updates
+    bool saveSnapshot(const std::string& fileName);
+    bool loadSnapshot(const std::string& fileName);
+
+    // export genomes of all living creatures / create creatures from exported genomes
+    bool exportGenomes(const std::string& fileName);
+    bool importGenomes(const std::string& fileName, uint64_t nCreatures);
+
+    // remove a random sample of at most nMigrants creatures from the world into migrants /
+    // create a creature from a migrant, placed like the initial population
+    void emigrate(uint64_t nMigrants, Vector<Migrant>& migrants);
+    void immigrate(const Migrant& migrant);
+
+    fug::Ecs& getEcs();
+    const Checkpointer& getCheckpointer() const;
+    const CompactionSystem& getCompactionSystem() const;
+
+    // id of an entity after the compaction swaps of the last update
+    fug::EntityId getRelocatedEntity(fug::EntityId eId) const;
+
+    // duration of a stage on the last tick, in seconds
+    double getStageTime(Stage stage) const;
+    // heap allocations of a stage on the last tick, zero unless allocation tracking is enabled
+    const AllocationTracker::Counts& getStageAllocations(Stage stage) const;
+    static const char* getStageName(Stage stage);
+
+private:
+    fug::Ecs            _ecs;
+    // Systems
+    fug::EventSystem    _eventSystem;
+    CreatureSystem      _creatureSystem;
+    FoodSystem          _foodSystem;
+    CollisionSystem     _collisionSystem;
+    CompactionSystem    _compactionSystem;
+    SnapshotSystem      _snapshotSystem;
+
+    WorldSnapshot       _snapshot;
+    Checkpointer        _checkpointer;
+    GenomeBank          _genomeBank;
+
+    double                      _nNewFood; // fractional food accumulated over ticks
+    uint64_t                    _cellSizeTuningTick; // tick of the last grid cell size estimate
+    uint64_t                    _indexRebuildTick; // tick of the last full spatial index rebuild
+    bool                        _indexRebuildPending; // index layout changed since the last rebuild
+    Vector<Vec2f>               _foodPositions; // scratch
+    Vector<fug::EntityId>       _migrantIds; // scratch
+    std::function<void()>       _beforeCollisions;
+    std::function<void()>       _afterCollisions;
+    double                      _stageTimes[N_STAGES];
+    AllocationTracker::Counts   _stageAllocations[N_STAGES];
+
+    // rebuild the spatial index unless it's updated incrementally and not due for a rebuild
+    void updateSpatialIndex();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_SIMULATION_HPP
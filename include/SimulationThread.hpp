@@ -0,0 +1,87 @@
+//
+// Project: evolution_simulator_2
+// File: SimulationThread.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_SIMULATIONTHREAD_HPP
+#define EVOLUTION_SIMULATOR_2_SIMULATIONTHREAD_HPP
+
+
+#include <Simulation.hpp>
+#include <RenderSnapshot.hpp>
+#include <TripleBuffer.hpp>
+
+#include <SDL.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+/** @brief  Steps a simulation on a thread of its own at a target tick rate
+ *
+ *  After every tick a render snapshot is published to the triple buffer. Other threads
+ *  access the simulation by locking the thread (std::unique_lock<SimulationThread>),
+ *  which makes it wait between ticks. try_lock doesn't wait for the current tick, a
+ *  failed attempt makes the thread wait after it instead.
+ */
+class SimulationThread {
+public:
+    using TickCallback = std::function<void(RenderSnapshot&)>;
+
+    SimulationThread(Simulation& simulation, TripleBuffer<RenderSnapshot>& renderBuffer);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread(SimulationThread&&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+    SimulationThread& operator=(SimulationThread&&) = delete;
+
+    // glContext shares its objects with the context the simulation was initialized with and is
+    // made current on the thread. onTick is called after every tick with the render snapshot
+    // captured of it, before the snapshot is published.
+    bool start(SDL_Window* window, SDL_GLContext glContext, TickCallback onTick = nullptr);
+    // to be called unlocked
+    void stop();
+    bool isRunning() const;
+
+    // to be called locked, a tick rate of 0 runs as fast as possible
+    void setTickRate(double tickRate);
+    void setPaused(bool paused);
+    // values last set, readable unlocked by the thread setting them
+    double getTickRate() const;
+    bool isPaused() const;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+private:
+    Simulation&                     _simulation;
+    TripleBuffer<RenderSnapshot>&   _renderBuffer;
+    SDL_Window*                     _window;
+    SDL_GLContext                   _glContext;
+    TickCallback                    _onTick;
+
+    double                          _tickRate; // ticks per second
+    bool                            _paused;
+    bool                            _quit;
+    std::atomic<uint32_t>           _nWaiting; // threads waiting for the lock
+    std::atomic<bool>               _lockRequested; // by a failed try_lock
+
+    std::mutex                      _mutex;
+    std::condition_variable         _condition;
+    std::thread                     _thread;
+
+    void run();
+    void tick();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_SIMULATIONTHREAD_HPP
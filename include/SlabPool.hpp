@@ -0,0 +1,136 @@
+//
+// Project: evolution_simulator_2
+// File: SlabPool.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_SLABPOOL_HPP
+#define EVOLUTION_SIMULATOR_2_SLABPOOL_HPP
+
+
+#include <gut_utils/TypeUtils.hpp>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+
+/** @brief  Pool of fixed-size, cache line aligned memory slots
+ *
+ *  Slots are carved from slabs allocated on demand. Freed slots are recycled in LIFO
+ *  order (most likely still in cache) and the slabs are only released along with the
+ *  pool, so that a steady population causes no heap traffic nor fragmentation.
+ *  Thread safe, slots can be freed on a different thread than they were allocated on.
+ */
+class SlabPool {
+public:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t slabSize = 256*1024; // bytes, a slab holds at least one slot
+
+    struct Statistics {
+        size_t  slotSize;
+        size_t  nSlots; // allocated in the slabs
+        size_t  nUsedSlots;
+    };
+
+    explicit SlabPool(size_t slotSize);
+    ~SlabPool();
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool(SlabPool&&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+    SlabPool& operator=(SlabPool&&) = delete;
+
+    void* allocate();
+    void deallocate(void* slot);
+
+    Statistics getStatistics() const;
+
+    // size class pool for arrays, nullptr in case size exceeds the largest class
+    static SlabPool* sizeClass(size_t size);
+    static constexpr size_t maxSizeClass = 64*1024;
+
+    // pools of the size classes and the object pools created so far
+    static Vector<Statistics> getAllStatistics();
+
+private:
+    struct FreeSlot {
+        FreeSlot*   next;
+    };
+
+    size_t              _slotSize;
+    size_t              _slotsPerSlab;
+
+    mutable std::mutex  _mutex;
+    Vector<void*>       _slabs;
+    FreeSlot*           _freeSlots;
+    size_t              _nUsedSlots;
+
+    void addSlab(); // requires _mutex
+};
+
+
+/** @brief  Standard allocator drawing from slab pools
+ *
+ *  Single objects come from a pool dedicated to the size of T, arrays from the power of
+ *  two size classes. Arrays larger than the largest class use aligned operator new.
+ *  The pools are never destroyed so that objects with static storage duration may
+ *  outlive any other static.
+ */
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    PoolAllocator() noexcept = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        if (n == 1)
+            return static_cast<T*>(pool().allocate());
+
+        auto* pool = SlabPool::sizeClass(n*sizeof(T));
+        if (pool != nullptr)
+            return static_cast<T*>(pool->allocate());
+
+        return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(SlabPool::alignment)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (n == 1) {
+            pool().deallocate(p);
+            return;
+        }
+
+        auto* pool = SlabPool::sizeClass(n*sizeof(T));
+        if (pool != nullptr) {
+            pool->deallocate(p);
+            return;
+        }
+
+        ::operator delete(p, std::align_val_t(SlabPool::alignment));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+
+private:
+    static SlabPool& pool()
+    {
+        static SlabPool& pool = *new SlabPool(sizeof(T));
+        return pool;
+    }
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_SLABPOOL_HPP
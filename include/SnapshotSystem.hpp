@@ -0,0 +1,64 @@
+//
+// Project: evolution_simulator_2
+// File: SnapshotSystem.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_SNAPSHOTSYSTEM_HPP
+#define EVOLUTION_SIMULATOR_2_SNAPSHOTSYSTEM_HPP
+
+
+#include <ecs/System.hpp>
+#include <ecs/Ecs.hpp>
+#include <graphics/Orientation2DComponent.hpp>
+#include <graphics/SpriteComponent.hpp>
+#include <gut_utils/TypeUtils.hpp>
+
+
+class WorldSnapshot;
+class GenomeBank;
+struct RenderSnapshot;
+
+
+FUG_SYSTEM(SnapshotSystem, fug::Orientation2DComponent, fug::SpriteComponent) {
+public:
+    enum class Stage {
+        CAPTURE,    // append all creatures and food to the snapshot
+        CLEAR,          // remove all creatures and food from the ECS
+        COLLECT_GENOMES, // append genomes of all creatures to the genome bank
+        SAMPLE_CREATURES, // uniform random sample of creature ids (reservoir sampling)
+        RENDER          // append all creatures and food to the render snapshot
+    };
+
+    SnapshotSystem(fug::Ecs& ecs);
+
+    void setStage(Stage stage);
+    void setSnapshot(WorldSnapshot* snapshot);
+    void setGenomeBank(GenomeBank* genomeBank);
+    // entity arrays of renderSnapshot are cleared
+    void setRenderSnapshot(RenderSnapshot* renderSnapshot);
+    // sample of at most sampleSize creatures, cleared
+    void setSample(Vector<fug::EntityId>* sample, size_t sampleSize);
+
+    void operator()(const fug::EntityId& eId,
+        fug::Orientation2DComponent& orientationComponent,
+        fug::SpriteComponent& spriteComponent);
+
+private:
+    fug::Ecs&       _ecs;
+    Stage           _stage;
+    WorldSnapshot*  _snapshot;
+    GenomeBank*     _genomeBank;
+    RenderSnapshot* _renderSnapshot;
+
+    Vector<fug::EntityId>*  _sample;
+    size_t                  _sampleSize;
+    size_t                  _nCreaturesSeen;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_SNAPSHOTSYSTEM_HPP
@@ -0,0 +1,63 @@
+//
+// Project: evolution_simulator_2
+// File: SocketTransport.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_SOCKETTRANSPORT_HPP
+#define EVOLUTION_SIMULATOR_2_SOCKETTRANSPORT_HPP
+
+
+#include <Transport.hpp>
+
+
+/** @brief  Transport over connected stream sockets, one per peer
+ *
+ *  Messages are framed with a 64-bit length prefix. Sends and receives to all peers are
+ *  interleaved with poll, so an exchange cannot deadlock on full socket buffers. Works with
+ *  any connected stream socket: the Unix socket pairs of connectLocal or TCP connections.
+ */
+class SocketTransport : public Transport {
+public:
+    // larger length prefixes are treated as a broken or desynchronized stream
+    static constexpr uint64_t maxMessageSize = 1ull << 28;
+
+    // sockets[r] is connected to rank r, sockets[rank] is unused. Takes ownership of the sockets.
+    SocketTransport(uint32_t rank, Vector<int> sockets);
+    ~SocketTransport() override;
+
+    SocketTransport(const SocketTransport&) = delete;
+    SocketTransport(SocketTransport&&) = delete;
+    SocketTransport& operator=(const SocketTransport&) = delete;
+    SocketTransport& operator=(SocketTransport&&) = delete;
+
+    // connect nRanks local processes with Unix socket pairs, to be called before forking.
+    // sockets[i][j] is the end of rank i connected to rank j, each rank closes the ends of
+    // the others with closeOthers.
+    static bool connectLocal(uint32_t nRanks, Vector<Vector<int>>& sockets);
+    static void closeOthers(uint32_t rank, Vector<Vector<int>>& sockets);
+
+    uint32_t getRank() const override;
+    uint32_t getNumberOfRanks() const override;
+
+    bool exchange(const Vector<Vector<char>>& outgoing, Vector<Vector<char>>& incoming) override;
+
+private:
+    struct Peer {
+        uint64_t    sendLength; // length prefix in native byte order
+        uint64_t    recvLength;
+        uint64_t    nSent; // bytes of prefix and payload
+        uint64_t    nReceived;
+    };
+
+    uint32_t        _rank;
+    Vector<int>     _sockets;
+    Vector<Peer>    _peers;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_SOCKETTRANSPORT_HPP
@@ -0,0 +1,101 @@
+//
+// Project: evolution_simulator_2
+// File: SpeciesSingleton.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_SPECIESSINGLETON_HPP
+#define EVOLUTION_SIMULATOR_2_SPECIESSINGLETON_HPP
+
+
+#include <Genome.hpp>
+#include <gut_utils/MathTypes.hpp>
+#include <gut_utils/TypeUtils.hpp>
+#include <limits>
+
+
+/** @brief  Incremental species clustering
+ *
+ *  Genomes are compared through a random projection sketch (sketchSize floats
+ *  instead of the full genome), scaled so that sketch distances approximate the
+ *  RMS gene difference. Clustering is online leader / k-means: a sampled creature
+ *  joins the nearest species if it is within the distance threshold, otherwise it
+ *  founds a new one, and the species centroid is moved towards the sample. Only a
+ *  round-robin window of creatures is sampled every tick, so the cost is amortized
+ *  over multiple ticks.
+ */
+class SpeciesSingleton {
+public:
+    static constexpr int        sketchSize = 32;
+    static constexpr int        maxSpecies = 64;
+    static constexpr uint32_t   noSpecies = std::numeric_limits<uint32_t>::max();
+    static constexpr uint64_t   maxCentroidWeight = 256; // centroids track drift of long-lived species
+
+    using Sketch = Eigen::Matrix<float, sketchSize, 1>;
+
+    // per-creature clustering state, stored in CreatureComponent
+    struct Membership {
+        Sketch      sketch;
+        uint32_t    slot = noSpecies;
+        bool        sketched = false; // sketch is computed once, genomes are immutable
+    };
+
+    struct Species {
+        uint64_t    label; // unique, not reused after the species dies out
+        uint64_t    size;
+        uint64_t    foundedTick;
+        float       spread; // average distance of sampled members to the centroid
+        Vec3f       color; // average color of sampled members
+    };
+
+    SpeciesSingleton();
+
+    // select the window of creatures sampled on this tick
+    void beginTick(uint64_t nCreatures, uint64_t budget, uint64_t tick);
+    // called for every creature in iteration order, returns true in case the creature is to be sampled
+    bool isSampled();
+
+    // assign a creature to a species and update the species centroid
+    void sample(const Genome& genome, Membership& membership, float distanceThreshold);
+    // remove a dead creature from its species
+    void remove(Membership& membership);
+
+    // forget all species (used when the world is replaced)
+    void reset();
+
+    // active species sorted by size (largest first)
+    const Vector<Species>& getSpecies() const;
+    uint64_t getNumberOfAssigned() const;
+
+private:
+    using Centroids = Eigen::Matrix<float, sketchSize, maxSpecies>;
+    using SpeciesDistances = Eigen::Matrix<float, 1, maxSpecies>;
+
+    Eigen::Matrix<float, sketchSize, Eigen::Dynamic>    _projection;
+    Genome::Genes                                       _genes; // scratch buffer for sketching
+
+    Centroids           _centroids;
+    SpeciesDistances    _penalty; // 0 for active species, infinity for free slots
+    Species             _slots[maxSpecies];
+    uint64_t            _weights[maxSpecies];
+    uint64_t            _nextLabel;
+    uint64_t            _nAssigned;
+
+    uint64_t            _tick;
+    uint64_t            _nCreatures;
+    uint64_t            _cursor; // first creature sampled on this tick
+    uint64_t            _windowSize;
+    uint64_t            _visitIndex;
+
+    mutable Vector<Species> _species;
+    mutable bool            _speciesDirty;
+
+    uint32_t found(const Sketch& sketch);
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_SPECIESSINGLETON_HPP
@@ -0,0 +1,153 @@
+//
+// Project: evolution_simulator_2
+// File: TelemetrySingleton.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_TELEMETRYSINGLETON_HPP
+#define EVOLUTION_SIMULATOR_2_TELEMETRYSINGLETON_HPP
+
+
+#include <WorkerThread.hpp>
+#include <HotPathCounters.hpp>
+#include <gut_utils/TypeUtils.hpp>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+/** @brief  Per-tick population aggregates streamed to a chunked columnar file
+ *
+ *  File layout: header (magic, version, number of columns, ticks per chunk) followed
+ *  by the null-terminated column names, followed by any number of chunks. Each chunk
+ *  starts with a chunk magic and the number of ticks in it, followed by one array of
+ *  doubles per column. Only a single chunk is buffered in memory, full chunks are
+ *  appended to the file on a background thread.
+ */
+class TelemetrySingleton {
+public:
+    static constexpr char       magic[8] = { 'E', 'V', 'O', 'T', 'E', 'L', 'E', 'M' };
+    static constexpr uint32_t   chunkMagic = 0x4b4e4843; // "CHNK"
+    static constexpr uint32_t   version = 3;
+    static constexpr uint32_t   chunkTicks = 256;
+    static constexpr int        nHistogramBins = 16;
+
+    enum Quantity { // per-creature quantities with a mean and a histogram column
+        MASS,
+        ENERGY, // relative to the energy storage capacity
+        AGE, // log2 bins
+        SPEED, // absolute value
+        METABOLIC_CONSTANT,
+        N_QUANTITIES
+    };
+
+    enum Column { // scalar columns, followed by mean and histogram columns of each quantity
+        TICK,
+        N_CREATURES,
+        N_FOOD,
+        BIRTHS,
+        DEATHS,
+        KILLS,
+        CREATURE_BIOMASS,
+        FOOD_BIOMASS,
+        TOTAL_BIOMASS,
+        N_SPECIES,
+        LARGEST_SPECIES,
+        HOT_PATH_COUNTERS, // one column per HotPathCounters::Counter
+        N_SCALAR_COLUMNS = HOT_PATH_COUNTERS + HotPathCounters::N_COUNTERS
+    };
+
+    static constexpr int nColumns = N_SCALAR_COLUMNS + N_QUANTITIES*(1+nHistogramBins);
+
+    TelemetrySingleton();
+    ~TelemetrySingleton();
+
+    TelemetrySingleton(const TelemetrySingleton&) = delete;
+    TelemetrySingleton(TelemetrySingleton&&) = delete;
+    TelemetrySingleton& operator=(const TelemetrySingleton&) = delete;
+    TelemetrySingleton& operator=(TelemetrySingleton&&) = delete;
+
+    // start streaming to a file (appended to in case it exists and has a matching header)
+    bool open(const std::string& fileName);
+    // flush the partial chunk and close the file
+    void close();
+    bool isOpen() const;
+
+    // event counters, reset at the end of each tick
+    void countBirth();
+    void countDeath();
+    void countKill();
+
+    // per-entity samples, gathered once per tick
+    void addCreature(double mass, double energyRatio, double age, float speed, float metabolicConstant);
+    void addFood(double mass);
+    void setSpecies(uint64_t nSpecies, uint64_t largestSpeciesSize);
+    void setHotPathCounters(const HotPathCounters::Values& values);
+
+    // reduce the samples of the tick and append a row to the chunk buffer
+    void endTick(uint64_t tick, uint64_t nCreatures, uint64_t nFood);
+
+    // value of a column on the last finished tick
+    double getLastValue(int column) const;
+    static const char* getColumnName(int column);
+
+    static int meanColumn(Quantity quantity);
+    static int histogramColumn(Quantity quantity, int bin);
+    static int hotPathColumn(HotPathCounters::Counter counter);
+
+private:
+    // partial result of the reduction over creatures
+    struct Accumulator {
+        uint64_t    n;
+        double      sum[N_QUANTITIES];
+        uint64_t    histogram[N_QUANTITIES][nHistogramBins];
+
+        Accumulator();
+        void add(const double (&values)[N_QUANTITIES]);
+        void merge(const Accumulator& other);
+    };
+
+    // creature samples in structure-of-arrays layout, capacity is retained between ticks
+    Vector<double>                  _samples[N_QUANTITIES];
+    Vector<Accumulator>             _partials; // per reduction thread, capacity is retained
+
+    // persistent reduction threads, started by the first reduction large enough to be distributed
+    Vector<std::thread>             _reductionThreads;
+    std::mutex                      _reductionMutex;
+    std::condition_variable         _reductionStarted;
+    std::condition_variable         _reductionFinished;
+    uint64_t                        _reductionRound; // incremented to start a round on all threads
+    unsigned                        _nReductionsPending; // threads still working on the round
+    size_t                          _reductionSize; // number of samples in the round
+    bool                            _reductionStopped;
+
+    uint64_t                        _births;
+    uint64_t                        _deaths;
+    uint64_t                        _kills;
+    double                          _foodBiomass;
+    uint64_t                        _nSpecies;
+    uint64_t                        _largestSpecies;
+    HotPathCounters::Values         _hotPathCounters;
+
+    double                          _lastRow[nColumns];
+
+    FILE*                           _file;
+    Vector<double>                  _chunk; // column-major, chunkTicks values per column
+    uint32_t                        _chunkSize; // number of ticks in the chunk
+    std::unique_ptr<WorkerThread>   _writer;
+
+    Accumulator reduce();
+    void reduceRange(unsigned threadId, unsigned nThreads, size_t n);
+    void reductionLoop(unsigned threadId, unsigned nThreads);
+    void flushChunk();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_TELEMETRYSINGLETON_HPP
@@ -0,0 +1,38 @@
+//
+// Project: evolution_simulator_2
+// File: Transport.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_TRANSPORT_HPP
+#define EVOLUTION_SIMULATOR_2_TRANSPORT_HPP
+
+
+#include <gut_utils/TypeUtils.hpp>
+
+#include <cstdint>
+
+
+/** @brief  Message exchange between the processes of a distributed simulation
+ *
+ *  Every process (rank) takes part in each exchange, which sends one message to and
+ *  receives one message from every other rank. Messages may be empty.
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual uint32_t getRank() const = 0;
+    virtual uint32_t getNumberOfRanks() const = 0;
+
+    // send outgoing[r] to rank r and receive the message of rank r to incoming[r] for all
+    // other ranks, blocks until done. Returns false if a peer has disconnected.
+    virtual bool exchange(const Vector<Vector<char>>& outgoing, Vector<Vector<char>>& incoming) = 0;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_TRANSPORT_HPP
@@ -0,0 +1,74 @@
+//
+// Project: evolution_simulator_2
+// File: TripleBuffer.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_TRIPLEBUFFER_HPP
+#define EVOLUTION_SIMULATOR_2_TRIPLEBUFFER_HPP
+
+
+#include <atomic>
+#include <cstdint>
+
+
+/** @brief  Lock-free hand-over of the latest state from one writer thread to one reader thread
+ *
+ *  The writer fills the back buffer and publishes it, the reader picks up the most recently
+ *  published buffer. Neither end ever waits, states published in between reads are skipped.
+ *  The buffers are reused, so containers in T keep their capacity.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() :
+        _middle (1),
+        _back   (0),
+        _front  (2)
+    {
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // writer end
+    T& getBack()
+    {
+        return _buffers[_back];
+    }
+
+    void publish()
+    {
+        _back = _middle.exchange(_back | newBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // reader end, returns true in case a newer state was picked up
+    bool update()
+    {
+        if ((_middle.load(std::memory_order_relaxed) & newBit) == 0)
+            return false;
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    T& getFront()
+    {
+        return _buffers[_front];
+    }
+
+private:
+    static constexpr uint32_t newBit = 4; // middle buffer has been published after the last update
+    static constexpr uint32_t indexMask = 3;
+
+    T                       _buffers[3];
+    std::atomic<uint32_t>   _middle; // index and newBit
+    uint32_t                _back;
+    uint32_t                _front;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_TRIPLEBUFFER_HPP
@@ -12,6 +12,8 @@
 #define EVOLUTION_SIMULATOR_UTILS_HPP
 
 
+#include <algorithm>
+#include <limits>
 #include <random>
 #include <ecs/Ecs.hpp>
 #include <gut_utils/MathTypes.hpp>
@@ -27,10 +29,16 @@
 #define RNDRANGE(MIN, MAX) (MIN + RND*(MAX-MIN))
 
 
-inline __attribute__((always_inline)) int64_t generateRandomNumber()
+// engine behind RND, RNDS and RNDRANGE, exposed for storing and restoring its state
+inline std::default_random_engine& randomEngine()
 {
     static std::default_random_engine rnd(1507715517);
-    return rnd();
+    return rnd;
+}
+
+inline __attribute__((always_inline)) int64_t generateRandomNumber()
+{
+    return randomEngine()();
 }
 
 template <typename T>
@@ -43,6 +51,51 @@ inline __attribute__((always_inline)) T gauss2(const Eigen::Matrix<T,2,1>& p, T
     return gauss(p(0), sigma) * gauss(p(1), sigma);
 }
 
+// ray parameter t of the closer intersection of ray p + t*v and a circle, infinity in case they do not intersect
+inline __attribute__((always_inline)) float rayCircleIntersection(
+    const Vec2f& p, const Vec2f& v, const Vec2f& center, float radius)
+{
+    // helper vector required in lot of subsequent quadratic term calculations
+    Vec2f pc = p-center;
+
+    // quadratic terms of 2D ray-circle intersection
+    float a = v(0)*v(0) + v(1)*v(1);
+    float b = 2.0f*(v(0)*pc(0) + v(1)*pc(1));
+    float c = pc(0)*pc(0) + pc(1)*pc(1) - radius*radius;
+
+    // no intersection when determinant is < 0
+    float det = b*b - 4.0f*a*c;
+    if (det < 0.0f)
+        return std::numeric_limits<float>::infinity();
+
+    // solve quadratic (only negative used since it's always the closer one)
+    return (-b-sqrtf(det))/(2.0f*a);
+}
+
+// whether the segment from begin to end intersects an AABB (slab test)
+inline __attribute__((always_inline)) bool segmentIntersectsAABB(
+    const Vec2f& begin, const Vec2f& end, const Vec2f& boxBegin, const Vec2f& boxEnd)
+{
+    float tMin = 0.0f;
+    float tMax = 1.0f;
+    for (int i=0; i<2; ++i) {
+        float d = end(i)-begin(i);
+        if (d == 0.0f) {
+            if (begin(i) < boxBegin(i) || begin(i) > boxEnd(i))
+                return false;
+            continue;
+        }
+
+        float t1 = (boxBegin(i)-begin(i)) / d;
+        float t2 = (boxEnd(i)-begin(i)) / d;
+        tMin = std::max(tMin, std::min(t1, t2));
+        tMax = std::min(tMax, std::max(t1, t2));
+        if (tMin > tMax)
+            return false;
+    }
+    return true;
+}
+
 fug::EntityId createFood(fug::Ecs& ecs, FoodComponent::Type type, double mass, const Vec2f& position);
 fug::EntityId createCreature(fug::Ecs& ecs, Genome&& genome, double mass, double energyRatio,
     const Vec2f& position, float direction, float speed);
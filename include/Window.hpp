@@ -13,14 +13,17 @@
 
 
 #include <Viewport.hpp>
-#include <CreatureSystem.hpp>
-#include <FoodSystem.hpp>
-#include <CollisionSystem.hpp>
+#include <Simulation.hpp>
+#include <SimulationThread.hpp>
+#include <WorldRenderer.hpp>
+#include <TripleBuffer.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <functional>
 #include <string>
 #include <SDL.h>
 #include <glad/glad.h>
 #include <ecs/Ecs.hpp>
-#include <graphics/SpriteSystem.hpp>
 
 
 class Window {
@@ -90,13 +93,19 @@ public:
     struct Settings {
         WindowSettings window;
         GLSettings gl;
+        float worldSize; // see ConfigSingleton::worldSize
+        WorldSingleton::IndexType spatialIndex;
 
         explicit Settings(
-                const WindowSettings& window    = WindowSettings(),
-                const GLSettings& gl            = GLSettings()
+                const WindowSettings& window            = WindowSettings(),
+                const GLSettings& gl                    = GLSettings(),
+                float worldSize                         = ConfigSingleton::defaultWorldSize,
+                WorldSingleton::IndexType spatialIndex  = WorldSingleton::IndexType::GRID
         ) :
                 window          (window),
-                gl              (gl)
+                gl              (gl),
+                worldSize       (worldSize),
+                spatialIndex    (spatialIndex)
         {}
     };
 
@@ -112,36 +121,67 @@ public:
 
     void updateGUI();
 
-    // world step function (food creation etc.)
-    void updateWorld(void);
+    // apply the GUI actions and config edits and step the world unless threaded, to be called locked
+    void updateWorld();
+    // GUI readouts of the world, to be called locked
+    void captureStatus(RenderSnapshot::Status& status);
+    // select the creature at a world position, to be called locked
+    void pickCreature(const Vec2f& position);
 
-    void addEntitiesToWorld(void);
+    // start or stop the simulation thread, to be called without holding its lock
+    void setThreaded(bool threaded);
+
+    // load a snapshot and deselect the active creature, to be called locked
+    bool loadSnapshot(const std::string& fileName);
+
+    // capture a profiler trace, written when stopped from the GUI or when the loop exits
+    void startTrace(const std::string& fileName, size_t capacity);
 
 private:
     Settings            _settings;
     SDL_Window*         _window;
     SDL_GLContext       _glCtx;
+    SDL_GLContext       _simulationGlCtx; // shared with _glCtx, current on the simulation thread
 
     bool                _quit; // flag for quitting the application
     bool                _paused; // flag for pausing the simulation
+    bool                _threaded; // simulation runs on its own thread instead of once per frame
+    double              _tickRate; // target ticks per second of the simulation thread, 0 for unlimited
+    bool                _fastForward; // several ticks per frame, without a thread
+    uint64_t            _speedMultiplier; // target ticks per frame in fast-forward
+    uint64_t            _frameTicks; // ticks run on the last frame
+    bool                _renderPending; // world changed since the loop last captured it, also when threaded
     Viewport            _viewport;
     Vec2f               _cursorPosition;
-    fug::EntityId       _activeCreature;
+    fug::EntityId       _activeCreature; // accessed locked, the GUI shows RenderSnapshot::Status
+    uint64_t            _activeCreatureLineageId; // detects reuse of the entity id
     bool                _activeCreatureFollow;
+    Vector<fug::EntityId> _pickedEntities; // scratch for picking the clicked creature
+
+    Vector<std::function<void()>> _worldActions; // queued by the GUI until the world is locked
+    ConfigSingleton     _config; // edited by the GUI, copied from / to the world when locked
+    bool                _configEdited;
+    bool                _lockRequested; // the simulation thread waits after its tick until locked
+
+    uint64_t            _lastCounter; // SDL performance counter
+    double              _frameTime; // seconds
+    uint64_t            _tickRateCounter; // SDL performance counter of the last tick rate measurement
+    uint64_t            _tickRateTick; // world tick of the last tick rate measurement
+    double              _ticksPerSecond;
 
-    uint32_t            _lastTicks;
-    uint32_t            _frameTicks;
+    char                _snapshotFileName[256];
+    char                _telemetryFileName[256];
+    char                _genomeBankFileName[256];
+    char                _phylogenyFileName[256];
+    char                _traceFileName[256];
 
     Window::Context     _windowContext;
 
-    // ECS
-    fug::Ecs            _ecs;
-    // Systems
-    fug::EventSystem    _eventSystem;
-    CreatureSystem      _creatureSystem;
-    FoodSystem          _foodSystem;
-    CollisionSystem     _collisionSystem;
-    fug::SpriteSystem   _spriteSystem;
+    Simulation                      _simulation;
+    fug::Ecs&                       _ecs;
+    TripleBuffer<RenderSnapshot>    _renderBuffer;
+    WorldRenderer                   _worldRenderer;
+    SimulationThread                _simulationThread; // stopped before the simulation is destroyed
 
     // Resources
     fug::SpriteSheetId  _spriteSheetId;
@@ -0,0 +1,68 @@
+//
+// Project: evolution_simulator_2
+// File: WorkerThread.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_WORKERTHREAD_HPP
+#define EVOLUTION_SIMULATOR_2_WORKERTHREAD_HPP
+
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+/** @brief  Background thread executing jobs in submission order
+ *
+ *  The job queue is bounded so that a slow consumer (disk) cannot make the
+ *  producer (simulation) accumulate unbounded amounts of pending data.
+ */
+class WorkerThread {
+public:
+    using Job = std::function<void()>;
+
+    // name is used to label the thread in profiler traces
+    explicit WorkerThread(size_t maxQueuedJobs = 4, const std::string& name = "worker");
+
+    WorkerThread(const WorkerThread&) = delete;
+    WorkerThread(WorkerThread&&) = delete;
+    WorkerThread& operator=(const WorkerThread&) = delete;
+    WorkerThread& operator=(WorkerThread&&) = delete;
+
+    // finishes all queued jobs before returning
+    ~WorkerThread();
+
+    // returns false without queuing the job in case the queue is full
+    bool tryPush(Job&& job);
+
+    // blocks until there's space in the queue
+    void push(Job&& job);
+
+    // blocks until all queued jobs have been executed
+    void wait();
+
+private:
+    size_t                  _maxQueuedJobs;
+    std::string             _name;
+    std::deque<Job>         _jobs;
+    bool                    _running; // a job is being executed
+    bool                    _quit;
+
+    std::mutex              _mutex;
+    std::condition_variable _jobAvailable;
+    std::condition_variable _jobFinished;
+    std::thread             _thread;
+
+    void run();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_WORKERTHREAD_HPP
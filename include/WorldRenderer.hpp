@@ -0,0 +1,53 @@
+//
+// Project: evolution_simulator_2
+// File: WorldRenderer.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_WORLDRENDERER_HPP
+#define EVOLUTION_SIMULATOR_2_WORLDRENDERER_HPP
+
+
+#include <Viewport.hpp>
+#include <RenderSnapshot.hpp>
+#include <ecs/Ecs.hpp>
+#include <graphics/SpriteSystem.hpp>
+
+
+/** @brief  Draws the creatures, food and debug lines of render snapshots
+ *
+ *  The sprites are entities of an ECS of its own, so drawing never touches the simulated
+ *  world and the simulation may be stepped on another thread meanwhile.
+ */
+class WorldRenderer {
+public:
+    WorldRenderer();
+
+    WorldRenderer(const WorldRenderer&) = delete;
+    WorldRenderer(WorldRenderer&&) = delete;
+    WorldRenderer& operator=(const WorldRenderer&) = delete;
+    WorldRenderer& operator=(WorldRenderer&&) = delete;
+
+    // load the sprites and the line shader, requires a current OpenGL context
+    void init(int windowWidth, int windowHeight);
+
+    // replace the drawn sprites with the entities of snapshot, the lines of the latest snapshot
+    // are drawn on every render
+    void setSnapshot(const RenderSnapshot& snapshot);
+
+    void render(const Viewport& viewport);
+
+private:
+    fug::Ecs                _ecs;
+    fug::SpriteSystem       _spriteSystem;
+    Vector<fug::EntityId>   _entities;
+    Vector<Vec2f>           _linePositions;
+    Vector<Vec3f>           _lineColors;
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_WORLDRENDERER_HPP
@@ -13,44 +13,158 @@
 
 
 #include <ConfigSingleton.hpp>
+#include <Quadtree.hpp>
 #include <utils/Types.hpp>
 #include <gut_utils/MathTypes.hpp>
 #include <gut_utils/TypeUtils.hpp>
+#include <cmath>
+#include <memory>
 #include <unordered_map>
 
 
+/** @brief  Spatial index and entity bookkeeping of the world
+ *
+ *  The uniform grid is sparse: cells are grouped into square chunks which are only
+ *  allocated once an entity is added into them, so the memory use is independent of
+ *  the world extents. Chunks left empty for a whole rebuild are released for reuse.
+ *
+ *  The cell size can be tuned to the live entity density: the occupancy of the cells
+ *  and the extents of the queries are tracked, from which the cell size minimizing the
+ *  expected cost of a query (cells visited plus candidates returned) is estimated.
+ *
+ *  Alternatively the entities can be indexed with a quadtree, which adapts to heavily
+ *  clustered populations and only returns the entities inside the queried region.
+ *
+ *  In the incremental mode the index records the slot of every entity and is kept up
+ *  to date by updateEntity() and removeEntity() as entities spawn, move and despawn,
+ *  instead of being rebuilt with reset() and addEntity() every tick. Grid entities are
+ *  only relocated when they cross a cell boundary.
+ */
 class WorldSingleton {
 public:
     enum class EntityType {
         CREATURE,
-        FOOD
+        FOOD,
+        N_ENTITY_TYPES
     };
 
-    WorldSingleton();
+    enum class IndexType {
+        GRID,
+        QUADTREE
+    };
+
+    static constexpr float      defaultCellSize = ConfigSingleton::maxObjectRadius*2.0f;
+    static constexpr int64_t    chunkShift = 4;
+    static constexpr int64_t    chunkSize = 1 << chunkShift; // cells per chunk side
+    static constexpr float      minCellSize = ConfigSingleton::maxObjectRadius;
+    static constexpr float      maxCellSize = ConfigSingleton::maxObjectRadius*32.0f;
+    // relative costs of visiting a cell and of a candidate returned by a query
+    static constexpr double     cellCost = 1.0;
+    static constexpr double     candidateCost = 2.0;
+
+    explicit WorldSingleton(float cellSize = defaultCellSize);
+
+    // both change the index layout, the index has to be rebuilt afterwards
+    void setIndexType(IndexType indexType);
+    void setWorldSize(float worldSize);
+    IndexType getIndexType() const;
+
+    // the index has to be rebuilt after switching the mode
+    void setIncremental(bool incremental);
+    bool isIncremental() const;
 
     void reset();
     void addEntity(const fug::EntityId& eId, const Vec2f& position, EntityType entityType);
 
+    // insert or relocate / remove an entity in the incremental mode, no-ops otherwise
+    void updateEntity(const fug::EntityId& eId, const Vec2f& position, EntityType entityType);
+    void removeEntity(const fug::EntityId& eId);
+
     // get entities inside an AABB
     void getEntities(Vector<fug::EntityId>& entities, const Vec2f& begin, const Vec2f& end) const;
+    // get entities within distance radius from the segment from begin to end
+    void getEntitiesAlongRay(Vector<fug::EntityId>& entities,
+        const Vec2f& begin, const Vec2f& end, float radius) const;
 
     // get number of entities of specific type
     uint64_t getNumberOf(EntityType entityType);
+    // ghosts are mirrored from other processes (DomainDecomposition), they're included in getNumberOf
+    void setNumberOfGhosts(EntityType entityType, uint64_t nGhosts);
+    // get number of entities of specific type simulated by this process
+    uint64_t getNumberOfOwned(EntityType entityType);
+
+    // simulation tick counter, advanced once per world update
+    uint64_t getTick() const;
+    void setTick(uint64_t tick);
+    void advanceTick();
+
+    float getCellSize() const;
+    // changes the cell mapping, the grid has to be rebuilt afterwards
+    void setCellSize(float cellSize);
+
+    // grid cell size minimizing the expected query cost, estimated from the occupancy of the last
+    // rebuild and the queries since the last call, returns the current size in case there's no data
+    float estimateOptimalCellSize();
+    // number of allocated grid chunks / quadtree nodes in use
+    size_t getNumberOfChunks() const;
+    size_t getNumberOfQuadtreeNodes() const;
 
 private:
-    static constexpr float      cellSize = ConfigSingleton::maxObjectRadius*2.0f;
-    static constexpr int64_t    gridSize = int64_t((ConfigSingleton::worldSize*2.0)/cellSize)+1;
+    struct Chunk {
+        Vector<fug::EntityId>   cells[chunkSize*chunkSize];
+        int64_t                 x; // chunk coordinates
+        int64_t                 y;
+        uint64_t                nEntities; // added since the last reset
+    };
 
-    Vector<Vector<fug::EntityId>>               _entityGrid;
-    std::unordered_map<EntityType, uint64_t>    _numberOfEntities;
+    struct Slot { // incremental mode
+        Vec2f       position; // at insertion or the last relocation
+        uint32_t    index; // in the grid cell
+        EntityType  type;
+        bool        indexed;
+    };
 
-    static inline __attribute__((always_inline)) int64_t posToGridCoord(float p);
+    IndexType                                   _indexType;
+    Quadtree                                    _quadtree;
+    float                                       _cellSize;
+    Vector<std::unique_ptr<Chunk>>              _chunks;
+    Vector<std::unique_ptr<Chunk>>              _freeChunks; // released chunks retain the cell capacity
+    std::unordered_map<uint64_t, uint32_t>      _chunkIndex; // chunk key to index in _chunks
+    Chunk*                                      _lastChunk; // consecutive additions tend to hit the same chunk
+    uint64_t                                    _nGridEntities; // added since the last reset
+    uint64_t                                    _occupancySquares; // sum of squared cell occupancies
+    mutable uint64_t                            _nQueries; // since the last estimate
+    mutable double                              _queryExtentSum; // sum of mean AABB side lengths
+    bool                                        _incremental;
+    Vector<Slot>                                _slots; // indexed by entity id
+    uint64_t                                    _numberOfEntities[(int)EntityType::N_ENTITY_TYPES];
+    uint64_t                                    _numberOfGhosts[(int)EntityType::N_ENTITY_TYPES];
+    uint64_t                                    _tick;
+
+    inline __attribute__((always_inline)) int64_t posToGridCoord(float p) const;
+    inline __attribute__((always_inline)) static uint64_t chunkKey(int64_t x, int64_t y);
+
+    const Chunk* findChunk(int64_t x, int64_t y) const;
+    Chunk& getChunk(int64_t x, int64_t y); // allocates a missing chunk
+    void releaseChunks();
+    // returns the index of the entity in the cell
+    uint32_t gridInsert(const fug::EntityId& eId, const Vec2f& position);
+    void gridRemove(const Vec2f& position, uint32_t index);
+    void countQuery(size_t nEntitiesBefore, size_t nEntitiesAfter, uint64_t nCellsVisited, float extent) const;
+    // append the entities of the cells of a chunk inside the cell range, returns the number of cells visited
+    uint64_t getEntities(Vector<fug::EntityId>& entities, const Chunk& chunk,
+        int64_t xBegin, int64_t yBegin, int64_t xEnd, int64_t yEnd) const;
 };
 
 
-int64_t WorldSingleton::posToGridCoord(float p)
+int64_t WorldSingleton::posToGridCoord(float p) const
+{
+    return (int64_t)std::floor(p/_cellSize);
+}
+
+uint64_t WorldSingleton::chunkKey(int64_t x, int64_t y)
 {
-    return (int64_t)((p+ConfigSingleton::worldSize)/cellSize);
+    return ((uint64_t)(uint32_t)x << 32) | (uint64_t)(uint32_t)y;
 }
 
 
@@ -0,0 +1,171 @@
+//
+// Project: evolution_simulator_2
+// File: WorldSnapshot.hpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#ifndef EVOLUTION_SIMULATOR_2_WORLDSNAPSHOT_HPP
+#define EVOLUTION_SIMULATOR_2_WORLDSNAPSHOT_HPP
+
+
+#include <CreatureCognition.hpp>
+#include <Genome.hpp>
+#include <FoodComponent.hpp>
+#include <ecs/Ecs.hpp>
+#include <graphics/Orientation2DComponent.hpp>
+#include <graphics/SpriteComponent.hpp>
+#include <gut_utils/TypeUtils.hpp>
+#include <string>
+
+
+struct CreatureComponent;
+class SnapshotSystem;
+
+
+/** @brief  Complete state of a world at a tick boundary
+ *
+ *  A snapshot is either captured from an ECS (in which case it owns its data) or loaded
+ *  from a file (in which case the data is read directly from a read-only memory mapping).
+ *  The file consists of a header followed by 64-byte aligned blocks: config, mutation
+ *  stages, RNG state, creature records, genomes (one genomeSize float array per creature),
+ *  food records and the fertility map.
+ */
+class WorldSnapshot {
+public:
+    static constexpr char       magic[8] = { 'E', 'V', 'O', 'S', 'N', 'A', 'P', '\0' };
+    static constexpr uint32_t   version = 1;
+    static constexpr uint64_t   blockAlignment = 64;
+
+    struct Header {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    headerSize;
+        uint32_t    genomeSize;
+        uint32_t    memorySize;
+        uint64_t    tick;
+        uint64_t    nMutationStages;
+        uint64_t    rngStateSize;
+        uint64_t    nCreatures;
+        uint64_t    nFood;
+        uint32_t    mapWidth;
+        uint32_t    mapHeight;
+
+        // block offsets from the beginning of the file
+        uint64_t    configOffset;
+        uint64_t    mutationStagesOffset;
+        uint64_t    rngStateOffset;
+        uint64_t    creaturesOffset;
+        uint64_t    genomesOffset;
+        uint64_t    foodOffset;
+        uint64_t    mapOffset;
+        uint64_t    fileSize;
+    };
+
+    struct ConfigRecord {
+        double  creatureEnergyUseConstant;
+        double  creatureAccelerationEnergyUseConstant;
+        double  creatureTurnEnergyUseConstant;
+        double  creatureMassIncreaseFactor;
+        double  creatureFeedRate;
+        double  massEnergyStorageConstant;
+        double  foodPlantMassToEnergyConstant;
+        double  foodMeatMassToEnergyConstant;
+        double  foodPerTick;
+        double  foodGrowthRate;
+        double  foodSpoilRate;
+        float   creatureDragCoefficient;
+        float   worldSize; // 0 in snapshots predating runtime world sizes
+    };
+
+    struct MutationStageRecord {
+        float       probability;
+        float       amplitude;
+        uint32_t    mode;
+        uint32_t    padding;
+    };
+
+    struct CreatureRecord {
+        double  energy;
+        double  mass;
+        double  age;
+        double  agingFactor;
+        float   position[2];
+        float   scale;
+        float   direction;
+        float   speed;
+        float   color[3];
+        float   memory[CreatureCognition::memorySize];
+    };
+
+    struct FoodRecord {
+        double      mass;
+        float       position[2];
+        float       scale;
+        uint32_t    type;
+    };
+
+    WorldSnapshot();
+    ~WorldSnapshot();
+
+    WorldSnapshot(const WorldSnapshot&) = delete;
+    WorldSnapshot(WorldSnapshot&&) = delete;
+    WorldSnapshot& operator=(const WorldSnapshot&) = delete;
+    WorldSnapshot& operator=(WorldSnapshot&&) = delete;
+
+    // capture the current state of the ECS, to be called between world updates
+    void capture(fug::Ecs& ecs, SnapshotSystem& snapshotSystem);
+
+    // replace the state of the ECS with the one stored in the snapshot
+    void restore(fug::Ecs& ecs, SnapshotSystem& snapshotSystem) const;
+
+    // sync: flush the file to the storage device before returning
+    bool write(const std::string& fileName, bool sync = false) const;
+    bool load(const std::string& fileName);
+
+    // used by SnapshotSystem during capture
+    void addCreature(const CreatureComponent& creatureComponent,
+        const fug::Orientation2DComponent& orientationComponent,
+        const fug::SpriteComponent& spriteComponent);
+    void addFood(const FoodComponent& foodComponent,
+        const fug::Orientation2DComponent& orientationComponent);
+
+    uint64_t getTick() const;
+    uint64_t getNumberOfCreatures() const;
+    uint64_t getNumberOfFood() const;
+
+private:
+    Header                          _header;
+
+    // owned data (filled by capture)
+    ConfigRecord                    _configRecord;
+    Vector<MutationStageRecord>     _mutationStageRecords;
+    std::string                     _rngState;
+    Vector<CreatureRecord>          _creatureRecords;
+    Vector<float>                   _genomeData;
+    Vector<FoodRecord>              _foodRecords;
+    Vector<float>                   _fertilityData;
+
+    // views to either the owned data or the memory mapped file
+    const ConfigRecord*             _config;
+    const MutationStageRecord*      _mutationStages;
+    const char*                     _rng;
+    const CreatureRecord*           _creatures;
+    const float*                    _genomes;
+    const FoodRecord*               _food;
+    const float*                    _fertility;
+
+    void*                           _mapping;
+    size_t                          _mappingSize;
+    bool                            _valid; // captured or loaded, the views may be null for empty blocks
+
+    void updateOwnedViews();
+    void computeOffsets();
+    void releaseMapping();
+};
+
+
+#endif //EVOLUTION_SIMULATOR_2_WORLDSNAPSHOT_HPP
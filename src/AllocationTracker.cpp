@@ -0,0 +1,128 @@
+//
+// Project: evolution_simulator_2
+// File: AllocationTracker.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <AllocationTracker.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+
+namespace {
+
+    // constant initialized, safe to access from within operator new on any thread
+    thread_local AllocationTracker::Counts threadAllocations {0, 0};
+
+} // namespace
+
+
+AllocationTracker::Counts AllocationTracker::threadCounts()
+{
+    return threadAllocations;
+}
+
+void AllocationTracker::recordAllocation(size_t bytes)
+{
+    ++threadAllocations.allocations;
+    threadAllocations.bytes += bytes;
+}
+
+
+#ifdef EVOLUTION_SIMULATOR_ALLOCATION_TRACKING
+
+// Replacements of the global allocation functions. This translation unit is always
+// linked in since Simulation refers to AllocationTracker::threadCounts.
+
+namespace {
+
+    void* allocate(size_t size)
+    {
+        AllocationTracker::recordAllocation(size);
+        return malloc(size == 0 ? 1 : size);
+    }
+
+    void* allocateAligned(size_t size, std::align_val_t alignment)
+    {
+        AllocationTracker::recordAllocation(size);
+        void* p = nullptr;
+        if (posix_memalign(&p, std::max((size_t)alignment, sizeof(void*)), size == 0 ? 1 : size) != 0)
+            return nullptr;
+        return p;
+    }
+
+} // namespace
+
+
+void* operator new(size_t size)
+{
+    void* p = allocate(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    void* p = allocate(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* p = allocateAligned(size, alignment);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    void* p = allocateAligned(size, alignment);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+
+#endif
@@ -0,0 +1,96 @@
+//
+// Project: evolution_simulator_2
+// File: BoundarySystem.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <BoundarySystem.hpp>
+#include <CreatureComponent.hpp>
+#include <FoodComponent.hpp>
+
+#include <algorithm>
+
+
+BoundarySystem::BoundarySystem(fug::Ecs& ecs) :
+    _ecs        (ecs),
+    _stage      (Stage::EMIGRANTS),
+    _nRegionsX  (1),
+    _nRegionsY  (1),
+    _region     (0),
+    _worldSize  (1.0f),
+    _haloWidth  (0.0f),
+    _entities   (1)
+{
+}
+
+void BoundarySystem::setStage(BoundarySystem::Stage stage)
+{
+    _stage = stage;
+}
+
+void BoundarySystem::setRegions(uint32_t nRegionsX, uint32_t nRegionsY, uint32_t region,
+    float worldSize, float haloWidth)
+{
+    _nRegionsX = nRegionsX;
+    _nRegionsY = nRegionsY;
+    _region = region;
+    _worldSize = worldSize;
+    _haloWidth = haloWidth;
+    _entities.resize(nRegionsX*nRegionsY);
+}
+
+uint32_t BoundarySystem::getRegion(const Vec2f& position) const
+{
+    return regionCoordinate(position(1), _nRegionsY)*_nRegionsX + regionCoordinate(position(0), _nRegionsX);
+}
+
+void BoundarySystem::clear()
+{
+    for (auto& entities : _entities)
+        entities.clear();
+}
+
+const Vector<fug::EntityId>& BoundarySystem::getEntities(uint32_t region) const
+{
+    return _entities[region];
+}
+
+void BoundarySystem::operator()(const fug::EntityId& eId, fug::Orientation2DComponent& orientationComponent)
+{
+    auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+    if (cc != nullptr ? cc->ghost : _ecs.getComponent<FoodComponent>(eId)->ghost)
+        return;
+
+    auto& p = orientationComponent.getPosition();
+    switch (_stage) {
+        case Stage::EMIGRANTS: {
+            uint32_t region = getRegion(p);
+            if (region != _region)
+                _entities[region].push_back(eId);
+        }   break;
+        case Stage::HALO: {
+            // regions overlapping the halo square around the entity
+            uint32_t x0 = regionCoordinate(p(0)-_haloWidth, _nRegionsX);
+            uint32_t x1 = regionCoordinate(p(0)+_haloWidth, _nRegionsX);
+            uint32_t y0 = regionCoordinate(p(1)-_haloWidth, _nRegionsY);
+            uint32_t y1 = regionCoordinate(p(1)+_haloWidth, _nRegionsY);
+            for (uint32_t y=y0; y<=y1; ++y) {
+                for (uint32_t x=x0; x<=x1; ++x) {
+                    uint32_t region = y*_nRegionsX + x;
+                    if (region != _region)
+                        _entities[region].push_back(eId);
+                }
+            }
+        }   break;
+    }
+}
+
+uint32_t BoundarySystem::regionCoordinate(float x, uint32_t nRegions) const
+{
+    auto c = (int64_t)std::floor((x+_worldSize) / (2.0f*_worldSize) * (float)nRegions);
+    return (uint32_t)std::clamp(c, (int64_t)0, (int64_t)nRegions-1);
+}
@@ -0,0 +1,92 @@
+//
+// Project: evolution_simulator_2
+// File: Checkpointer.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Checkpointer.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+
+#include <chrono>
+#include <cstdio>
+
+
+Checkpointer::Checkpointer() :
+    _snapshotBusy       {false, false},
+    _lastCheckpointTick (0),
+    _lastCaptureTime    (0.0),
+    _lastWriteTime      (0.0),
+    _writer             (nBuffers, "checkpoint writer")
+{
+}
+
+void Checkpointer::update(fug::Ecs& ecs, SnapshotSystem& snapshotSystem)
+{
+    auto& config = *ecs.getSingleton<ConfigSingleton>();
+    auto& world = *ecs.getSingleton<WorldSingleton>();
+
+    if (config.checkpointInterval == 0 || world.getTick() % config.checkpointInterval != 0)
+        return;
+
+    // find a buffer not being written
+    int bufferId = -1;
+    for (int i=0; i<nBuffers; ++i) {
+        if (!_snapshotBusy[i]) {
+            bufferId = i;
+            break;
+        }
+    }
+    if (bufferId < 0) {
+        printf("Warning: Previous checkpoints still being written, skipping checkpoint at tick %lu\n",
+            world.getTick());
+        return;
+    }
+
+    auto captureStart = std::chrono::steady_clock::now();
+    auto& snapshot = _snapshots[bufferId];
+    snapshot.capture(ecs, snapshotSystem);
+    _snapshotBusy[bufferId] = true;
+    _lastCaptureTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-captureStart).count();
+
+    _writer.push([this, bufferId, fileName = config.checkpointFileName]() {
+        auto writeStart = std::chrono::steady_clock::now();
+        auto& snapshot = _snapshots[bufferId];
+
+        // write to a temporary file first so that a crash mid-write never corrupts the previous checkpoint
+        std::string tmpFileName = fileName + ".tmp";
+        if (snapshot.write(tmpFileName, true)) {
+            if (std::rename(tmpFileName.c_str(), fileName.c_str()) == 0)
+                _lastCheckpointTick = snapshot.getTick();
+            else
+                printf("Error: Could not rename %s to %s\n", tmpFileName.c_str(), fileName.c_str());
+        }
+
+        _lastWriteTime = std::chrono::duration<double>(std::chrono::steady_clock::now()-writeStart).count();
+        _snapshotBusy[bufferId] = false;
+    });
+}
+
+void Checkpointer::wait()
+{
+    _writer.wait();
+}
+
+uint64_t Checkpointer::getLastCheckpointTick() const
+{
+    return _lastCheckpointTick;
+}
+
+double Checkpointer::getLastCaptureTime() const
+{
+    return _lastCaptureTime;
+}
+
+double Checkpointer::getLastWriteTime() const
+{
+    return _lastWriteTime;
+}
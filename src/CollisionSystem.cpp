@@ -14,6 +14,7 @@
 #include <FoodComponent.hpp>
 #include <CreatureComponent.hpp>
 #include <ConfigSingleton.hpp>
+#include <HotPathCounters.hpp>
 
 
 CollisionSystem::CollisionSystem(fug::Ecs& ecs, fug::EventSystem& eventSystem) :
@@ -26,6 +27,10 @@ void CollisionSystem::operator()(const fug::EntityId& eId,
     CreatureComponent& creatureComponent,
     fug::Orientation2DComponent& orientationComponent)
 {
+    // ghosts only get collided with, their owner handles their own collisions
+    if (creatureComponent.ghost)
+        return;
+
     float radius = orientationComponent.getScale()*ConfigSingleton::spriteRadius;
     Vec2f collisionBoxVec(
         radius+ConfigSingleton::maxObjectRadius, radius+ConfigSingleton::maxObjectRadius);
@@ -38,14 +43,23 @@ void CollisionSystem::operator()(const fug::EntityId& eId,
         getEntities(entities, p-collisionBoxVec, p+collisionBoxVec);
 
     // check collisions
+    uint64_t nTests = 0;
+    uint64_t nHits = 0;
     for (auto& ceId : entities) {
         if (ceId == eId) // don't self-collide
             continue;
 
+        ++nTests;
         auto& oc2 = *_ecs.getComponent<fug::Orientation2DComponent>(ceId);
         float dis = (orientationComponent.getPosition()-oc2.getPosition()).norm(); // distance to other object
         float minDis = (orientationComponent.getScale()+oc2.getScale())*ConfigSingleton::spriteRadius; // distance required
-        if (dis < minDis) // collision
+        if (dis < minDis) { // collision
             _eventSystem.sendEvent(eId, CollisionEvent(ceId));
+            ++nHits;
+        }
     }
+
+    HotPathCounters::add(HotPathCounters::COLLISION_TESTS, nTests);
+    HotPathCounters::add(HotPathCounters::COLLISION_HITS, nHits);
 }
+
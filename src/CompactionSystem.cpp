@@ -0,0 +1,192 @@
+//
+// Project: evolution_simulator_2
+// File: CompactionSystem.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <CompactionSystem.hpp>
+#include <CreatureComponent.hpp>
+#include <FoodComponent.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <graphics/SpriteComponent.hpp>
+
+#include <algorithm>
+
+
+namespace {
+
+    // spread the lower 16 bits of x to the even bits
+    inline uint32_t spreadBits(uint32_t x)
+    {
+        x &= 0x0000ffff;
+        x = (x | (x << 8)) & 0x00ff00ff;
+        x = (x | (x << 4)) & 0x0f0f0f0f;
+        x = (x | (x << 2)) & 0x33333333;
+        x = (x | (x << 1)) & 0x55555555;
+        return x;
+    }
+
+    inline uint32_t mortonCode(const Vec2f& p, float worldSize)
+    {
+        float scale = 65535.0f / (2.0f*worldSize);
+        auto x = (uint32_t)std::clamp((p(0)+worldSize)*scale, 0.0f, 65535.0f);
+        auto y = (uint32_t)std::clamp((p(1)+worldSize)*scale, 0.0f, 65535.0f);
+        return spreadBits(x) | (spreadBits(y) << 1);
+    }
+
+    template <typename T_Component>
+    void swapComponents(fug::Ecs& ecs, fug::EntityId a, fug::EntityId b)
+    {
+        using std::swap;
+        swap(*ecs.getComponent<T_Component>(a), *ecs.getComponent<T_Component>(b));
+    }
+
+} // namespace
+
+
+void CompactionSystem::Permutation::build(Vector<CompactionSystem::Entry>& entries)
+{
+    size_t n = entries.size();
+
+    slots.resize(n);
+    for (size_t i=0; i<n; ++i)
+        slots[i] = entries[i].eId;
+    std::sort(slots.begin(), slots.end());
+
+    // original slot of each entity, then the entities in curve order
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.code < b.code;
+    });
+    target.resize(n);
+    for (size_t i=0; i<n; ++i)
+        target[i] = (uint32_t)(std::lower_bound(slots.begin(), slots.end(), entries[i].eId) - slots.begin());
+
+    where.resize(n);
+    who.resize(n);
+    for (size_t i=0; i<n; ++i) {
+        where[i] = (uint32_t)i;
+        who[i] = (uint32_t)i;
+    }
+    cursor = 0;
+}
+
+bool CompactionSystem::Permutation::finished() const
+{
+    return cursor >= slots.size();
+}
+
+CompactionSystem::CompactionSystem(fug::Ecs& ecs) :
+    _ecs            (ecs),
+    _worldSize      (ConfigSingleton::defaultWorldSize),
+    _passTick       (0),
+    _passStarted    (false)
+{
+    _creaturePermutation.cursor = 0;
+    _foodPermutation.cursor = 0;
+}
+
+void CompactionSystem::update(uint64_t tick, uint64_t interval, uint64_t maxSwaps)
+{
+    _swaps.clear();
+
+    bool finished = _creaturePermutation.finished() && _foodPermutation.finished();
+    if (finished && interval > 0 && (!_passStarted || tick >= _passTick+interval)) {
+        startPass();
+        _passTick = tick;
+        _passStarted = true;
+    }
+
+    for (uint64_t i=0; i<maxSwaps; ++i) {
+        if (!_creaturePermutation.finished())
+            step<CreatureComponent>(_creaturePermutation);
+        else if (!_foodPermutation.finished())
+            step<FoodComponent>(_foodPermutation);
+        else
+            break;
+    }
+}
+
+void CompactionSystem::reset()
+{
+    _creaturePermutation.slots.clear();
+    _creaturePermutation.cursor = 0;
+    _foodPermutation.slots.clear();
+    _foodPermutation.cursor = 0;
+    _swaps.clear();
+}
+
+fug::EntityId CompactionSystem::getRelocated(fug::EntityId eId) const
+{
+    for (auto& swap : _swaps) {
+        if (eId == swap.first)
+            eId = swap.second;
+        else if (eId == swap.second)
+            eId = swap.first;
+    }
+    return eId;
+}
+
+double CompactionSystem::getProgress() const
+{
+    size_t n = _creaturePermutation.slots.size() + _foodPermutation.slots.size();
+    if (n == 0)
+        return 1.0;
+
+    return (double)(std::min(_creaturePermutation.cursor, _creaturePermutation.slots.size()) +
+        std::min(_foodPermutation.cursor, _foodPermutation.slots.size())) / (double)n;
+}
+
+void CompactionSystem::operator()(const fug::EntityId& eId, fug::Orientation2DComponent& orientationComponent)
+{
+    if (_ecs.getComponent<CreatureComponent>(eId) != nullptr)
+        _creatures.push_back(Entry{mortonCode(orientationComponent.getPosition(), _worldSize), eId});
+    else if (_ecs.getComponent<FoodComponent>(eId) != nullptr)
+        _food.push_back(Entry{mortonCode(orientationComponent.getPosition(), _worldSize), eId});
+}
+
+void CompactionSystem::startPass()
+{
+    _creatures.clear();
+    _food.clear();
+    _worldSize = _ecs.getSingleton<ConfigSingleton>()->worldSize;
+    _ecs.runSystem(*this);
+
+    _creaturePermutation.build(_creatures);
+    _foodPermutation.build(_food);
+}
+
+template <typename T_TypeComponent>
+void CompactionSystem::step(CompactionSystem::Permutation& permutation)
+{
+    uint32_t i = (uint32_t)permutation.cursor++;
+    uint32_t j = permutation.where[permutation.target[i]];
+    if (i == j)
+        return;
+
+    fug::EntityId a = permutation.slots[i];
+    fug::EntityId b = permutation.slots[j];
+    // entity removed or replaced with one of the other type since the pass started
+    if (_ecs.getComponent<T_TypeComponent>(a) == nullptr || _ecs.getComponent<T_TypeComponent>(b) == nullptr)
+        return;
+
+    swapComponents<T_TypeComponent>(_ecs, a, b);
+    swapComponents<fug::Orientation2DComponent>(_ecs, a, b);
+    swapComponents<fug::SpriteComponent>(_ecs, a, b);
+    _swaps.emplace_back(a, b);
+
+    // the ids trade places in an incrementally updated index
+    constexpr auto type = std::is_same_v<T_TypeComponent, CreatureComponent> ?
+        WorldSingleton::EntityType::CREATURE : WorldSingleton::EntityType::FOOD;
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+    world.updateEntity(a, _ecs.getComponent<fug::Orientation2DComponent>(a)->getPosition(), type);
+    world.updateEntity(b, _ecs.getComponent<fug::Orientation2DComponent>(b)->getPosition(), type);
+
+    std::swap(permutation.who[i], permutation.who[j]);
+    permutation.where[permutation.who[i]] = i;
+    permutation.where[permutation.who[j]] = j;
+}
@@ -10,6 +10,38 @@
 
 #include <ConfigSingleton.hpp>
 
+#include <cstdio>
+
+
+namespace {
+
+    template <typename T>
+    struct Parameter {
+        const char*         name;
+        T ConfigSingleton::*member;
+    };
+
+    const Parameter<double> doubleParameters[] = {
+        { "creatureEnergyUseConstant",              &ConfigSingleton::creatureEnergyUseConstant },
+        { "creatureAccelerationEnergyUseConstant",  &ConfigSingleton::creatureAccelerationEnergyUseConstant },
+        { "creatureTurnEnergyUseConstant",          &ConfigSingleton::creatureTurnEnergyUseConstant },
+        { "creatureMassIncreaseFactor",             &ConfigSingleton::creatureMassIncreaseFactor },
+        { "creatureFeedRate",                       &ConfigSingleton::creatureFeedRate },
+        { "massEnergyStorageConstant",              &ConfigSingleton::massEnergyStorageConstant },
+        { "foodPlantMassToEnergyConstant",          &ConfigSingleton::foodPlantMassToEnergyConstant },
+        { "foodMeatMassToEnergyConstant",           &ConfigSingleton::foodMeatMassToEnergyConstant },
+        { "foodPerTick",                            &ConfigSingleton::foodPerTick },
+        { "foodGrowthRate",                         &ConfigSingleton::foodGrowthRate },
+        { "foodSpoilRate",                          &ConfigSingleton::foodSpoilRate },
+    };
+
+    const Parameter<float> floatParameters[] = {
+        { "creatureDragCoefficient",                &ConfigSingleton::creatureDragCoefficient },
+        { "speciesDistanceThreshold",               &ConfigSingleton::speciesDistanceThreshold },
+    };
+
+} // namespace
+
 
 ConfigSingleton::ConfigSingleton()
 {
@@ -17,3 +49,36 @@ ConfigSingleton::ConfigSingleton()
     mutationStages.emplace_back(0.2f, 0.04f, Genome::MutationMode::MULTIPLICATIVE);
     mutationStages.emplace_back(0.01f, 0.1f, Genome::MutationMode::MULTIPLICATIVE);
 }
+
+bool ConfigSingleton::setParameter(const std::string& name, double value)
+{
+    for (auto& parameter : doubleParameters) {
+        if (name == parameter.name) {
+            this->*parameter.member = value;
+            return true;
+        }
+    }
+    for (auto& parameter : floatParameters) {
+        if (name == parameter.name) {
+            this->*parameter.member = (float)value;
+            return true;
+        }
+    }
+
+    unsigned stage = 0;
+    int length = 0;
+    if (sscanf(name.c_str(), "mutationStage%u.probability%n", &stage, &length) == 1 &&
+        length == (int)name.size() && stage < mutationStages.size()) {
+        mutationStages[stage].probability = (float)value;
+        return true;
+    }
+    length = 0;
+    if (sscanf(name.c_str(), "mutationStage%u.amplitude%n", &stage, &length) == 1 &&
+        length == (int)name.size() && stage < mutationStages.size()) {
+        mutationStages[stage].amplitude = (float)value;
+        return true;
+    }
+
+    printf("Error: Unknown parameter %s\n", name.c_str());
+    return false;
+}
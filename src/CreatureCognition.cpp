@@ -10,33 +10,63 @@
 
 #include <CreatureCognition.hpp>
 #include <Genome.hpp>
+#include <SlabPool.hpp>
 
 
 #define INIT_LAYER_FIRST(TYPE, NAME) \
     constexpr uint64_t NAME ## Begin = Genome::genomeHeaderSize; \
         for (int j=0; j<Dims<TYPE>::input; ++j) \
             for (int i=0; i<Dims<TYPE>::output; ++i) \
-                NAME(i, j) = genome[NAME ## Begin + j*Dims<TYPE>::output + i];
+                _weights->NAME(i, j) = genes[NAME ## Begin + j*Dims<TYPE>::output + i];
 
 #define INIT_LAYER(PREVTYPE, PREVNAME, TYPE, NAME) \
     constexpr uint64_t NAME ## Begin = PREVNAME ## Begin + Dims<PREVTYPE>::total; \
         for (int j=0; j<Dims<TYPE>::input; ++j) \
             for (int i=0; i<Dims<TYPE>::output; ++i) \
-                NAME(i, j) = genome[NAME ## Begin + j*Dims<TYPE>::output + i];
+                _weights->NAME(i, j) = genes[NAME ## Begin + j*Dims<TYPE>::output + i];
 
 
-CreatureCognition::CreatureCognition(const Genome& genome)
+CreatureCognition::CreatureCognition(const Genome& genome) :
+    _weights    (allocateWeights())
 {
-    INIT_LAYER_FIRST(Layer1, _layer1)
-    INIT_LAYER(Layer1, _layer1, Layer2, _layer2)
-    INIT_LAYER(Layer2, _layer2, Layer3, _layer3)
-    INIT_LAYER(Layer2, _layer2, Layer3MemoryValue, _layer3MemoryValue)
-    INIT_LAYER(Layer2, _layer2, Layer3MemoryGate, _layer3MemoryGate)
-    INIT_LAYER(Layer3, _layer3, Layer4, _layer4)
-    INIT_LAYER(Layer4, _layer4, Layer5, _layer5)
-
-    INIT_LAYER(Layer5, _layer5, AttackLayer1, _attackLayer1)
-    INIT_LAYER(AttackLayer1, _attackLayer1, AttackLayer2, _attackLayer2)
+    // materialize the genome once instead of resolving the delta for every weight
+    Genome::Genes genes;
+    genome.copyTo(genes.data());
+
+    INIT_LAYER_FIRST(Layer1, layer1)
+    INIT_LAYER(Layer1, layer1, Layer2, layer2)
+    INIT_LAYER(Layer2, layer2, Layer3, layer3)
+    INIT_LAYER(Layer2, layer2, Layer3MemoryValue, layer3MemoryValue)
+    INIT_LAYER(Layer2, layer2, Layer3MemoryGate, layer3MemoryGate)
+    INIT_LAYER(Layer3, layer3, Layer4, layer4)
+    INIT_LAYER(Layer4, layer4, Layer5, layer5)
+
+    INIT_LAYER(Layer5, layer5, AttackLayer1, attackLayer1)
+    INIT_LAYER(AttackLayer1, attackLayer1, AttackLayer2, attackLayer2)
+}
+
+CreatureCognition::CreatureCognition(const CreatureCognition& other) :
+    _weights    (allocateWeights(other._weights.get())),
+    _input      (other._input),
+    _output     (other._output),
+    _memory     (other._memory)
+{
+}
+
+CreatureCognition& CreatureCognition::operator=(const CreatureCognition& other)
+{
+    if (this == &other)
+        return *this;
+
+    if (_weights == nullptr || other._weights == nullptr)
+        _weights = allocateWeights(other._weights.get());
+    else
+        *_weights = *other._weights;
+    _input = other._input;
+    _output = other._output;
+    _memory = other._memory;
+
+    return *this;
 }
 
 const CreatureCognition::Output& CreatureCognition::forward()
@@ -44,33 +74,33 @@ const CreatureCognition::Output& CreatureCognition::forward()
     // Layer 1 + tanh
     _input(inputSize) = 1.0f; // layer 1 bias term
     Eigen::Matrix<float, Dims<Layer2>::input,1> layer2Input;
-    layer2Input.block<Dims<Layer1>::output,1>(0,0) = tanh((_layer1 * _input).array()); // layer 1 output
+    layer2Input.block<Dims<Layer1>::output,1>(0,0) = tanh((_weights->layer1 * _input).array()); // layer 1 output
 
     // Layer 2 + tanh
     layer2Input.block<memorySize,1>(Dims<Layer1>::output,0) = _memory; // last tick memory input
     layer2Input(Dims<Layer2>::input-1) = 1.0f; // layer 2 bias term
     Eigen::Matrix<float, Dims<Layer3>::input,1> layer3Input;
-    layer3Input.block<Dims<Layer2>::output,1>(0,0) = tanh((_layer2 * layer2Input).array()); // layer 2 output
+    layer3Input.block<Dims<Layer2>::output,1>(0,0) = tanh((_weights->layer2 * layer2Input).array()); // layer 2 output
 
     // Layer 3 + tanh
     layer3Input(Dims<Layer3>::input-1) = 1.0f; // layer 3 bias term
     Eigen::Matrix<float, Dims<Layer4>::input,1> layer4Input;
-    layer4Input.block<Dims<Layer3>::output,1>(0,0) = tanh((_layer3 * layer3Input).array()); // layer 3 output
+    layer4Input.block<Dims<Layer3>::output,1>(0,0) = tanh((_weights->layer3 * layer3Input).array()); // layer 3 output
 
     // Update memory
-    Memory memoryGate = 1.0 / (1.0 + exp((_layer3MemoryGate * layer3Input).array()));
-    Memory memoryValue = tanh((_layer3MemoryValue * layer3Input).array());
+    Memory memoryGate = 1.0 / (1.0 + exp((_weights->layer3MemoryGate * layer3Input).array()));
+    Memory memoryValue = tanh((_weights->layer3MemoryValue * layer3Input).array());
     _memory = memoryValue.array()*memoryGate.array() + _memory.array()*(1.0-memoryGate.array());
 
     // Layer 4 + tanh
     layer4Input.block<memorySize,1>(Dims<Layer3>::output,0) = _memory; // updated memory input
     layer4Input(Dims<Layer4>::input-1) = 1.0f; // layer 4 bias term
     Eigen::Matrix<float, Dims<Layer5>::input,1> layer5Input;
-    layer5Input.block<Dims<Layer4>::output,1>(0,0) = tanh((_layer4 * layer4Input).array()); // layer 4 output
+    layer5Input.block<Dims<Layer4>::output,1>(0,0) = tanh((_weights->layer4 * layer4Input).array()); // layer 4 output
 
     // Layer 5 + tanh
     layer5Input(Dims<Layer5>::input-1) = 1.0f; // layer 5 bias term
-    _output = tanh((_layer5 * layer5Input).array());
+    _output = tanh((_weights->layer5 * layer5Input).array());
 
     return _output;
 }
@@ -81,15 +111,38 @@ CreatureCognition::AttackOutput CreatureCognition::attack(
     // Attack Layer 1 + tanh
     input(attackInputSize) = 1.0f; // attack layer 1 bias term
     Eigen::Matrix<float, Dims<AttackLayer2>::input,1> layer2Input;
-    layer2Input.block<Dims<AttackLayer1>::output,1>(0,0) = tanh((_attackLayer1 * input).array());
+    layer2Input.block<Dims<AttackLayer1>::output,1>(0,0) = tanh((_weights->attackLayer1 * input).array());
 
     // Attack Layer 2 + tanh
     layer2Input.block<memorySize,1>(Dims<AttackLayer1>::output,0) = _memory; // updated memory input
     layer2Input(Dims<AttackLayer2>::input-1) = 1.0f; // attack layer 2 bias term
-    return tanh((_attackLayer2 * layer2Input).array());
+    return tanh((_weights->attackLayer2 * layer2Input).array());
 }
 
 const CreatureCognition::Memory& CreatureCognition::getMemory() const
 {
     return _memory;
 }
+
+void CreatureCognition::setMemory(const CreatureCognition::Memory& memory)
+{
+    _memory = memory;
+}
+
+void CreatureCognition::WeightsDeleter::operator()(CreatureCognition::Weights* weights) const
+{
+    weights->~Weights();
+    PoolAllocator<Weights>().deallocate(weights, 1);
+}
+
+CreatureCognition::WeightsPointer CreatureCognition::allocateWeights(const Weights* source)
+{
+    // weights are fully initialized from the genome in case there's no source
+    Weights* weights = PoolAllocator<Weights>().allocate(1);
+    if (source != nullptr)
+        new (weights) Weights(*source);
+    else
+        new (weights) Weights;
+
+    return WeightsPointer(weights);
+}
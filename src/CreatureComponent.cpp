@@ -9,6 +9,7 @@
 //
 
 #include <CreatureComponent.hpp>
+#include <PhylogenySingleton.hpp>
 
 
 CreatureComponent::CreatureComponent(
@@ -24,6 +25,8 @@ CreatureComponent::CreatureComponent(
     direction  (direction),
     speed      (speed),
     age        (0.0),
+    lineageSlot(PhylogenySingleton::invalidSlot),
+    ghost      (false),
     cognition  (this->genome)
 {
 }
@@ -12,8 +12,12 @@
 #include <WorldSingleton.hpp>
 #include <ConfigSingleton.hpp>
 #include <LineSingleton.hpp>
+#include <TelemetrySingleton.hpp>
+#include <PhylogenySingleton.hpp>
+#include <SpeciesSingleton.hpp>
 #include <EventHandlers.hpp>
 #include <Utils.hpp>
+#include <HotPathCounters.hpp>
 #include <FoodComponent.hpp>
 
 #include <engine/EventComponent.hpp>
@@ -21,8 +25,8 @@
 
 
 CreatureSystem::CreatureSystem(fug::Ecs& ecs) :
-    _ecs    (ecs),
-    _stage  (Stage::DYNAMICS)
+    _ecs        (ecs),
+    _stage      (Stage::DYNAMICS)
 {
 }
 
@@ -36,6 +40,10 @@ void CreatureSystem::operator()(
     CreatureComponent& creatureComponent,
     fug::Orientation2DComponent& orientationComponent)
 {
+    // ghosts are simulated by their owner, they're only added to the spatial index
+    if (creatureComponent.ghost && _stage != Stage::ADD_TO_WORLD)
+        return;
+
     switch (_stage) {
         case Stage::COGNITION:
             cognition(eId, creatureComponent, orientationComponent);
@@ -52,6 +60,15 @@ void CreatureSystem::operator()(
         case Stage::PROCESS_INPUTS:
             processInputs(eId, creatureComponent, orientationComponent);
             break;
+        case Stage::DRAW_LINES:
+            drawLines(eId, creatureComponent, orientationComponent);
+            break;
+        case Stage::TELEMETRY:
+            telemetry(eId, creatureComponent, orientationComponent);
+            break;
+        case Stage::SPECIES:
+            species(eId, creatureComponent, orientationComponent);
+            break;
     }
 }
 
@@ -103,19 +120,26 @@ void CreatureSystem::dynamics(
     // if energy reaches 0, the creature dies
     if (e <= 0.0) {
         createFood(_ecs, FoodComponent::Type::MEAT, m, orientationComponent.getPosition());
+        _ecs.getSingleton<PhylogenySingleton>()->addDeath(creatureComponent.lineageSlot,
+            _ecs.getSingleton<WorldSingleton>()->getTick());
+        _ecs.getSingleton<SpeciesSingleton>()->remove(creatureComponent.species);
+        _ecs.getSingleton<WorldSingleton>()->removeEntity(eId);
         _ecs.removeEntity(eId);
+        HotPathCounters::add(HotPathCounters::ENTITIES_REMOVED);
+        _ecs.getSingleton<TelemetrySingleton>()->countDeath();
         return;
     }
 
     // update orientation component
     Vec2f dVec = Vec2f(cosf(d), sinf(d));
     Vec2f p = orientationComponent.getPosition() + s*dVec;
-    if (p(0) < -ConfigSingleton::worldSize) p(0) = -ConfigSingleton::worldSize;
-    if (p(0) >= ConfigSingleton::worldSize) p(0) = ConfigSingleton::worldSize;
-    if (p(1) < -ConfigSingleton::worldSize) p(1) = -ConfigSingleton::worldSize;
-    if (p(1) >= ConfigSingleton::worldSize) p(1) = ConfigSingleton::worldSize;
+    if (p(0) < -config.worldSize) p(0) = -config.worldSize;
+    if (p(0) >= config.worldSize) p(0) = config.worldSize;
+    if (p(1) < -config.worldSize) p(1) = -config.worldSize;
+    if (p(1) >= config.worldSize) p(1) = config.worldSize;
     orientationComponent.setPosition(p);
     orientationComponent.setRotation(d);
+    _ecs.getSingleton<WorldSingleton>()->updateEntity(eId, p, WorldSingleton::EntityType::CREATURE);
 }
 
 void CreatureSystem::reproduction(
@@ -145,16 +169,21 @@ void CreatureSystem::reproduction(
         double childEnergy = minChildEnergy + childSize*(e-minChildEnergy);
         double childMass = childEnergy/reproductionEnergyConstant;
 
-        Genome childGenome = g;
+        Genome childGenome = g; // shares the parent's gene array
         for (auto& stage : config.mutationStages)
             childGenome.mutate(stage.probability, stage.amplitude, stage.mode);
+        if (!config.genomeDeltaStorage || childGenome.deltaSize() > config.genomeDeltaCompactionThreshold)
+            childGenome.compact();
 
         fug::EntityId childId = _ecs.getEmptyEntityId();
+        HotPathCounters::add(HotPathCounters::ENTITIES_CREATED);
 
         // Child components
         CreatureComponent childCreatureComponent = CreatureComponent(
             childGenome, childMass*config.massEnergyStorageConstant*g[Genome::CHILD_ENERGY], childMass,
             creatureComponent.direction, creatureComponent.speed);
+        childCreatureComponent.lineageSlot = _ecs.getSingleton<PhylogenySingleton>()->addBirth(
+            creatureComponent.lineageSlot, _ecs.getSingleton<WorldSingleton>()->getTick());
 
         fug::Orientation2DComponent childOrientationComponent = orientationComponent;
         childOrientationComponent.setScale(sqrtf(childMass) / ConfigSingleton::spriteRadius);
@@ -175,9 +204,14 @@ void CreatureSystem::reproduction(
         _ecs.setComponent(childId, std::move(childOrientationComponent));
         _ecs.setComponent(childId, std::move(childSpriteComponent));
         _ecs.setComponent(childId, std::move(childEventComponent));
+        _ecs.getSingleton<WorldSingleton>()->updateEntity(childId,
+            _ecs.getComponent<fug::Orientation2DComponent>(childId)->getPosition(),
+            WorldSingleton::EntityType::CREATURE);
 
         // reduce parent's energy by the amount given to child
         e -= childEnergy;
+
+        _ecs.getSingleton<TelemetrySingleton>()->countBirth();
     }
 }
 
@@ -200,7 +234,6 @@ void CreatureSystem::processInputs(
 {
     static auto& config = *_ecs.getSingleton<ConfigSingleton>();
     static auto& world = *_ecs.getSingleton<WorldSingleton>();
-    static auto& lineSingleton = *_ecs.getSingleton<LineSingleton>();
 
     // some shorthands for the creature variables
     auto& g = creatureComponent.genome;
@@ -218,44 +251,26 @@ void CreatureSystem::processInputs(
     Vec2f wBegin = p+r*wv;
     Vec2f wEnd = p+(r+t)*wv; // TODO variable whisker length
 
-    // fetch potential contacts
+    // fetch potential contacts, contacts up to r behind the whisker begin are accepted
     static Vector<fug::EntityId> wEntities;
     wEntities.clear();
-    world.getEntities(wEntities,
-        Vec2f(std::min(wBegin(0), wEnd(0))-ConfigSingleton::maxObjectRadius,
-        std::min(wBegin(1), wEnd(1))-ConfigSingleton::maxObjectRadius),
-        Vec2f(std::max(wBegin(0), wEnd(0))+ConfigSingleton::maxObjectRadius,
-        std::max(wBegin(1), wEnd(1))+ConfigSingleton::maxObjectRadius));
+    world.getEntitiesAlongRay(wEntities, p, wEnd, ConfigSingleton::maxObjectRadius);
 
     auto& color = _ecs.getComponent<fug::SpriteComponent>(eId)->getColor();
     auto cColor = color; // in case of contact, color end of whisker with the contact entity color
 
     // search for (closest) contact, t stores ray length to the nearest contact (so far)
     fug::EntityId cEId = -1; // contact entity ID
+    uint64_t nTests = 0;
     for (auto& wEId : wEntities) {
         if (eId == wEId) // do not self-collide
             continue;
 
+        ++nTests;
         // position and radius of potential contact
         auto* woc = _ecs.getComponent<fug::Orientation2DComponent>(wEId);
-        Vec2f wp = woc->getPosition();
-        float wr = woc->getScale()*ConfigSingleton::spriteRadius;
-
-        // helper vector required in lot of subsequent quadratic term calculations
-        Vec2f wbp = wBegin-wp;
-
-        // quadratic terms of 2D ray-circle intersection
-        float wa = wv(0)*wv(0) + wv(1)*wv(1);
-        float wb = 2.0f*(wv(0)*wbp(0) + wv(1)*wbp(1));
-        float wc = wbp(0)*wbp(0) + wbp(1)*wbp(1) - wr*wr;
-
-        // no intersection when determinant is < 0
-        float wDet = wb*wb - 4.0f*wa*wc;
-        if (wDet < 0.0f)
-            continue;
-
-        // solve quadratic (only negative used since it's always the closer one)
-        float tCand = (-wb-sqrtf(wDet))/(2.0f*wa);
+        float tCand = rayCircleIntersection(wBegin, wv, woc->getPosition(),
+            woc->getScale()*ConfigSingleton::spriteRadius);
         if (tCand < -r || tCand >= t) // skip if contact is behind or further away than the current closest
             continue;
 
@@ -268,6 +283,10 @@ void CreatureSystem::processInputs(
     if (t < 0.0f)
         t = 0.0f;
 
+    HotPathCounters::add(HotPathCounters::WHISKER_TESTS, nTests);
+    if (cEId >= 0)
+        HotPathCounters::add(HotPathCounters::WHISKER_HITS);
+
     auto& cognitionInput = creatureComponent.cognition._input;
     cognitionInput = CreatureCognition::Input::Zero();
     cognitionInput(0) = (float)m;
@@ -292,6 +311,50 @@ void CreatureSystem::processInputs(
 
         cognitionInput.block<3,1>(8,0) = cColor;
     }
+}
+
+void CreatureSystem::drawLines(
+    const fug::EntityId& eId,
+    CreatureComponent& creatureComponent,
+    fug::Orientation2DComponent& orientationComponent)
+{
+    static auto& lineSingleton = *_ecs.getSingleton<LineSingleton>();
+
+    // the whisker as sensed on the last PROCESS_INPUTS, the creature hasn't moved since
+    auto& cognitionInput = creatureComponent.cognition._input;
+    float r = orientationComponent.getScale()*ConfigSingleton::spriteRadius;
+    Vec2f wv = Vec2f(cosf(creatureComponent.direction), sinf(creatureComponent.direction));
+    Vec2f wBegin = orientationComponent.getPosition()+r*wv;
+
+    auto& color = _ecs.getComponent<fug::SpriteComponent>(eId)->getColor();
+    bool contact = cognitionInput(5) > 0.0f || cognitionInput(6) > 0.0f;
+    Vec3f cColor = contact ? Vec3f(cognitionInput.block<3,1>(8,0)) : color;
+
+    lineSingleton.drawLine(wBegin, wBegin + wv*cognitionInput(4), color, cColor);
+}
+
+void CreatureSystem::telemetry(
+    const fug::EntityId& eId,
+    CreatureComponent& creatureComponent,
+    fug::Orientation2DComponent& orientationComponent)
+{
+    static auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    static auto& telemetry = *_ecs.getSingleton<TelemetrySingleton>();
+
+    telemetry.addCreature(creatureComponent.mass,
+        creatureComponent.energy / (creatureComponent.mass*config.massEnergyStorageConstant),
+        creatureComponent.age, creatureComponent.speed,
+        creatureComponent.genome[Genome::METABOLIC_CONSTANT]);
+}
+
+void CreatureSystem::species(
+    const fug::EntityId& eId,
+    CreatureComponent& creatureComponent,
+    fug::Orientation2DComponent& orientationComponent)
+{
+    static auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    static auto& species = *_ecs.getSingleton<SpeciesSingleton>();
 
-    lineSingleton.drawLine(wBegin, wBegin + wv*t, color, cColor);
+    if (species.isSampled())
+        species.sample(creatureComponent.genome, creatureComponent.species, config.speciesDistanceThreshold);
 }
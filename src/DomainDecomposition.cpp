@@ -0,0 +1,506 @@
+//
+// Project: evolution_simulator_2
+// File: DomainDecomposition.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <DomainDecomposition.hpp>
+#include <CreatureComponent.hpp>
+#include <FoodComponent.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <ResourceSingleton.hpp>
+#include <PhylogenySingleton.hpp>
+#include <SpeciesSingleton.hpp>
+#include <EventHandlers.hpp>
+#include <HotPathCounters.hpp>
+#include <Utils.hpp>
+
+#include <engine/EventComponent.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+
+namespace {
+
+    template <typename T>
+    void append(Vector<char>& message, const T& value)
+    {
+        auto* bytes = reinterpret_cast<const char*>(&value);
+        message.insert(message.end(), bytes, bytes+sizeof(T));
+    }
+
+    // sequential reads from a received message
+    class MessageReader {
+    public:
+        explicit MessageReader(const Vector<char>& message) :
+            _message    (message),
+            _position   (0)
+        {
+        }
+
+        bool atEnd() const
+        {
+            return _position >= _message.size();
+        }
+
+        bool read(void* data, size_t size)
+        {
+            if (_position+size > _message.size())
+                return false;
+            memcpy(data, _message.data()+_position, size);
+            _position += size;
+            return true;
+        }
+
+        template <typename T>
+        bool read(T& value)
+        {
+            return read(&value, sizeof(T));
+        }
+
+    private:
+        const Vector<char>& _message;
+        size_t              _position;
+    };
+
+} // namespace
+
+
+DomainDecomposition::DomainDecomposition(Simulation& simulation, Transport& transport,
+    uint32_t nRegionsX, uint32_t nRegionsY) :
+    _simulation     (simulation),
+    _ecs            (simulation.getEcs()),
+    _transport      (transport),
+    _nRegionsX      (nRegionsX),
+    _nRegionsY      (nRegionsY),
+    // reach of the longest whisker (5+6r) plus the radius of the contact, r <= maxObjectRadius
+    _haloWidth      (5.0f + 7.0f*ConfigSingleton::maxObjectRadius),
+    _boundarySystem (_ecs),
+    _ghostGenome    (0.0f, 0.0f),
+    _nGhostCreatures(0),
+    _nGhostFood     (0),
+    _outgoing       (transport.getNumberOfRanks()),
+    _incoming       (transport.getNumberOfRanks()),
+    _genes          (Genome::genomeSize),
+    _nEmigrants     (0),
+    _nImmigrants    (0),
+    _failed         (false)
+{
+}
+
+DomainDecomposition::~DomainDecomposition()
+{
+    _simulation.setBoundaryCallbacks(nullptr, nullptr);
+}
+
+bool DomainDecomposition::init()
+{
+    if (_nRegionsX*_nRegionsY != _transport.getNumberOfRanks()) {
+        printf("Error: %ux%u regions require %u ranks, the transport has %u\n", _nRegionsX, _nRegionsY,
+            _nRegionsX*_nRegionsY, _transport.getNumberOfRanks());
+        return false;
+    }
+
+    _boundarySystem.setRegions(_nRegionsX, _nRegionsY, _transport.getRank(),
+        _ecs.getSingleton<ConfigSingleton>()->worldSize, _haloWidth);
+    _simulation.setBoundaryCallbacks([this]() { beforeCollisions(); }, [this]() { afterCollisions(); });
+    return true;
+}
+
+void DomainDecomposition::claimRegion()
+{
+    _boundarySystem.clear();
+    _boundarySystem.setStage(BoundarySystem::Stage::EMIGRANTS);
+    _ecs.runSystem(_boundarySystem);
+
+    for (uint32_t r=0; r<_transport.getNumberOfRanks(); ++r) {
+        for (auto eId : _boundarySystem.getEntities(r))
+            removeEntity(eId);
+    }
+}
+
+uint32_t DomainDecomposition::getRegion() const
+{
+    return _transport.getRank();
+}
+
+uint64_t DomainDecomposition::getNumberOfCreatures()
+{
+    return _ecs.getSingleton<WorldSingleton>()->getNumberOfOwned(WorldSingleton::EntityType::CREATURE);
+}
+
+uint64_t DomainDecomposition::getNumberOfFood()
+{
+    return _ecs.getSingleton<WorldSingleton>()->getNumberOfOwned(WorldSingleton::EntityType::FOOD);
+}
+
+uint64_t DomainDecomposition::getNumberOfGhosts() const
+{
+    return _ghosts.size();
+}
+
+uint64_t DomainDecomposition::getNumberOfEmigrants() const
+{
+    return _nEmigrants;
+}
+
+uint64_t DomainDecomposition::getNumberOfImmigrants() const
+{
+    return _nImmigrants;
+}
+
+bool DomainDecomposition::hasFailed() const
+{
+    return _failed;
+}
+
+void DomainDecomposition::beforeCollisions()
+{
+    if (_failed)
+        return;
+
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+
+    // ghosts of the last update, compaction may have moved them since
+    for (auto& ghost : _ghosts) {
+        auto eId = _simulation.getRelocatedEntity(ghost.eId);
+        world.removeEntity(eId);
+        _ecs.removeEntity(eId);
+        HotPathCounters::add(HotPathCounters::ENTITIES_REMOVED);
+    }
+    _ghosts.clear();
+    _nGhostCreatures = 0;
+    _nGhostFood = 0;
+
+    migrate();
+    sendGhosts();
+    updateGhostCounts();
+}
+
+void DomainDecomposition::afterCollisions()
+{
+    if (_failed)
+        return;
+
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+
+    // report what the collisions did to the ghosts
+    for (auto& message : _outgoing)
+        message.clear();
+
+    size_t nGhosts = 0;
+    for (auto& ghost : _ghosts) {
+        EffectRecord record {ghost.owner, (uint32_t)ghost.kind, 0.0};
+        bool removed = false;
+        switch (ghost.kind) {
+            case Kind::CREATURE:
+                record.delta = _ecs.getComponent<CreatureComponent>(ghost.eId)->energy - ghost.value;
+                break;
+            case Kind::FOOD: {
+                auto* fc = _ecs.getComponent<FoodComponent>(ghost.eId);
+                removed = fc == nullptr || !fc->ghost; // completely eaten, the id may have been reused
+                record.delta = (removed ? 0.0 : fc->mass) - ghost.value;
+            }   break;
+        }
+
+        if (record.delta != 0.0)
+            append(_outgoing[ghost.region], record);
+        if (removed)
+            --_nGhostFood;
+        else
+            _ghosts[nGhosts++] = ghost;
+    }
+    _ghosts.resize(nGhosts);
+    updateGhostCounts();
+
+    if (!exchange())
+        return;
+
+    for (uint32_t r=0; r<_incoming.size(); ++r) {
+        MessageReader reader(_incoming[r]);
+        EffectRecord record;
+        bool malformed = false;
+        while (reader.read(record)) {
+            if (record.kind != (uint32_t)Kind::CREATURE && record.kind != (uint32_t)Kind::FOOD) {
+                malformed = true;
+                break;
+            }
+
+            // the entity may have been removed by the local collisions
+            if (record.kind == (uint32_t)Kind::CREATURE) {
+                auto* cc = _ecs.getComponent<CreatureComponent>(record.owner);
+                if (cc != nullptr && !cc->ghost)
+                    cc->energy += record.delta; // dies on its next dynamics step
+                continue;
+            }
+
+            auto* fc = _ecs.getComponent<FoodComponent>(record.owner);
+            if (fc == nullptr || fc->ghost)
+                continue;
+            fc->mass += record.delta;
+            if (fc->mass <= 0.0) {
+                world.removeEntity(record.owner);
+                _ecs.removeEntity(record.owner);
+                HotPathCounters::add(HotPathCounters::ENTITIES_REMOVED);
+            }
+            else {
+                _ecs.getComponent<fug::Orientation2DComponent>(record.owner)->setScale(
+                    sqrtf((float)fc->mass) / ConfigSingleton::spriteRadius);
+            }
+        }
+
+        if (malformed || !reader.atEnd()) {
+            printf("Error: Malformed effect message from rank %u\n", r);
+            _failed = true;
+            return;
+        }
+    }
+}
+
+void DomainDecomposition::migrate()
+{
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+    auto& resources = *_ecs.getSingleton<ResourceSingleton>();
+    auto& phylogeny = *_ecs.getSingleton<PhylogenySingleton>();
+
+    _boundarySystem.clear();
+    _boundarySystem.setStage(BoundarySystem::Stage::EMIGRANTS);
+    _ecs.runSystem(_boundarySystem);
+
+    // messages are sequences of kind tags, each followed by a creature (with genome) or food record
+    for (uint32_t r=0; r<_outgoing.size(); ++r) {
+        auto& message = _outgoing[r];
+        message.clear();
+        for (auto eId : _boundarySystem.getEntities(r)) {
+            auto& oc = *_ecs.getComponent<fug::Orientation2DComponent>(eId);
+            auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+            if (cc != nullptr) {
+                WorldSnapshot::CreatureRecord record {};
+                record.energy = cc->energy;
+                record.mass = cc->mass;
+                record.age = cc->age;
+                record.agingFactor = cc->agingFactor;
+                record.position[0] = oc.getPosition()(0);
+                record.position[1] = oc.getPosition()(1);
+                record.scale = oc.getScale();
+                record.direction = cc->direction;
+                record.speed = cc->speed;
+                auto& color = _ecs.getComponent<fug::SpriteComponent>(eId)->getColor();
+                record.color[0] = color(0);
+                record.color[1] = color(1);
+                record.color[2] = color(2);
+                Eigen::Map<CreatureCognition::Memory>(record.memory) = cc->cognition.getMemory();
+                cc->genome.copyTo(_genes.data());
+
+                append(message, Kind::CREATURE);
+                append(message, record);
+                message.insert(message.end(), reinterpret_cast<const char*>(_genes.data()),
+                    reinterpret_cast<const char*>(_genes.data()+Genome::genomeSize));
+            }
+            else {
+                auto& fc = *_ecs.getComponent<FoodComponent>(eId);
+                WorldSnapshot::FoodRecord record {};
+                record.mass = fc.mass;
+                record.position[0] = oc.getPosition()(0);
+                record.position[1] = oc.getPosition()(1);
+                record.scale = oc.getScale();
+                record.type = (uint32_t)fc.type;
+
+                append(message, Kind::FOOD);
+                append(message, record);
+            }
+
+            removeEntity(eId);
+            ++_nEmigrants;
+        }
+    }
+
+    if (!exchange())
+        return;
+
+    for (uint32_t r=0; r<_incoming.size(); ++r) {
+        MessageReader reader(_incoming[r]);
+        Kind kind;
+        bool malformed = false;
+        while (reader.read(kind)) {
+            if (kind != Kind::CREATURE && kind != Kind::FOOD) {
+                malformed = true;
+                break;
+            }
+
+            if (kind == Kind::FOOD) {
+                WorldSnapshot::FoodRecord record;
+                if (!reader.read(record))
+                    break;
+                if (record.type > (uint32_t)FoodComponent::Type::MEAT) {
+                    malformed = true;
+                    break;
+                }
+                createFood(_ecs, static_cast<FoodComponent::Type>(record.type), record.mass,
+                    Vec2f(record.position[0], record.position[1]));
+                ++_nImmigrants;
+                continue;
+            }
+
+            WorldSnapshot::CreatureRecord record;
+            if (!reader.read(record) || !reader.read(_genes.data(), Genome::genomeSize*sizeof(float)))
+                break;
+
+            // lineages don't cross process boundaries, the creature starts a new one
+            CreatureComponent creatureComponent(Genome(_genes.data()),
+                record.energy, record.mass, record.direction, record.speed);
+            creatureComponent.age = record.age;
+            creatureComponent.agingFactor = record.agingFactor;
+            creatureComponent.cognition.setMemory(Eigen::Map<const CreatureCognition::Memory>(record.memory));
+            creatureComponent.lineageSlot = phylogeny.addBirth(PhylogenySingleton::invalidSlot, world.getTick());
+
+            fug::SpriteComponent spriteComponent = resources.creatureSpriteComponent;
+            spriteComponent.setColor(Vec3f(record.color[0], record.color[1], record.color[2]));
+
+            Vec2f position(record.position[0], record.position[1]);
+            fug::EntityId id = _ecs.getEmptyEntityId();
+            _ecs.setComponent(id, fug::Orientation2DComponent(position, record.direction, record.scale));
+            _ecs.setComponent(id, std::move(spriteComponent));
+            _ecs.addComponent<fug::EventComponent>(id)->addHandler<EventHandler_Creature_CollisionEvent>();
+            _ecs.setComponent(id, std::move(creatureComponent));
+            world.updateEntity(id, position, WorldSingleton::EntityType::CREATURE);
+            HotPathCounters::add(HotPathCounters::ENTITIES_CREATED);
+            ++_nImmigrants;
+        }
+
+        if (malformed || !reader.atEnd()) {
+            printf("Error: Malformed migration message from rank %u\n", r);
+            _failed = true;
+            return;
+        }
+    }
+}
+
+void DomainDecomposition::sendGhosts()
+{
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+    auto& resources = *_ecs.getSingleton<ResourceSingleton>();
+
+    _boundarySystem.clear();
+    _boundarySystem.setStage(BoundarySystem::Stage::HALO);
+    _ecs.runSystem(_boundarySystem);
+
+    for (uint32_t r=0; r<_outgoing.size(); ++r) {
+        auto& message = _outgoing[r];
+        message.clear();
+        for (auto eId : _boundarySystem.getEntities(r)) {
+            auto& oc = *_ecs.getComponent<fug::Orientation2DComponent>(eId);
+            auto& color = _ecs.getComponent<fug::SpriteComponent>(eId)->getColor();
+            GhostRecord record {};
+            record.owner = eId;
+            record.position[0] = oc.getPosition()(0);
+            record.position[1] = oc.getPosition()(1);
+            record.scale = oc.getScale();
+            record.color[0] = color(0);
+            record.color[1] = color(1);
+            record.color[2] = color(2);
+
+            auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+            if (cc != nullptr) {
+                record.kind = (uint32_t)Kind::CREATURE;
+                record.direction = cc->direction;
+                record.mass = cc->mass;
+                record.energy = cc->energy;
+            }
+            else {
+                auto& fc = *_ecs.getComponent<FoodComponent>(eId);
+                record.kind = (uint32_t)Kind::FOOD;
+                record.foodType = (uint32_t)fc.type;
+                record.mass = fc.mass;
+            }
+            append(message, record);
+        }
+    }
+
+    if (!exchange())
+        return;
+
+    for (uint32_t r=0; r<_incoming.size(); ++r) {
+        MessageReader reader(_incoming[r]);
+        GhostRecord record;
+        bool malformed = false;
+        while (reader.read(record)) {
+            if (record.kind != (uint32_t)Kind::CREATURE && (record.kind != (uint32_t)Kind::FOOD ||
+                record.foodType > (uint32_t)FoodComponent::Type::MEAT)) {
+                malformed = true;
+                break;
+            }
+
+            Vec2f position(record.position[0], record.position[1]);
+            if (record.kind == (uint32_t)Kind::FOOD) {
+                auto id = createFood(_ecs, static_cast<FoodComponent::Type>(record.foodType), record.mass,
+                    position);
+                _ecs.getComponent<FoodComponent>(id)->ghost = true;
+                _ghosts.push_back(Ghost{id, record.owner, r, Kind::FOOD, record.mass});
+                ++_nGhostFood;
+                continue;
+            }
+
+            CreatureComponent creatureComponent(_ghostGenome, record.energy, record.mass, record.direction);
+            creatureComponent.ghost = true;
+
+            fug::SpriteComponent spriteComponent = resources.creatureSpriteComponent;
+            spriteComponent.setColor(Vec3f(record.color[0], record.color[1], record.color[2]));
+
+            fug::EntityId id = _ecs.getEmptyEntityId();
+            _ecs.setComponent(id, fug::Orientation2DComponent(position, record.direction, record.scale));
+            _ecs.setComponent(id, std::move(spriteComponent));
+            // never receives events, but compaction may swap it with a creature that does
+            _ecs.addComponent<fug::EventComponent>(id)->addHandler<EventHandler_Creature_CollisionEvent>();
+            _ecs.setComponent(id, std::move(creatureComponent));
+            world.updateEntity(id, position, WorldSingleton::EntityType::CREATURE);
+            HotPathCounters::add(HotPathCounters::ENTITIES_CREATED);
+            _ghosts.push_back(Ghost{id, record.owner, r, Kind::CREATURE, record.energy});
+            ++_nGhostCreatures;
+        }
+
+        if (malformed || !reader.atEnd()) {
+            printf("Error: Malformed ghost message from rank %u\n", r);
+            _failed = true;
+            return;
+        }
+    }
+}
+
+void DomainDecomposition::removeEntity(fug::EntityId eId)
+{
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+
+    auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+    if (cc != nullptr) {
+        // the lineage ends in this region
+        _ecs.getSingleton<PhylogenySingleton>()->addDeath(cc->lineageSlot, world.getTick());
+        _ecs.getSingleton<SpeciesSingleton>()->remove(cc->species);
+    }
+    world.removeEntity(eId);
+    _ecs.removeEntity(eId);
+    HotPathCounters::add(HotPathCounters::ENTITIES_REMOVED);
+}
+
+void DomainDecomposition::updateGhostCounts()
+{
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+    world.setNumberOfGhosts(WorldSingleton::EntityType::CREATURE, _nGhostCreatures);
+    world.setNumberOfGhosts(WorldSingleton::EntityType::FOOD, _nGhostFood);
+}
+
+bool DomainDecomposition::exchange()
+{
+    if (!_transport.exchange(_outgoing, _incoming)) {
+        printf("Error: Boundary exchange of region %u failed\n", _transport.getRank());
+        _failed = true;
+        return false;
+    }
+    return true;
+}
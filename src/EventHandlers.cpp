@@ -12,6 +12,9 @@
 #include <CreatureComponent.hpp>
 #include <FoodComponent.hpp>
 #include <ConfigSingleton.hpp>
+#include <TelemetrySingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <HotPathCounters.hpp>
 #include <ecs/Ecs.hpp>
 #include <graphics/Orientation2DComponent.hpp>
 #include <graphics/SpriteComponent.hpp>
@@ -22,6 +25,8 @@ void EventHandler_Creature_CollisionEvent::handleEvent(
 {
     static auto& config = *ecs.getSingleton<ConfigSingleton>();
 
+    HotPathCounters::add(HotPathCounters::EVENTS_DISPATCHED);
+
     auto& cc1 = *ecs.getComponent<CreatureComponent>(eId);
     auto& oc1 = *ecs.getComponent<fug::Orientation2DComponent>(eId);
     auto& oc2 = *ecs.getComponent<fug::Orientation2DComponent>(event.entityId);
@@ -41,6 +46,8 @@ void EventHandler_Creature_CollisionEvent::handleEvent(
 
         // direction reflection
         oc1.translate(pv*(m2/massSum));
+        ecs.getSingleton<WorldSingleton>()->updateEntity(eId, oc1.getPosition(),
+            WorldSingleton::EntityType::CREATURE);
 
         if (cc1.energy < 0.0)
             return;
@@ -56,19 +63,28 @@ void EventHandler_Creature_CollisionEvent::handleEvent(
         auto attackOutput = cc1.cognition.attack(attackInput);
         double damage = (attackOutput(0)+1.0f)*0.5*cc1.energy;
         double damageMassFactor = std::max(cc1.mass / cc2->mass, 1.0);
+        bool wasAlive = cc2->energy > 0.0;
         cc2->energy -= damage*damageMassFactor;
         cc1.energy -= damage;
+
+        // the victim is removed on its next dynamics step
+        if (wasAlive && cc2->energy <= 0.0)
+            ecs.getSingleton<TelemetrySingleton>()->countKill();
     }
     else if (fc2 != nullptr) {// collision object is food
         double feedMass = sqrtf(cc1.mass)*config.creatureFeedRate;
         if (feedMass >= fc2->mass) { // food gets completely eaten
             feedMass = fc2->mass;
+            ecs.getSingleton<WorldSingleton>()->removeEntity(event.entityId);
             ecs.removeEntity(event.entityId);
+            HotPathCounters::add(HotPathCounters::ENTITIES_REMOVED);
         }
         else { // food gets partially eaten
             fc2->mass -= feedMass;
             oc2.setScale(sqrtf((float)fc2->mass) / ConfigSingleton::spriteRadius);
             oc1.translate(pv);
+            ecs.getSingleton<WorldSingleton>()->updateEntity(eId, oc1.getPosition(),
+                WorldSingleton::EntityType::CREATURE);
         }
 
         // dMass is the amount of food mass that is to be converted to creature mass, rest becomes energy
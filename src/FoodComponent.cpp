@@ -13,6 +13,7 @@
 
 FoodComponent::FoodComponent(Type type, double mass) :
     type    (type),
-    mass    (mass)
+    mass    (mass),
+    ghost   (false)
 {
 }
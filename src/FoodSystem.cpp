@@ -12,6 +12,8 @@
 #include <WorldSingleton.hpp>
 #include <ConfigSingleton.hpp>
 #include <MapSingleton.hpp>
+#include <TelemetrySingleton.hpp>
+#include <HotPathCounters.hpp>
 
 
 FoodSystem::FoodSystem(fug::Ecs& ecs) :
@@ -28,6 +30,9 @@ void FoodSystem::operator()(const fug::EntityId& eId,
     FoodComponent& foodComponent,
     fug::Orientation2DComponent& orientationComponent)
 {
+    if (foodComponent.ghost && _stage != Stage::ADD_TO_WORLD)
+        return;
+
     switch (_stage) {
         case Stage::GROW:
             grow(eId, foodComponent, orientationComponent);
@@ -49,7 +54,7 @@ void FoodSystem::grow(
     auto& p = orientationComponent.getPosition();
 
     // map pixel position
-    Vec2f pn = ((p / ConfigSingleton::worldSize) + Vec2f(1.0f, 1.0f))*0.5f;
+    Vec2f pn = ((p / config.worldSize) + Vec2f(1.0f, 1.0f))*0.5f;
     int pfx = std::clamp<int>(pn(0) * fertilityMap.width(), 0, fertilityMap.width()-1);
     int pfy = std::clamp<int>(pn(1) * fertilityMap.height(), 0, fertilityMap.height()-1);
 
@@ -68,12 +73,18 @@ void FoodSystem::grow(
             foodComponent.mass -= config.foodSpoilRate;
             fMapPixel.r += (float)(config.foodSpoilRate*100.0f);
             fertilityMap.setPixel(pfx, pfy, fMapPixel);
-            if (foodComponent.mass <= 0.0)
+            if (foodComponent.mass <= 0.0) {
+                _ecs.getSingleton<WorldSingleton>()->removeEntity(eId);
                 _ecs.removeEntity(eId);
+                HotPathCounters::add(HotPathCounters::ENTITIES_REMOVED);
+            }
             break;
     }
 
     orientationComponent.setScale(sqrt(foodComponent.mass) / ConfigSingleton::spriteRadius);
+
+    if (foodComponent.mass > 0.0)
+        _ecs.getSingleton<TelemetrySingleton>()->addFood(foodComponent.mass);
 }
 
 void FoodSystem::addToWorld(
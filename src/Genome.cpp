@@ -13,66 +13,150 @@
 #include <ConfigSingleton.hpp>
 
 
+namespace {
+
+    // the bounds of the first legacyBoundsSize cognition genes predate the current header size,
+    // they're kept to preserve the evolution dynamics
+    constexpr size_t legacyBoundsSize = 4;
+
+} // namespace
+
+
 const Genome Genome::minGenome = [](){
-    Vector<float> g({
+    // a header with too many values doesn't compile
+    const float header[genomeHeaderSize+legacyBoundsSize] = {
         ConfigSingleton::minCreatureMass, 0.0f,
         0.0f, 0.0f, 0.1f,
         0.0f, 0.0f, 0.0f,
         0.01f, 0.01f, 0.01f, 0.01f
-    });
+    };
 
-    // cognition portion of the genome
-    Vector<float> c(genomeSize-COGNITION_BEGIN, -100.0f);
-    g.insert(g.end(), c.begin(), c.end());
+    Vector<float> g(genomeSize, -100.0f); // cognition portion of the genome
+    std::copy_n(header, genomeHeaderSize+legacyBoundsSize, g.begin());
 
     return g;
 }();
 
 const Genome Genome::maxGenome = [](){
-    Vector<float> g({
+    const float header[genomeHeaderSize+legacyBoundsSize] = {
         ConfigSingleton::maxCreatureMass, 1.0f,
         0.99f, 0.99f, 1.0f,
         1.0f, 1.0f, 1.0f,
         0.1f, 0.1f, 0.1f, 0.1f
-    });
+    };
 
-    // cognition portion of the genome
-    Vector<float> c(genomeSize-COGNITION_BEGIN, 100.0f);
-    g.insert(g.end(), c.begin(), c.end());
+    Vector<float> g(genomeSize, 100.0f); // cognition portion of the genome
+    std::copy_n(header, genomeHeaderSize+legacyBoundsSize, g.begin());
 
     return g;
 }();
 
-Genome::Genome(float amplitude, float cognitionAmplitude) :
-    Vector<float>   (genomeSize)
+Genome::Genome(float amplitude, float cognitionAmplitude)
 {
+    auto genes = allocateGenes();
     for (size_t i=0; i<genomeSize; ++i) {
         if (i < COGNITION_BEGIN)
-            (*this)[i] = (minGenome[i] + maxGenome[i])*0.5f +
+            (*genes)[i] = (minGenome[i] + maxGenome[i])*0.5f +
                 (float)RNDS*(maxGenome[i] - minGenome[i])*0.5f*amplitude;
         else
-            (*this)[i] = (minGenome[i] + maxGenome[i])*0.5f +
+            (*genes)[i] = (minGenome[i] + maxGenome[i])*0.5f +
                 (float)RNDS*(maxGenome[i] - minGenome[i])*0.5f*cognitionAmplitude;
     }
+    _genes = std::move(genes);
 }
 
-Genome::Genome(Vector<float>&& vector) :
-    Vector<float>   (vector)
+Genome::Genome(Vector<float>&& vector)
 {
+    auto genes = allocateGenes();
+    std::copy_n(vector.begin(), std::min(vector.size(), genomeSize), genes->begin());
+    _genes = std::move(genes);
+}
+
+Genome::Genome(const float* genes)
+{
+    auto newGenes = allocateGenes();
+    std::copy_n(genes, genomeSize, newGenes->begin());
+    _genes = std::move(newGenes);
+}
+
+float Genome::operator[](size_t i) const
+{
+    if (!_delta.empty()) {
+        auto it = std::lower_bound(_delta.begin(), _delta.end(), i,
+            [](const GeneDelta& d, size_t i) { return d.index < i; });
+        if (it != _delta.end() && it->index == i)
+            return it->value;
+    }
+    return (*_genes)[i];
 }
 
 void Genome::mutate(float probability, float amplitude, MutationMode mode)
 {
-    for (size_t i=0; i<size(); ++i) {
-        if (RND < probability) {
-            switch (mode) {
-                case MutationMode::ADDITIVE:
-                    (*this)[i] = std::clamp((*this)[i]+(float)RNDS*amplitude, minGenome[i], maxGenome[i]);
-                    break;
-                case MutationMode::MULTIPLICATIVE:
-                    (*this)[i] = std::clamp((*this)[i]*(1.0f+(float)RNDS*amplitude), minGenome[i], maxGenome[i]);
-                    break;
-            }
+    thread_local Delta mutatedDelta;
+    mutatedDelta.clear();
+
+    if (_delta.empty()) {
+        // nothing to merge, always the case without delta storage as children are compacted after mutation
+        for (uint32_t i=0; i<genomeSize; ++i) {
+            if (RND < probability)
+                mutatedDelta.push_back(GeneDelta{i, mutateGene(i, (*_genes)[i], amplitude, mode)});
         }
+        _delta.swap(mutatedDelta);
+        return;
+    }
+
+    // merge the mutated genes with the existing delta, both are in index order
+    auto d = _delta.begin();
+    for (uint32_t i=0; i<genomeSize; ++i) {
+        bool inDelta = d != _delta.end() && d->index == i;
+        if (RND < probability)
+            mutatedDelta.push_back(GeneDelta{i, mutateGene(i, inDelta ? d->value : (*_genes)[i], amplitude, mode)});
+        else if (inDelta)
+            mutatedDelta.push_back(*d);
+
+        if (inDelta)
+            ++d;
     }
+
+    _delta.swap(mutatedDelta);
+}
+
+void Genome::copyTo(float* genes) const
+{
+    std::copy(_genes->begin(), _genes->end(), genes);
+    for (auto& d : _delta)
+        genes[d.index] = d.value;
+}
+
+void Genome::compact()
+{
+    if (_delta.empty())
+        return;
+
+    auto genes = allocateGenes();
+    copyTo(genes->data());
+    _genes = std::move(genes);
+    _delta.clear();
+}
+
+size_t Genome::deltaSize() const
+{
+    return _delta.size();
+}
+
+float Genome::mutateGene(size_t i, float value, float amplitude, MutationMode mode)
+{
+    switch (mode) {
+        case MutationMode::ADDITIVE:
+            return std::clamp(value+(float)RNDS*amplitude, minGenome[i], maxGenome[i]);
+        case MutationMode::MULTIPLICATIVE:
+            return std::clamp(value*(1.0f+(float)RNDS*amplitude), minGenome[i], maxGenome[i]);
+    }
+    return value;
+}
+
+std::shared_ptr<Genome::Genes> Genome::allocateGenes()
+{
+    // the control block and the genes share a single pool slot
+    return std::allocate_shared<Genes>(PoolAllocator<Genes>());
 }
@@ -0,0 +1,395 @@
+//
+// Project: evolution_simulator_2
+// File: GenomeBank.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <GenomeBank.hpp>
+#include <ConfigSingleton.hpp>
+#include <Utils.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+    constexpr uint64_t blockAlignment = 64;
+
+    inline uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + blockAlignment - 1) & ~(blockAlignment - 1);
+    }
+
+    inline uint16_t quantize(float value, float minimum, float maximum)
+    {
+        float range = maximum - minimum;
+        if (range <= 0.0f)
+            return 0;
+        return (uint16_t)std::lround(
+            std::clamp((value - minimum) / range, 0.0f, 1.0f) * (float)GenomeBank::quantizationMax);
+    }
+
+    inline float dequantize(int32_t value, float minimum, float maximum)
+    {
+        return minimum + (maximum - minimum) * ((float)value / (float)GenomeBank::quantizationMax);
+    }
+
+    inline uint32_t zigzagEncode(int32_t value)
+    {
+        return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    }
+
+    inline int32_t zigzagDecode(uint32_t value)
+    {
+        return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+
+    inline void writeVarint(Vector<uint8_t>& data, uint32_t value)
+    {
+        while (value >= 0x80) {
+            data.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        data.push_back((uint8_t)value);
+    }
+
+    // a 32-bit varint is at most 5 bytes, returns false on truncated or overlong input
+    inline bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+    {
+        value = 0;
+        for (int shift=0; shift<35 && data < end; shift+=7) {
+            uint8_t byte = *data++;
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // check that an aligned block of count elements at offset lies within a file of fileSize bytes
+    inline bool blockFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+    {
+        return offset % blockAlignment == 0 && offset <= fileSize &&
+            (elementSize == 0 || count <= (fileSize - offset) / elementSize);
+    }
+
+    // split [0, n) into contiguous ranges processed in parallel, f(threadId, begin, end)
+    template <typename T_F>
+    unsigned parallelRanges(uint64_t n, T_F&& f)
+    {
+        unsigned nThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (n < nThreads*16)
+            nThreads = 1;
+
+        Vector<std::thread> threads;
+        for (unsigned t=1; t<nThreads; ++t)
+            threads.emplace_back(f, t, n*t/nThreads, n*(t+1)/nThreads);
+        f(0u, (uint64_t)0, n/nThreads);
+        for (auto& thread : threads)
+            thread.join();
+
+        return nThreads;
+    }
+
+} // namespace
+
+
+GenomeBank::GenomeBank() :
+    _header     (),
+    _minimums   (nullptr),
+    _maximums   (nullptr),
+    _reference  (nullptr),
+    _index      (nullptr),
+    _data       (nullptr),
+    _mapping    (nullptr),
+    _mappingSize(0)
+{
+}
+
+GenomeBank::~GenomeBank()
+{
+    releaseMapping();
+}
+
+void GenomeBank::clear()
+{
+    Vector<float>().swap(_genes); // release the memory, exports are infrequent
+}
+
+void GenomeBank::addGenome(const Genome& genome)
+{
+    size_t offset = _genes.size();
+    _genes.resize(offset + Genome::genomeSize);
+    genome.copyTo(&_genes[offset]);
+}
+
+bool GenomeBank::write(const std::string& fileName) const
+{
+    constexpr uint64_t genomeSize = Genome::genomeSize;
+    uint64_t nGenomes = _genes.size() / genomeSize;
+    if (nGenomes == 0) {
+        printf("Error: No genomes to write\n");
+        return false;
+    }
+
+    // per-gene value ranges
+    Vector<Vector<float>> partialMinimums(std::thread::hardware_concurrency()+1,
+        Vector<float>(genomeSize, std::numeric_limits<float>::max()));
+    Vector<Vector<float>> partialMaximums(partialMinimums.size(),
+        Vector<float>(genomeSize, std::numeric_limits<float>::lowest()));
+    unsigned nThreads = parallelRanges(nGenomes, [&](unsigned threadId, uint64_t begin, uint64_t end) {
+        auto& minimums = partialMinimums[threadId];
+        auto& maximums = partialMaximums[threadId];
+        for (uint64_t g=begin; g<end; ++g) {
+            const float* genes = &_genes[g*genomeSize];
+            for (uint64_t i=0; i<genomeSize; ++i) {
+                minimums[i] = std::min(minimums[i], genes[i]);
+                maximums[i] = std::max(maximums[i], genes[i]);
+            }
+        }
+    });
+    Vector<float> minimums = partialMinimums[0];
+    Vector<float> maximums = partialMaximums[0];
+    for (unsigned t=1; t<nThreads; ++t) {
+        for (uint64_t i=0; i<genomeSize; ++i) {
+            minimums[i] = std::min(minimums[i], partialMinimums[t][i]);
+            maximums[i] = std::max(maximums[i], partialMaximums[t][i]);
+        }
+    }
+
+    // reference genome: per-gene mean of the quantized values
+    Vector<Vector<uint64_t>> partialSums(partialMinimums.size(), Vector<uint64_t>(genomeSize, 0));
+    parallelRanges(nGenomes, [&](unsigned threadId, uint64_t begin, uint64_t end) {
+        auto& sums = partialSums[threadId];
+        for (uint64_t g=begin; g<end; ++g) {
+            const float* genes = &_genes[g*genomeSize];
+            for (uint64_t i=0; i<genomeSize; ++i)
+                sums[i] += quantize(genes[i], minimums[i], maximums[i]);
+        }
+    });
+    Vector<uint16_t> reference(genomeSize);
+    for (uint64_t i=0; i<genomeSize; ++i) {
+        uint64_t sum = 0;
+        for (unsigned t=0; t<nThreads; ++t)
+            sum += partialSums[t][i];
+        reference[i] = (uint16_t)((sum + nGenomes/2) / nGenomes);
+    }
+
+    // encode genomes, each thread into its own buffer
+    Vector<Vector<uint8_t>> partialData(partialMinimums.size());
+    Vector<uint64_t> index(nGenomes+1, 0); // offsets relative to the thread buffer at first
+    Vector<uint64_t> threadBegins(partialMinimums.size(), 0);
+    parallelRanges(nGenomes, [&](unsigned threadId, uint64_t begin, uint64_t end) {
+        auto& data = partialData[threadId];
+        threadBegins[threadId] = begin;
+        data.reserve((end-begin)*genomeSize*2);
+        for (uint64_t g=begin; g<end; ++g) {
+            index[g] = data.size();
+            const float* genes = &_genes[g*genomeSize];
+            for (uint64_t i=0; i<genomeSize; ++i) {
+                int32_t delta = (int32_t)quantize(genes[i], minimums[i], maximums[i]) - (int32_t)reference[i];
+                writeVarint(data, zigzagEncode(delta));
+            }
+        }
+    });
+
+    // convert the index to offsets relative to the data block
+    uint64_t dataSize = 0;
+    for (unsigned t=0; t<nThreads; ++t) {
+        uint64_t end = t+1 < nThreads ? threadBegins[t+1] : nGenomes;
+        for (uint64_t g=threadBegins[t]; g<end; ++g)
+            index[g] += dataSize;
+        dataSize += partialData[t].size();
+    }
+    index[nGenomes] = dataSize;
+
+    Header header {};
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.headerSize = sizeof(Header);
+    header.genomeSize = genomeSize;
+    header.quantizationBits = quantizationBits;
+    header.nGenomes = nGenomes;
+    header.minimumsOffset = alignOffset(sizeof(Header));
+    header.maximumsOffset = alignOffset(header.minimumsOffset + genomeSize*sizeof(float));
+    header.referenceOffset = alignOffset(header.maximumsOffset + genomeSize*sizeof(float));
+    header.indexOffset = alignOffset(header.referenceOffset + genomeSize*sizeof(uint16_t));
+    header.dataOffset = alignOffset(header.indexOffset + (nGenomes+1)*sizeof(uint64_t));
+    header.fileSize = header.dataOffset + dataSize;
+
+    FILE* file = fopen(fileName.c_str(), "wb");
+    if (file == nullptr) {
+        printf("Error: Could not open %s for writing\n", fileName.c_str());
+        return false;
+    }
+
+    uint64_t position = 0;
+    auto writeBlock = [&](uint64_t offset, const void* data, uint64_t size) {
+        static const char zeros[blockAlignment] = {};
+        if (offset > position && fwrite(zeros, 1, offset-position, file) != offset-position)
+            return false;
+        position = offset + size;
+        return size == 0 || fwrite(data, 1, size, file) == size;
+    };
+
+    bool success =
+        writeBlock(0, &header, sizeof(Header)) &&
+        writeBlock(header.minimumsOffset, minimums.data(), genomeSize*sizeof(float)) &&
+        writeBlock(header.maximumsOffset, maximums.data(), genomeSize*sizeof(float)) &&
+        writeBlock(header.referenceOffset, reference.data(), genomeSize*sizeof(uint16_t)) &&
+        writeBlock(header.indexOffset, index.data(), (nGenomes+1)*sizeof(uint64_t));
+    for (unsigned t=0; t<nThreads && success; ++t) {
+        success = writeBlock(t == 0 ? header.dataOffset : position,
+            partialData[t].data(), partialData[t].size());
+    }
+
+    if (fclose(file) != 0)
+        success = false;
+
+    if (!success)
+        printf("Error: Could not write genome bank to %s\n", fileName.c_str());
+
+    return success;
+}
+
+bool GenomeBank::load(const std::string& fileName)
+{
+    releaseMapping();
+
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Could not open %s for reading\n", fileName.c_str());
+        return false;
+    }
+
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 || (uint64_t)fileStat.st_size < sizeof(Header)) {
+        printf("Error: %s is not a valid genome bank\n", fileName.c_str());
+        close(fd);
+        return false;
+    }
+
+    _mappingSize = (size_t)fileStat.st_size;
+    _mapping = mmap(nullptr, _mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (_mapping == MAP_FAILED) {
+        printf("Error: Could not map %s\n", fileName.c_str());
+        _mapping = nullptr;
+        _mappingSize = 0;
+        return false;
+    }
+
+    const char* base = static_cast<const char*>(_mapping);
+    memcpy(&_header, base, sizeof(Header));
+
+    if (memcmp(_header.magic, magic, sizeof(magic)) != 0 ||
+        _header.version != version ||
+        _header.headerSize != sizeof(Header) ||
+        _header.genomeSize != Genome::genomeSize ||
+        _header.quantizationBits != quantizationBits ||
+        _header.fileSize != _mappingSize) {
+        printf("Error: %s is not a compatible genome bank (version %u, genome size %u)\n",
+            fileName.c_str(), _header.version, _header.genomeSize);
+        releaseMapping();
+        return false;
+    }
+
+    constexpr uint64_t genomeSize = Genome::genomeSize;
+    bool valid =
+        _header.nGenomes < _mappingSize && // at least a byte per genome, nGenomes+1 can't overflow
+        blockFits(_header.minimumsOffset, genomeSize, sizeof(float), _mappingSize) &&
+        blockFits(_header.maximumsOffset, genomeSize, sizeof(float), _mappingSize) &&
+        blockFits(_header.referenceOffset, genomeSize, sizeof(uint16_t), _mappingSize) &&
+        blockFits(_header.indexOffset, _header.nGenomes+1, sizeof(uint64_t), _mappingSize) &&
+        blockFits(_header.dataOffset, 0, 1, _mappingSize);
+
+    // index entries are offsets into the data block in genome order
+    if (valid) {
+        const uint64_t* index = reinterpret_cast<const uint64_t*>(base + _header.indexOffset);
+        uint64_t dataSize = _mappingSize - _header.dataOffset;
+        for (uint64_t g=0; g<=_header.nGenomes && valid; ++g)
+            valid = index[g] <= dataSize && (g == 0 || index[g] >= index[g-1]);
+    }
+
+    if (!valid) {
+        printf("Error: %s is truncated or corrupted\n", fileName.c_str());
+        releaseMapping();
+        return false;
+    }
+
+    _minimums = reinterpret_cast<const float*>(base + _header.minimumsOffset);
+    _maximums = reinterpret_cast<const float*>(base + _header.maximumsOffset);
+    _reference = reinterpret_cast<const uint16_t*>(base + _header.referenceOffset);
+    _index = reinterpret_cast<const uint64_t*>(base + _header.indexOffset);
+    _data = reinterpret_cast<const uint8_t*>(base + _header.dataOffset);
+
+    return true;
+}
+
+void GenomeBank::decode(uint64_t genomeId, float* genes) const
+{
+    const uint8_t* data = _data + _index[genomeId];
+    const uint8_t* end = _data + _index[genomeId+1];
+    for (uint64_t i=0; i<Genome::genomeSize; ++i) {
+        uint32_t encoded;
+        int32_t value = _reference[i]; // genes missing from a corrupted genome get the reference value
+        if (readVarint(data, end, encoded))
+            value = (int32_t)std::clamp((int64_t)value + zigzagDecode(encoded), (int64_t)0, (int64_t)quantizationMax);
+        genes[i] = dequantize(value, _minimums[i], _maximums[i]);
+    }
+}
+
+Genome GenomeBank::getGenome(uint64_t genomeId) const
+{
+    Vector<float> genes(Genome::genomeSize);
+    decode(genomeId, genes.data());
+    return Genome(std::move(genes));
+}
+
+void GenomeBank::populate(fug::Ecs& ecs, uint64_t nCreatures) const
+{
+    if (size() == 0) {
+        printf("Error: Genome bank is empty\n");
+        return;
+    }
+
+    float worldSize = ecs.getSingleton<ConfigSingleton>()->worldSize;
+    for (uint64_t i=0; i<nCreatures; ++i) {
+        // get position using rejection sampling
+        Vec2f p(RNDS*worldSize, RNDS*worldSize);
+        while (gauss2(p, ConfigSingleton::spawnSpread*worldSize) < RND)
+            p << RNDS*worldSize, RNDS*worldSize;
+
+        double mass = ConfigSingleton::minCreatureMass + RND*(
+            ConfigSingleton::maxCreatureMass-ConfigSingleton::minCreatureMass);
+
+        createCreature(ecs, getGenome(i % size()), mass, 1.0, p, RND*M_PI*2.0f, RND);
+    }
+}
+
+uint64_t GenomeBank::size() const
+{
+    return _mapping == nullptr ? 0 : _header.nGenomes;
+}
+
+void GenomeBank::releaseMapping()
+{
+    if (_mapping != nullptr) {
+        munmap(_mapping, _mappingSize);
+        _mapping = nullptr;
+        _mappingSize = 0;
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Project: evolution_simulator_2
+// File: HeadlessContext.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <HeadlessContext.hpp>
+
+#include <glad/glad.h>
+#include <cstdio>
+
+
+HeadlessContext::HeadlessContext() :
+    _sdlInitialized (false),
+    _window         (nullptr),
+    _glContext      (nullptr)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    if (_glContext != nullptr)
+        SDL_GL_DeleteContext(_glContext);
+    if (_window != nullptr)
+        SDL_DestroyWindow(_window);
+    if (_sdlInitialized)
+        SDL_Quit();
+}
+
+bool HeadlessContext::init(const char* name)
+{
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        printf("Error: Could not initialize SDL! SDL_Error: %s\n", SDL_GetError());
+        return false;
+    }
+    _sdlInitialized = true;
+
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+    _window = SDL_CreateWindow(name, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64, 64,
+        SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
+    if (_window == nullptr) {
+        printf("Error: SDL Window could not be created! SDL_Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    _glContext = SDL_GL_CreateContext(_window);
+    if (_glContext == nullptr || !gladLoadGL()) {
+        printf("Error: OpenGL context could not be created! SDL_Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
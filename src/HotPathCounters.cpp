@@ -0,0 +1,92 @@
+//
+// Project: evolution_simulator_2
+// File: HotPathCounters.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <HotPathCounters.hpp>
+#include <gut_utils/TypeUtils.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+
+struct HotPathCounters::Registry {
+    std::mutex                      mutex;
+    Vector<std::unique_ptr<Block>>  blocks;
+    Values                          retired {}; // totals of the exited threads
+    Values                          previous {}; // totals on the previous collect
+
+    Values total() // requires mutex
+    {
+        Values values = retired;
+        for (auto& block : blocks) {
+            for (int c=0; c<N_COUNTERS; ++c)
+                values[c] += block->values[c].load(std::memory_order_relaxed);
+        }
+        return values;
+    }
+};
+
+
+HotPathCounters::Values HotPathCounters::collect()
+{
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    Values values = r.total();
+    Values delta;
+    for (int c=0; c<N_COUNTERS; ++c)
+        delta[c] = values[c] - r.previous[c];
+    r.previous = values;
+
+    return delta;
+}
+
+const char* HotPathCounters::getName(HotPathCounters::Counter counter)
+{
+    static const char* names[] = {
+        "gridQueries", "gridCellsVisited", "gridCandidates", "collisionTests", "collisionHits",
+        "whiskerTests", "whiskerHits", "eventsDispatched", "eventRounds", "entitiesCreated",
+        "entitiesRemoved"
+    };
+    return names[counter];
+}
+
+HotPathCounters::Block* HotPathCounters::registerThread()
+{
+    // folds the counts of the block into the retired totals when the thread exits
+    struct BlockHandle {
+        Block*  block = nullptr;
+
+        ~BlockHandle()
+        {
+            auto& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            for (int c=0; c<N_COUNTERS; ++c)
+                r.retired[c] += block->values[c].load(std::memory_order_relaxed);
+            r.blocks.erase(std::find_if(r.blocks.begin(), r.blocks.end(),
+                [&](const std::unique_ptr<Block>& b) { return b.get() == block; }));
+            _threadBlock = nullptr;
+        }
+    };
+    thread_local BlockHandle handle;
+
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.blocks.push_back(std::make_unique<Block>());
+    handle.block = r.blocks.back().get();
+
+    return handle.block;
+}
+
+HotPathCounters::Registry& HotPathCounters::registry()
+{
+    static Registry registry;
+    return registry;
+}
@@ -11,6 +11,8 @@
 #include <LineSingleton.hpp>
 #include <Utils.hpp>
 
+#include <utility>
+
 
 LineSingleton::LineSingleton() :
     _windowWidth            (1280),
@@ -59,6 +61,20 @@ void LineSingleton::drawLine(const Vec2f& p1, const Vec2f& p2, const Vec3f& c1,
     _vertexColors.push_back(c2);
 }
 
+void LineSingleton::drawLines(const Vector<Vec2f>& positions, const Vector<Vec3f>& colors)
+{
+    _vertexPositions.insert(_vertexPositions.end(), positions.begin(), positions.end());
+    _vertexColors.insert(_vertexColors.end(), colors.begin(), colors.end());
+}
+
+void LineSingleton::moveLines(Vector<Vec2f>& positions, Vector<Vec3f>& colors)
+{
+    // swapping keeps the capacity of both for the next lines
+    std::swap(_vertexPositions, positions);
+    std::swap(_vertexColors, colors);
+    clear();
+}
+
 void LineSingleton::render(const Mat3f& viewport)
 {
     glBindBuffer(GL_ARRAY_BUFFER, _positionBufferId);
@@ -82,6 +98,11 @@ void LineSingleton::render(const Mat3f& viewport)
 
     glDrawArrays(GL_LINES, 0, _vertexPositions.size());
 
+    clear();
+}
+
+void LineSingleton::clear()
+{
     _vertexPositions.clear();
     _vertexColors.clear();
 }
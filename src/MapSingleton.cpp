@@ -11,6 +11,7 @@
 #include "MapSingleton.hpp"
 #include "Utils.hpp"
 #include "ConfigSingleton.hpp"
+#include "Profiler.hpp"
 
 #include <gut_utils/VertexData.hpp>
 
@@ -18,7 +19,10 @@
 MapSingleton::MapSingleton() :
     _fertilityMapTexture    (GL_TEXTURE_2D, GL_R32F, GL_FLOAT),
     _fertilityMapImage      (nullptr),
-    _averageFertility       (0.0f)
+    _averageFertility       (0.0f),
+    _worldSize              (ConfigSingleton::defaultWorldSize),
+    _diffusionFence         (nullptr),
+    _renderFence            (nullptr)
 {
     // load the shaders
     _mapRenderShader.load(
@@ -26,13 +30,13 @@ MapSingleton::MapSingleton() :
         EVOLUTION_SIMULATOR_RES("shaders/FS_Map.glsl"));
     _diffusionShader.load(EVOLUTION_SIMULATOR_RES("shaders/CS_Diffusion.glsl"), GL_COMPUTE_SHADER);
 
-    // setup the world quad
+    // setup the world quad, scaled to the world size when rendering
     gut::VertexData worldQuadVertexData;
     worldQuadVertexData.addDataVector<Vec3f>("position", Vector<Vec3f>{
-        Vec3f(-ConfigSingleton::worldSize, -ConfigSingleton::worldSize, 1.0f),
-        Vec3f(ConfigSingleton::worldSize, -ConfigSingleton::worldSize, 1.0f),
-        Vec3f(-ConfigSingleton::worldSize, ConfigSingleton::worldSize, 1.0f),
-        Vec3f(ConfigSingleton::worldSize, ConfigSingleton::worldSize, 1.0f)
+        Vec3f(-1.0f, -1.0f, 1.0f),
+        Vec3f(1.0f, -1.0f, 1.0f),
+        Vec3f(-1.0f, 1.0f, 1.0f),
+        Vec3f(1.0f, 1.0f, 1.0f)
     });
 
     worldQuadVertexData.addDataVector<Vec2f>("texCoord", Vector<Vec2f>{
@@ -61,18 +65,31 @@ MapSingleton::MapSingleton() :
     glGetnTexImage(GL_TEXTURE_2D, 12, GL_RED, GL_FLOAT, sizeof(float), &_averageFertility);
 }
 
+void MapSingleton::setWorldSize(float worldSize)
+{
+    std::lock_guard<std::mutex> lock(_textureMutex);
+    _worldSize = worldSize;
+}
+
 void MapSingleton::prefetch()
 {
+    PROFILE_SCOPE("map prefetch");
+    {   // the last diffusion may have been run in another context
+        std::lock_guard<std::mutex> lock(_textureMutex);
+        waitForFence(_diffusionFence);
+    }
     _fertilityMapTexture.initiateMapping();
 }
 
 void MapSingleton::map()
 {
+    PROFILE_SCOPE("map sync");
     _fertilityMapImage = &_fertilityMapTexture.mapToImage();
 }
 
 void MapSingleton::unmap()
 {
+    PROFILE_SCOPE("map unmap");
     _fertilityMapTexture.unmap();
     _fertilityMapImage = nullptr;
 }
@@ -84,21 +101,30 @@ gut::Image& MapSingleton::fertilityMap()
 
 void MapSingleton::diffuseFertility()
 {
-    _diffusionShader.use();
-    _diffusionShader.setUniform("averageFertility", _averageFertility);
-
-    _fertilityMapTexture.bindImage(0, 0, GL_READ_ONLY, true);
-    _fertilityMapTexture.bindImage(1, 0, GL_WRITE_ONLY, false);
-    _diffusionShader.dispatch(128, 128, 1);
-    _fertilityMapTexture.swap();
-    _fertilityMapTexture.generateMipMaps();
+    {   std::lock_guard<std::mutex> lock(_textureMutex);
+        // the last render or diffusion may have been issued in another context, the
+        // texture written to may still be sampled by the render
+        waitForFence(_renderFence);
+        waitForFence(_diffusionFence);
+
+        _diffusionShader.use();
+        _diffusionShader.setUniform("averageFertility", _averageFertility);
+
+        _fertilityMapTexture.bindImage(0, 0, GL_READ_ONLY, true);
+        _fertilityMapTexture.bindImage(1, 0, GL_WRITE_ONLY, false);
+        _diffusionShader.dispatch(128, 128, 1);
+        _fertilityMapTexture.swap();
+        _fertilityMapTexture.generateMipMaps();
+        setFence(_diffusionFence);
+    }
 
     // read new average fertility
+    PROFILE_SCOPE("map average readback");
     _fertilityMapTexture.bind();
     glGetnTexImage(GL_TEXTURE_2D, 12, GL_RED, GL_FLOAT, sizeof(float), &_averageFertility);
 }
 
-Vector<Vec2f> MapSingleton::sampleFertility(int nSamples)
+void MapSingleton::sampleFertility(Vector<Vec2f>& samples, int nSamples)
 {
     bool justInTimeMapped = false;
     if (_fertilityMapImage == nullptr) {
@@ -108,7 +134,7 @@ Vector<Vec2f> MapSingleton::sampleFertility(int nSamples)
     }
 
     // get samples
-    Vector<Vec2f> samples;
+    samples.clear();
     for (int i=0; i<nSamples; ++i) {
         Vec2f sample(RND, RND);
         gut::Image::Pixel<float> pixel = (*_fertilityMapImage)(
@@ -123,22 +149,98 @@ Vector<Vec2f> MapSingleton::sampleFertility(int nSamples)
                 (int)(sample(1)*(float)_fertilityMapTexture.height()));
         }
 
-        samples.push_back((sample*2.0f - Vec2f(1.0f, 1.0f))*ConfigSingleton::worldSize);
+        samples.push_back((sample*2.0f - Vec2f(1.0f, 1.0f))*_worldSize);
     }
 
     if (justInTimeMapped)
         _fertilityMapTexture.unmap();
+}
+
+int MapSingleton::width()
+{
+    return _fertilityMapTexture.width();
+}
+
+int MapSingleton::height()
+{
+    return _fertilityMapTexture.height();
+}
+
+void MapSingleton::readFertility(float* data)
+{
+    bool justInTimeMapped = false;
+    if (_fertilityMapImage == nullptr) {
+        prefetch();
+        map();
+        justInTimeMapped = true;
+    }
+
+    int w = _fertilityMapTexture.width();
+    int h = _fertilityMapTexture.height();
+    for (int j=0; j<h; ++j) {
+        for (int i=0; i<w; ++i)
+            data[j*w + i] = (*_fertilityMapImage)(i, j).r;
+    }
 
-    return samples;
+    if (justInTimeMapped)
+        unmap();
+}
+
+void MapSingleton::writeFertility(const float* data)
+{
+    bool justInTimeMapped = false;
+    if (_fertilityMapImage == nullptr) {
+        prefetch();
+        map();
+        justInTimeMapped = true;
+    }
+
+    int w = _fertilityMapTexture.width();
+    int h = _fertilityMapTexture.height();
+    for (int j=0; j<h; ++j) {
+        for (int i=0; i<w; ++i) {
+            gut::Image::Pixel<float> pixel = (*_fertilityMapImage)(i, j);
+            pixel.r = data[j*w + i];
+            _fertilityMapImage->setPixel(i, j, pixel);
+        }
+    }
+
+    // unmapping uploads the modified pixels back to the texture
+    if (justInTimeMapped) {
+        unmap();
+        std::lock_guard<std::mutex> lock(_textureMutex);
+        setFence(_diffusionFence);
+    }
 }
 
 void MapSingleton::render(const Viewport& viewport)
 {
+    std::lock_guard<std::mutex> lock(_textureMutex);
+    waitForFence(_diffusionFence);
+
     _mapRenderShader.use();
-    _mapRenderShader.setUniform("viewport", static_cast<const Mat3f&>(viewport));
+    Mat3f worldScale = Vec3f(_worldSize, _worldSize, 1.0f).asDiagonal();
+    _mapRenderShader.setUniform("viewport", static_cast<Mat3f>(static_cast<const Mat3f&>(viewport)*worldScale));
     _mapRenderShader.setUniform("windowWidth", (int)viewport.getWindowWidth());
     _mapRenderShader.setUniform("windowHeight", (int)viewport.getWindowHeight());
     _fertilityMapTexture.bind(GL_TEXTURE0);
     _mapRenderShader.setUniform("tex", 0);
     _worldQuad.render(_mapRenderShader);
+    setFence(_renderFence);
+}
+
+void MapSingleton::setFence(GLsync& fence)
+{
+    if (fence != nullptr)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // a fence is only waited for by other contexts once it has been flushed
+    glFlush();
+}
+
+void MapSingleton::waitForFence(GLsync fence)
+{
+    // waits on the GPU, the calling thread continues issuing commands
+    if (fence != nullptr)
+        glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
 }
@@ -0,0 +1,66 @@
+//
+// Project: evolution_simulator_2
+// File: MigrationQueue.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <MigrationQueue.hpp>
+
+#include <new>
+
+
+size_t MigrationQueue::requiredSize(uint32_t capacity)
+{
+    return sizeof(Control) + capacity*sizeof(Migrant);
+}
+
+MigrationQueue::MigrationQueue() :
+    _control    (nullptr),
+    _slots      (nullptr),
+    _capacity   (0)
+{
+}
+
+void MigrationQueue::init(void* memory, uint32_t capacity)
+{
+    _control = new (memory) Control;
+    _control->head.store(0, std::memory_order_relaxed);
+    _control->tail.store(0, std::memory_order_relaxed);
+    _slots = reinterpret_cast<Migrant*>(static_cast<char*>(memory) + sizeof(Control));
+    _capacity = capacity;
+}
+
+bool MigrationQueue::tryPush(const Migrant& migrant)
+{
+    uint64_t tail = _control->tail.load(std::memory_order_relaxed);
+    if (tail - _control->head.load(std::memory_order_acquire) >= _capacity)
+        return false;
+
+    _slots[tail % _capacity] = migrant;
+    // publish the slot contents along with the index
+    _control->tail.store(tail+1, std::memory_order_release);
+    return true;
+}
+
+uint32_t MigrationQueue::getFreeSlots() const
+{
+    uint64_t used = _control->tail.load(std::memory_order_relaxed) -
+        _control->head.load(std::memory_order_acquire);
+    return _capacity - (uint32_t)used;
+}
+
+bool MigrationQueue::tryPop(Migrant& migrant)
+{
+    uint64_t head = _control->head.load(std::memory_order_relaxed);
+    if (head == _control->tail.load(std::memory_order_acquire))
+        return false;
+
+    migrant = _slots[head % _capacity];
+    // release the slot to the producer only after it has been copied
+    _control->head.store(head+1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,244 @@
+//
+// Project: evolution_simulator_2
+// File: PhylogenySingleton.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <PhylogenySingleton.hpp>
+
+#include <cstring>
+
+
+PhylogenySingleton::PhylogenySingleton() :
+    _nSlots             (0),
+    _nNodes             (0),
+    _nextId             (1),
+    _file               (nullptr),
+    _nRecordsWritten    (0)
+{
+}
+
+PhylogenySingleton::~PhylogenySingleton()
+{
+    close();
+}
+
+bool PhylogenySingleton::open(const std::string& fileName)
+{
+    close();
+
+    _file = fopen(fileName.c_str(), "wb");
+    if (_file == nullptr) {
+        printf("Error: Could not open %s for writing\n", fileName.c_str());
+        return false;
+    }
+
+    uint32_t header[2] = { version, (uint32_t)sizeof(Record) };
+    fwrite(magic, 1, sizeof(magic), _file);
+    fwrite(header, sizeof(uint32_t), 2, _file);
+
+    _writer = std::make_unique<WorkerThread>(4, "phylogeny writer");
+    _segment.reserve(segmentSize);
+    _nRecordsWritten = 0;
+
+    return true;
+}
+
+void PhylogenySingleton::close()
+{
+    if (_file == nullptr)
+        return;
+
+    // retained nodes are still needed by the tree, they are written without removing them
+    for (uint32_t slot=0; slot<_nSlots; ++slot) {
+        auto& n = node(slot);
+        if (n.record.id != 0)
+            emit(n.record);
+    }
+
+    flushSegment();
+    _writer.reset(); // finishes the pending writes
+    fclose(_file);
+    _file = nullptr;
+}
+
+bool PhylogenySingleton::isOpen() const
+{
+    return _file != nullptr;
+}
+
+uint32_t PhylogenySingleton::addBirth(uint32_t parentSlot, uint64_t tick)
+{
+    uint32_t slot = allocate();
+    auto& n = node(slot);
+    n.record.id = _nextId++;
+    n.record.parentId = parentSlot == invalidSlot ? 0 : node(parentSlot).record.id;
+    n.record.birthTick = tick;
+    n.record.deathTick = noTick;
+    n.alive = true;
+    link(slot, parentSlot);
+
+    return slot;
+}
+
+void PhylogenySingleton::addDeath(uint32_t slot, uint64_t tick)
+{
+    if (slot == invalidSlot)
+        return;
+
+    auto& n = node(slot);
+    n.record.deathTick = tick;
+    n.alive = false;
+    coalesce(slot);
+}
+
+void PhylogenySingleton::reset()
+{
+    for (uint32_t slot=0; slot<_nSlots; ++slot) {
+        auto& n = node(slot);
+        if (n.record.id != 0)
+            emit(n.record);
+    }
+
+    _blocks.clear();
+    _nSlots = 0;
+    _freeSlots.clear();
+    _nNodes = 0;
+}
+
+uint64_t PhylogenySingleton::getId(uint32_t slot) const
+{
+    return slot == invalidSlot ? 0 : node(slot).record.id;
+}
+
+uint64_t PhylogenySingleton::getNumberOfNodes() const
+{
+    return _nNodes;
+}
+
+uint64_t PhylogenySingleton::getNumberOfRecordsWritten() const
+{
+    return _nRecordsWritten;
+}
+
+uint32_t PhylogenySingleton::allocate()
+{
+    uint32_t slot;
+    if (!_freeSlots.empty()) {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+    }
+    else {
+        if (_nSlots % arenaBlockSize == 0)
+            _blocks.emplace_back(new Node[arenaBlockSize]);
+        slot = _nSlots++;
+    }
+
+    auto& n = node(slot);
+    n.parent = invalidSlot;
+    n.firstChild = invalidSlot;
+    n.prevSibling = invalidSlot;
+    n.nextSibling = invalidSlot;
+    n.nChildren = 0;
+    ++_nNodes;
+
+    return slot;
+}
+
+void PhylogenySingleton::link(uint32_t slot, uint32_t parent)
+{
+    auto& n = node(slot);
+    n.parent = parent;
+    n.prevSibling = invalidSlot;
+    n.nextSibling = invalidSlot;
+    if (parent == invalidSlot)
+        return;
+
+    auto& p = node(parent);
+    n.nextSibling = p.firstChild;
+    if (p.firstChild != invalidSlot)
+        node(p.firstChild).prevSibling = slot;
+    p.firstChild = slot;
+    ++p.nChildren;
+}
+
+void PhylogenySingleton::unlink(uint32_t slot)
+{
+    auto& n = node(slot);
+    if (n.prevSibling != invalidSlot)
+        node(n.prevSibling).nextSibling = n.nextSibling;
+    else if (n.parent != invalidSlot)
+        node(n.parent).firstChild = n.nextSibling;
+    if (n.nextSibling != invalidSlot)
+        node(n.nextSibling).prevSibling = n.prevSibling;
+    if (n.parent != invalidSlot)
+        --node(n.parent).nChildren;
+
+    n.parent = invalidSlot;
+    n.prevSibling = invalidSlot;
+    n.nextSibling = invalidSlot;
+}
+
+void PhylogenySingleton::remove(uint32_t slot)
+{
+    auto& n = node(slot);
+    emit(n.record);
+    n.record.id = 0;
+    _freeSlots.push_back(slot);
+    --_nNodes;
+}
+
+void PhylogenySingleton::coalesce(uint32_t slot)
+{
+    while (slot != invalidSlot) {
+        auto& n = node(slot);
+        if (n.alive || n.nChildren >= 2)
+            return;
+
+        uint32_t parent = n.parent;
+        if (n.nChildren == 0) {
+            // extinct branch, the parent might now be prunable as well
+            unlink(slot);
+            remove(slot);
+            slot = parent;
+        }
+        else {
+            // single descendant line, splice the node out
+            uint32_t child = n.firstChild;
+            unlink(child);
+            unlink(slot);
+            link(child, parent);
+            remove(slot);
+            return;
+        }
+    }
+}
+
+void PhylogenySingleton::emit(const Record& record)
+{
+    if (_file == nullptr)
+        return;
+
+    _segment.push_back(record);
+    if (_segment.size() >= segmentSize)
+        flushSegment();
+}
+
+void PhylogenySingleton::flushSegment()
+{
+    if (_segment.empty())
+        return;
+
+    _nRecordsWritten += _segment.size();
+    _writer->push([file = _file, segment = std::move(_segment)]() {
+        fwrite(segment.data(), sizeof(Record), segment.size(), file);
+        fflush(file);
+    });
+
+    _segment = Vector<Record>();
+    _segment.reserve(segmentSize);
+}
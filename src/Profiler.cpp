@@ -0,0 +1,321 @@
+//
+// Project: evolution_simulator_2
+// File: Profiler.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Profiler.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() :
+    _historyPosition    (0),
+    _nHistoryFrames     (0),
+    _lastFrameBegin     (0),
+    _lastFrameEnd       (0),
+    _epoch              (0),
+    _tracing            (false),
+    _tracePosition      (0),
+    _nTraceEvents       (0)
+{
+    _epoch = now();
+}
+
+uint32_t Profiler::registerStage(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = std::find(_stageNames.begin(), _stageNames.end(), name);
+    if (it != _stageNames.end())
+        return (uint32_t)(it - _stageNames.begin());
+
+    _stageNames.push_back(name);
+    _history.emplace_back(historySize, 0.0);
+    return (uint32_t)_stageNames.size()-1;
+}
+
+void Profiler::beginSpan(uint64_t& begin, uint32_t& depth)
+{
+    auto& buffer = threadBuffer();
+    depth = buffer.depth++;
+    begin = now();
+}
+
+void Profiler::endSpan(uint32_t stage, uint64_t begin, uint32_t depth)
+{
+    uint64_t end = now();
+    auto& buffer = threadBuffer();
+    --buffer.depth;
+
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.spans.push_back(Span{stage, buffer.index, depth, begin, end});
+}
+
+uint32_t Profiler::registerCounter(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = std::find(_counterNames.begin(), _counterNames.end(), name);
+    if (it != _counterNames.end())
+        return (uint32_t)(it - _counterNames.begin());
+
+    _counterNames.push_back(name);
+    return (uint32_t)_counterNames.size()-1;
+}
+
+void Profiler::setCounter(uint32_t counter, double value)
+{
+    uint64_t timestamp = now();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_tracing)
+        return;
+
+    TraceEvent event {TraceEvent::Type::COUNTER, counter, 0, timestamp};
+    event.value = value;
+    pushTraceEvent(event);
+}
+
+void Profiler::setThreadName(const std::string& name)
+{
+    auto& buffer = threadBuffer();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    buffer.name = name;
+}
+
+void Profiler::endFrame()
+{
+    uint64_t frameEnd = now();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // collect the spans finished during the frame from all threads
+    _frameSpans.clear();
+    for (auto& thread : _threads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        _frameSpans.insert(_frameSpans.end(), thread->spans.begin(), thread->spans.end());
+        thread->spans.clear();
+    }
+    std::sort(_frameSpans.begin(), _frameSpans.end(), [](const Span& a, const Span& b) {
+        return a.thread < b.thread || (a.thread == b.thread && a.begin < b.begin);
+    });
+
+    // per-stage totals into the history
+    _frameTotals.assign(_stageNames.size(), 0.0);
+    for (auto& span : _frameSpans)
+        _frameTotals[span.stage] += (double)(span.end - span.begin)*1.0e-9;
+    for (size_t s=0; s<_history.size(); ++s)
+        _history[s][_historyPosition] = _frameTotals[s];
+    _historyPosition = (_historyPosition+1) % historySize;
+    _nHistoryFrames = std::min(_nHistoryFrames+1, historySize);
+
+    if (_tracing) {
+        for (auto& span : _frameSpans) {
+            TraceEvent event {TraceEvent::Type::SPAN, span.stage, span.thread, span.begin};
+            event.end = span.end;
+            pushTraceEvent(event);
+        }
+    }
+
+    std::swap(_lastFrameSpans, _frameSpans);
+    _lastFrameBegin = _lastFrameEnd;
+    _lastFrameEnd = frameEnd;
+}
+
+uint32_t Profiler::getNumberOfStages() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return (uint32_t)_stageNames.size();
+}
+
+std::string Profiler::getStageName(uint32_t stage) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stageNames[stage];
+}
+
+Profiler::StageStatistics Profiler::getStatistics(uint32_t stage) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    StageStatistics statistics {};
+    if (_nHistoryFrames == 0)
+        return statistics;
+
+    const auto& history = _history[stage];
+    statistics.last = history[(_historyPosition+historySize-1) % historySize];
+
+    Vector<double> values;
+    values.reserve(_nHistoryFrames);
+    for (uint32_t i=0; i<_nHistoryFrames; ++i)
+        values.push_back(history[(_historyPosition+historySize-1-i) % historySize]);
+
+    auto percentile = [&](double p) {
+        auto nth = values.begin() + (size_t)(p*(double)(values.size()-1));
+        std::nth_element(values.begin(), nth, values.end());
+        return *nth;
+    };
+    statistics.p50 = percentile(0.5);
+    statistics.p95 = percentile(0.95);
+    statistics.p99 = percentile(0.99);
+
+    return statistics;
+}
+
+const Vector<Profiler::Span>& Profiler::getLastFrameSpans() const
+{
+    return _lastFrameSpans;
+}
+
+uint64_t Profiler::getLastFrameBegin() const
+{
+    return _lastFrameBegin;
+}
+
+uint64_t Profiler::getLastFrameEnd() const
+{
+    return _lastFrameEnd;
+}
+
+uint64_t Profiler::now() const
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - _epoch;
+}
+
+void Profiler::startTrace(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _trace.resize(std::max(capacity, (size_t)1));
+    _tracePosition = 0;
+    _nTraceEvents = 0;
+    _tracing = true;
+}
+
+void Profiler::stopTrace()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tracing = false;
+}
+
+bool Profiler::isTracing() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tracing;
+}
+
+size_t Profiler::getNumberOfTraceEvents() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _nTraceEvents;
+}
+
+bool Profiler::writeTrace(const std::string& fileName) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    FILE* file = fopen(fileName.c_str(), "w");
+    if (file == nullptr) {
+        printf("Error: Unable to open trace file %s\n", fileName.c_str());
+        return false;
+    }
+
+    // names are written verbatim, they're literals from the source code
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"evolution_simulator\"}}");
+    for (auto& thread : _threads) {
+        if (thread->name.empty())
+            continue;
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            thread->index, thread->name.c_str());
+    }
+
+    // oldest event first, timestamps in microseconds
+    size_t first = (_tracePosition + _trace.size() - _nTraceEvents) % std::max(_trace.size(), (size_t)1);
+    for (size_t i=0; i<_nTraceEvents; ++i) {
+        const auto& event = _trace[(first+i) % _trace.size()];
+        switch (event.type) {
+            case TraceEvent::Type::SPAN:
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    _stageNames[event.id].c_str(), event.thread,
+                    (double)event.begin*1.0e-3, (double)(event.end-event.begin)*1.0e-3);
+                break;
+            case TraceEvent::Type::COUNTER:
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%.17g}}",
+                    _counterNames[event.id].c_str(), (double)event.begin*1.0e-3, event.value);
+                break;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool success = ferror(file) == 0;
+    fclose(file);
+    if (!success) {
+        printf("Error: Unable to write trace file %s\n", fileName.c_str());
+        return false;
+    }
+
+    printf("Wrote %lu trace events to %s\n", _nTraceEvents, fileName.c_str());
+    return true;
+}
+
+void Profiler::pushTraceEvent(const TraceEvent& event)
+{
+    // overwrites the oldest event once full
+    _trace[_tracePosition] = event;
+    _tracePosition = (_tracePosition+1) % _trace.size();
+    _nTraceEvents = std::min(_nTraceEvents+1, _trace.size());
+}
+
+Profiler::ThreadBuffer& Profiler::threadBuffer()
+{
+    // releases the buffer for reuse when the thread exits
+    struct ThreadBufferHandle {
+        Profiler*       profiler = nullptr;
+        ThreadBuffer*   buffer = nullptr;
+
+        ~ThreadBufferHandle()
+        {
+            if (buffer != nullptr) {
+                std::lock_guard<std::mutex> lock(profiler->_mutex);
+                buffer->released = true;
+            }
+        }
+    };
+    thread_local ThreadBufferHandle handle;
+
+    if (handle.buffer == nullptr) {
+        // buffers are not freed, pending spans of exited threads are still collected
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& thread : _threads) {
+            if (thread->released) {
+                handle.buffer = thread.get();
+                break;
+            }
+        }
+        if (handle.buffer == nullptr) {
+            _threads.push_back(std::make_unique<ThreadBuffer>());
+            handle.buffer = _threads.back().get();
+            handle.buffer->index = (uint32_t)_threads.size()-1;
+        }
+        handle.profiler = this;
+        handle.buffer->name.clear();
+        handle.buffer->depth = 0;
+        handle.buffer->released = false;
+    }
+    return *handle.buffer;
+}
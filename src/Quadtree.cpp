@@ -0,0 +1,307 @@
+//
+// Project: evolution_simulator_2
+// File: Quadtree.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Quadtree.hpp>
+#include <Utils.hpp>
+
+#include <algorithm>
+
+
+namespace {
+
+    constexpr uint32_t  maxDepth = 32;
+
+    inline __attribute__((always_inline)) uint32_t quadrant(const Vec2f& p, const Vec2f& center)
+    {
+        return (p(0) >= center(0) ? 1 : 0) | (p(1) >= center(1) ? 2 : 0);
+    }
+
+    // center of a child with half size h
+    inline __attribute__((always_inline)) Vec2f childCenter(const Vec2f& center, uint32_t q, float h)
+    {
+        return center + Vec2f((q & 1) ? h : -h, (q & 2) ? h : -h);
+    }
+
+} // namespace
+
+
+Quadtree::Quadtree(float halfSize, float minLeafSize) :
+    _halfSize       (halfSize),
+    _minLeafSize    (minLeafSize),
+    _nodes          (1),
+    _nNodes         (1)
+{
+    _nodes[0].firstChild = 0;
+    _nodes[0].nEntities = 0;
+}
+
+void Quadtree::setHalfSize(float halfSize)
+{
+    if (halfSize == _halfSize)
+        return;
+
+    // all nodes cover different areas now
+    release(0);
+    _nodes[0].entries.clear();
+    _nodes[0].nEntities = 0;
+    _halfSize = halfSize;
+}
+
+void Quadtree::reset()
+{
+    collapse(0);
+}
+
+void Quadtree::insert(fug::EntityId eId, const Vec2f& position)
+{
+    Vec2f p = clamp(position);
+    uint32_t node = 0;
+    uint32_t depth = 0;
+    Vec2f center(0.0f, 0.0f);
+    float h = _halfSize;
+    for (;;) {
+        ++_nodes[node].nEntities;
+        uint32_t firstChild = _nodes[node].firstChild;
+        if (firstChild == 0)
+            break;
+
+        uint32_t q = quadrant(p, center);
+        h *= 0.5f;
+        center = childCenter(center, q, h);
+        node = firstChild + q;
+        ++depth;
+    }
+
+    _nodes[node].entries.push_back(Entry{p, eId});
+    if (_nodes[node].entries.size() > leafCapacity && h >= _minLeafSize && depth < maxDepth)
+        split(node, center, h, depth);
+}
+
+bool Quadtree::remove(fug::EntityId eId, const Vec2f& position)
+{
+    Vec2f p = clamp(position);
+
+    // find the leaf first, counts along the path are only updated if the entity is found
+    uint32_t node = 0;
+    Vec2f center(0.0f, 0.0f);
+    float h = _halfSize;
+    while (_nodes[node].firstChild != 0) {
+        uint32_t q = quadrant(p, center);
+        h *= 0.5f;
+        center = childCenter(center, q, h);
+        node = _nodes[node].firstChild + q;
+    }
+
+    auto& entries = _nodes[node].entries;
+    auto it = std::find_if(entries.begin(), entries.end(), [eId](const Entry& e) { return e.eId == eId; });
+    if (it == entries.end())
+        return false;
+
+    *it = entries.back();
+    entries.pop_back();
+
+    node = 0;
+    center << 0.0f, 0.0f;
+    h = _halfSize;
+    for (;;) {
+        --_nodes[node].nEntities;
+        if (_nodes[node].firstChild == 0)
+            break;
+
+        uint32_t q = quadrant(p, center);
+        h *= 0.5f;
+        center = childCenter(center, q, h);
+        node = _nodes[node].firstChild + q;
+    }
+    return true;
+}
+
+bool Quadtree::move(fug::EntityId eId, const Vec2f& from, const Vec2f& to)
+{
+    Vec2f pFrom = clamp(from);
+    Vec2f pTo = clamp(to);
+
+    // most moves stay inside the leaf
+    uint32_t node = 0;
+    Vec2f center(0.0f, 0.0f);
+    float h = _halfSize;
+    while (_nodes[node].firstChild != 0) {
+        uint32_t q = quadrant(pFrom, center);
+        if (q != quadrant(pTo, center))
+            break;
+        h *= 0.5f;
+        center = childCenter(center, q, h);
+        node = _nodes[node].firstChild + q;
+    }
+
+    if (_nodes[node].firstChild == 0) {
+        for (auto& e : _nodes[node].entries) {
+            if (e.eId == eId) {
+                e.position = pTo;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (!remove(eId, from))
+        return false;
+    insert(eId, to);
+    return true;
+}
+
+uint64_t Quadtree::getEntities(Vector<fug::EntityId>& entities, const Vec2f& begin, const Vec2f& end) const
+{
+    return query(entities,
+        [&](const Vec2f& center, float h) {
+            return center(0)+h >= begin(0) && center(0)-h <= end(0) &&
+                center(1)+h >= begin(1) && center(1)-h <= end(1);
+        },
+        [&](const Vec2f& p) {
+            return p(0) >= begin(0) && p(0) <= end(0) && p(1) >= begin(1) && p(1) <= end(1);
+        });
+}
+
+uint64_t Quadtree::getEntitiesAlongRay(Vector<fug::EntityId>& entities,
+    const Vec2f& begin, const Vec2f& end, float radius) const
+{
+    Vec2f d = end-begin;
+    float dd = d.squaredNorm();
+    float radius2 = radius*radius;
+
+    return query(entities,
+        [&](const Vec2f& center, float h) {
+            // node expanded by the radius against the segment
+            return segmentIntersectsAABB(begin, end,
+                center-Vec2f(h+radius, h+radius), center+Vec2f(h+radius, h+radius));
+        },
+        [&](const Vec2f& p) {
+            float t = dd > 0.0f ? std::clamp((p-begin).dot(d)/dd, 0.0f, 1.0f) : 0.0f;
+            return (begin+t*d-p).squaredNorm() <= radius2;
+        });
+}
+
+size_t Quadtree::getNumberOfNodes() const
+{
+    return _nNodes;
+}
+
+Vec2f Quadtree::clamp(const Vec2f& position) const
+{
+    return Vec2f(std::clamp(position(0), -_halfSize, _halfSize), std::clamp(position(1), -_halfSize, _halfSize));
+}
+
+void Quadtree::split(uint32_t node, const Vec2f& center, float halfSize, uint32_t depth)
+{
+    uint32_t firstChild;
+    if (_freeBlocks.empty()) {
+        firstChild = (uint32_t)_nodes.size();
+        _nodes.resize(_nodes.size()+4);
+    }
+    else {
+        firstChild = _freeBlocks.back();
+        _freeBlocks.pop_back();
+    }
+    _nNodes += 4;
+
+    for (uint32_t q=0; q<4; ++q) {
+        auto& child = _nodes[firstChild+q];
+        child.entries.clear();
+        child.firstChild = 0;
+        child.nEntities = 0;
+    }
+    _nodes[node].firstChild = firstChild;
+
+    // the node keeps the entry capacity in case it's collapsed later
+    for (auto& e : _nodes[node].entries) {
+        auto& child = _nodes[firstChild + quadrant(e.position, center)];
+        child.entries.push_back(e);
+        ++child.nEntities;
+    }
+    _nodes[node].entries.clear();
+
+    // all entries might have ended up in the same child
+    float h = halfSize*0.5f;
+    for (uint32_t q=0; q<4; ++q) {
+        if (_nodes[firstChild+q].entries.size() > leafCapacity && h >= _minLeafSize && depth+1 < maxDepth)
+            split(firstChild+q, childCenter(center, q, h), h, depth+1);
+    }
+}
+
+void Quadtree::collapse(uint32_t node)
+{
+    uint32_t firstChild = _nodes[node].firstChild;
+    if (firstChild != 0) {
+        if (_nodes[node].nEntities <= leafCapacity)
+            release(node);
+        else {
+            for (uint32_t q=0; q<4; ++q)
+                collapse(firstChild+q);
+        }
+    }
+
+    // entries retain their capacity
+    _nodes[node].entries.clear();
+    _nodes[node].nEntities = 0;
+}
+
+void Quadtree::release(uint32_t node)
+{
+    uint32_t firstChild = _nodes[node].firstChild;
+    if (firstChild == 0)
+        return;
+
+    for (uint32_t q=0; q<4; ++q) {
+        release(firstChild+q);
+        _nodes[firstChild+q].entries.clear();
+        _nodes[firstChild+q].nEntities = 0;
+    }
+    _freeBlocks.push_back(firstChild);
+    _nNodes -= 4;
+    _nodes[node].firstChild = 0;
+}
+
+template <typename T_Overlaps, typename T_Contains>
+uint64_t Quadtree::query(Vector<fug::EntityId>& entities, T_Overlaps&& overlaps, T_Contains&& contains) const
+{
+    struct Item {
+        uint32_t    node;
+        float       h;
+        Vec2f       center;
+    };
+
+    // depth first, at most three siblings per level wait in the stack
+    Item stack[3*maxDepth+4];
+    uint32_t nItems = 0;
+    stack[nItems++] = Item{0, _halfSize, Vec2f(0.0f, 0.0f)};
+
+    uint64_t nVisited = 0;
+    while (nItems > 0) {
+        Item item = stack[--nItems];
+        const Node& node = _nodes[item.node];
+        if (node.nEntities == 0 || !overlaps(item.center, item.h))
+            continue;
+
+        ++nVisited;
+        if (node.firstChild == 0) {
+            for (auto& e : node.entries) {
+                if (contains(e.position))
+                    entities.push_back(e.eId);
+            }
+            continue;
+        }
+
+        float h = item.h*0.5f;
+        for (uint32_t q=0; q<4; ++q)
+            stack[nItems++] = Item{node.firstChild+q, h, childCenter(item.center, q, h)};
+    }
+
+    return nVisited;
+}
@@ -0,0 +1,510 @@
+//
+// Project: evolution_simulator_2
+// File: Simulation.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Simulation.hpp>
+#include <Utils.hpp>
+#include <Genome.hpp>
+#include <CreatureComponent.hpp>
+#include <FoodComponent.hpp>
+#include <WorldSingleton.hpp>
+#include <ConfigSingleton.hpp>
+#include <ResourceSingleton.hpp>
+#include <MapSingleton.hpp>
+#include <LineSingleton.hpp>
+#include <TelemetrySingleton.hpp>
+#include <SpeciesSingleton.hpp>
+#include <PhylogenySingleton.hpp>
+#include <HotPathCounters.hpp>
+#include <Profiler.hpp>
+
+#include <chrono>
+
+
+namespace {
+
+    // adds the lifetime and the heap allocations of the timer to a stage
+    class StageTimer {
+    public:
+        StageTimer(double& time, AllocationTracker::Counts& allocations) :
+            _time               (time),
+            _allocations        (allocations),
+            _start              (std::chrono::steady_clock::now()),
+            _startAllocations   (AllocationTracker::threadCounts())
+        {
+        }
+
+        ~StageTimer()
+        {
+            _time += std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+            _allocations += AllocationTracker::threadCounts() - _startAllocations;
+        }
+
+    private:
+        double&                                 _time;
+        AllocationTracker::Counts&              _allocations;
+        std::chrono::steady_clock::time_point   _start;
+        AllocationTracker::Counts               _startAllocations;
+    };
+
+} // namespace
+
+
+Simulation::Simulation() :
+    _eventSystem        (_ecs),
+    _creatureSystem     (_ecs),
+    _foodSystem         (_ecs),
+    _collisionSystem    (_ecs, _eventSystem),
+    _compactionSystem   (_ecs),
+    _snapshotSystem     (_ecs),
+    _nNewFood           (0.0),
+    _cellSizeTuningTick (0),
+    _indexRebuildTick   (0),
+    _indexRebuildPending(true),
+    _stageTimes         {},
+    _stageAllocations   {}
+{
+}
+
+void Simulation::init(fug::SpriteSheetId spriteSheetId)
+{
+    _ecs.getSingleton<ResourceSingleton>()->init(spriteSheetId);
+    _ecs.getSingleton<MapSingleton>();
+}
+
+void Simulation::setWorldSize(float worldSize)
+{
+    _ecs.getSingleton<ConfigSingleton>()->worldSize = worldSize;
+    _ecs.getSingleton<MapSingleton>()->setWorldSize(worldSize);
+    _ecs.getSingleton<WorldSingleton>()->setWorldSize(worldSize);
+    _indexRebuildPending = true;
+}
+
+void Simulation::setSpatialIndex(WorldSingleton::IndexType indexType)
+{
+    _ecs.getSingleton<WorldSingleton>()->setIndexType(indexType);
+    _indexRebuildPending = true;
+}
+
+void Simulation::populate(uint64_t nCreatures, uint64_t nFood, float spread)
+{
+    auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    auto& map = *_ecs.getSingleton<MapSingleton>();
+
+    if (spread < 0.0f)
+        spread = ConfigSingleton::spawnSpread*config.worldSize;
+
+    // Create creatures
+    for (uint64_t i=0; i<nCreatures; ++i) {
+        // get position using rejection sampling
+        Vec2f p(RNDS*config.worldSize, RNDS*config.worldSize);
+        while (gauss2(p, spread) < RND)
+            p << RNDS*config.worldSize, RNDS*config.worldSize;
+
+        double mass = ConfigSingleton::minCreatureMass + RND*(
+            ConfigSingleton::maxCreatureMass-ConfigSingleton::minCreatureMass);
+
+        createCreature(_ecs, Genome(), mass, 1.0, p, RND*M_PI*2.0f, RND);
+    }
+
+    // Create food
+    map.sampleFertility(_foodPositions, (int)nFood);
+    for (auto& p : _foodPositions) {
+        double mass = RNDRANGE(ConfigSingleton::minFoodMass, ConfigSingleton::maxFoodMass);
+        createFood(_ecs, FoodComponent::Type::PLANT, mass, p);
+    }
+
+    addEntitiesToWorld();
+    processInputs();
+}
+
+void Simulation::setBoundaryCallbacks(
+    std::function<void()> beforeCollisions, std::function<void()> afterCollisions)
+{
+    _beforeCollisions = std::move(beforeCollisions);
+    _afterCollisions = std::move(afterCollisions);
+}
+
+void Simulation::update()
+{
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+    auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    auto& map = *_ecs.getSingleton<MapSingleton>();
+
+    PROFILE_SCOPE("update");
+
+    for (int i=0; i<INPUTS; ++i) {
+        _stageTimes[i] = 0.0;
+        _stageAllocations[i] = AllocationTracker::Counts{0, 0};
+    }
+
+    {   StageTimer timer(_stageTimes[COGNITION], _stageAllocations[COGNITION]);
+        // initiate pixel data transfer from GPU
+        map.prefetch();
+
+        PROFILE_SCOPE("cognition");
+        _creatureSystem.setStage(CreatureSystem::Stage::COGNITION);
+        _ecs.runSystem(_creatureSystem);
+    }
+
+    {   StageTimer timer(_stageTimes[DYNAMICS], _stageAllocations[DYNAMICS]);
+        PROFILE_SCOPE("dynamics");
+        _creatureSystem.setStage(CreatureSystem::Stage::DYNAMICS);
+        _ecs.runSystem(_creatureSystem);
+    }
+
+    {   StageTimer timer(_stageTimes[REPRODUCTION], _stageAllocations[REPRODUCTION]);
+        // map the pixel data memory
+        map.map();
+
+        PROFILE_SCOPE("reproduction");
+        _creatureSystem.setStage(CreatureSystem::Stage::REPRODUCTION);
+        _ecs.runSystem(_creatureSystem);
+    }
+
+    {   StageTimer timer(_stageTimes[FOOD], _stageAllocations[FOOD]);
+        PROFILE_SCOPE("food creation");
+        // Create new food
+        _nNewFood += config.foodPerTick;
+        map.sampleFertility(_foodPositions, (int)_nNewFood);
+        for (auto& p : _foodPositions) {
+            createFood(_ecs, FoodComponent::Type::PLANT, ConfigSingleton::minFoodMass, p);
+        }
+        _nNewFood -= (int)_nNewFood;
+
+        if (world.getNumberOfOwned(WorldSingleton::EntityType::CREATURE) < 1000) {
+            for (int i = 0l; i < 1000; ++i) {   // create a new creatures
+                if (RND > 0.0001) continue;
+
+                Vec2f p(RNDS * config.worldSize, RNDS * config.worldSize);
+                while (gauss2(p, ConfigSingleton::spawnSpread * config.worldSize) < RND)
+                    p << RNDS * config.worldSize, RNDS * config.worldSize;
+
+                double mass = ConfigSingleton::minCreatureMass + RND * (
+                    ConfigSingleton::maxCreatureMass - ConfigSingleton::minCreatureMass);
+
+                createCreature(_ecs, Genome(1.0f, RNDRANGE(0.001f, 0.005f)),
+                    mass, 1.0, p, RND * M_PI * 2.0f, RND);
+            }
+        }
+
+        {   PROFILE_SCOPE("food growth");
+            _foodSystem.setStage(FoodSystem::Stage::GROW);
+            _ecs.runSystem(_foodSystem);
+        }
+
+        // unmap the pixel data memory
+        map.unmap();
+    }
+
+    if (_beforeCollisions) {
+        StageTimer timer(_stageTimes[BOUNDARY], _stageAllocations[BOUNDARY]);
+        PROFILE_SCOPE("boundary exchange");
+        _beforeCollisions();
+    }
+
+    updateSpatialIndex();
+
+    {   StageTimer timer(_stageTimes[COLLISION], _stageAllocations[COLLISION]);
+        {   PROFILE_SCOPE("collisions");
+            _ecs.runSystem(_collisionSystem);
+        }
+
+        PROFILE_SCOPE("event dispatch");
+        while (_eventSystem.swap()) {
+            PROFILE_SCOPE("event round");
+            _ecs.runSystem(_eventSystem);
+            HotPathCounters::add(HotPathCounters::EVENT_ROUNDS);
+        }
+    }
+
+    if (_afterCollisions) {
+        StageTimer timer(_stageTimes[BOUNDARY], _stageAllocations[BOUNDARY]);
+        PROFILE_SCOPE("boundary effects");
+        _afterCollisions();
+    }
+
+    {   // Spatial compaction, swaps entity ids so the index is updated after
+        StageTimer timer(_stageTimes[COMPACTION], _stageAllocations[COMPACTION]);
+        PROFILE_SCOPE("compaction");
+        _compactionSystem.update(world.getTick(), config.compactionInterval, config.compactionSwapsPerTick);
+    }
+
+    updateSpatialIndex();
+
+    {   // Species clustering, a window of creatures is (re)assigned every tick
+        StageTimer timer(_stageTimes[SPECIES], _stageAllocations[SPECIES]);
+        PROFILE_SCOPE("species");
+        auto& species = *_ecs.getSingleton<SpeciesSingleton>();
+        species.beginTick(world.getNumberOfOwned(WorldSingleton::EntityType::CREATURE),
+            config.speciesSamplesPerTick, world.getTick());
+        _creatureSystem.setStage(CreatureSystem::Stage::SPECIES);
+        _ecs.runSystem(_creatureSystem);
+    }
+
+    {   // Population telemetry
+        StageTimer timer(_stageTimes[TELEMETRY], _stageAllocations[TELEMETRY]);
+        PROFILE_SCOPE("telemetry");
+        auto& telemetry = *_ecs.getSingleton<TelemetrySingleton>();
+        auto& species = *_ecs.getSingleton<SpeciesSingleton>();
+        _creatureSystem.setStage(CreatureSystem::Stage::TELEMETRY);
+        _ecs.runSystem(_creatureSystem);
+        const auto& speciesList = species.getSpecies();
+        telemetry.setSpecies(speciesList.size(), speciesList.empty() ? 0 : speciesList.front().size);
+        auto hotPathCounters = HotPathCounters::collect();
+        telemetry.setHotPathCounters(hotPathCounters);
+        PROFILE_COUNTER("contacts", hotPathCounters[HotPathCounters::COLLISION_HITS]);
+        PROFILE_COUNTER("event rounds", hotPathCounters[HotPathCounters::EVENT_ROUNDS]);
+        telemetry.endTick(world.getTick(),
+            world.getNumberOfOwned(WorldSingleton::EntityType::CREATURE),
+            world.getNumberOfOwned(WorldSingleton::EntityType::FOOD));
+    }
+
+    PROFILE_COUNTER("creatures", world.getNumberOfOwned(WorldSingleton::EntityType::CREATURE));
+    PROFILE_COUNTER("food", world.getNumberOfOwned(WorldSingleton::EntityType::FOOD));
+
+    world.advanceTick();
+
+    {   StageTimer timer(_stageTimes[CHECKPOINT], _stageAllocations[CHECKPOINT]);
+        PROFILE_SCOPE("checkpoint");
+        _checkpointer.update(_ecs, _snapshotSystem);
+    }
+
+    // sensed once per tick, the inputs stay valid until the next update
+    processInputs();
+}
+
+void Simulation::processInputs()
+{
+    _stageTimes[INPUTS] = 0.0;
+    _stageAllocations[INPUTS] = AllocationTracker::Counts{0, 0};
+    StageTimer timer(_stageTimes[INPUTS], _stageAllocations[INPUTS]);
+    PROFILE_SCOPE("inputs");
+
+    _creatureSystem.setStage(CreatureSystem::Stage::PROCESS_INPUTS);
+    _ecs.runSystem(_creatureSystem);
+}
+
+void Simulation::diffuseMap()
+{
+    _stageTimes[MAP] = 0.0;
+    _stageAllocations[MAP] = AllocationTracker::Counts{0, 0};
+    StageTimer timer(_stageTimes[MAP], _stageAllocations[MAP]);
+    PROFILE_SCOPE("map diffusion");
+
+    _ecs.getSingleton<MapSingleton>()->diffuseFertility();
+}
+
+void Simulation::addEntitiesToWorld()
+{
+    StageTimer timer(_stageTimes[SPATIAL_INDEX], _stageAllocations[SPATIAL_INDEX]);
+    PROFILE_SCOPE("grid rebuild");
+
+    auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+
+    _indexRebuildTick = world.getTick();
+    _indexRebuildPending = false;
+
+    if (world.getIndexType() == WorldSingleton::IndexType::GRID && config.gridCellSizeTuningInterval > 0 &&
+        world.getTick() - _cellSizeTuningTick >= config.gridCellSizeTuningInterval) {
+        _cellSizeTuningTick = world.getTick();
+        // small changes are not worth releasing all chunks for
+        float cellSize = world.estimateOptimalCellSize();
+        float ratio = cellSize / world.getCellSize();
+        if (ratio < 0.8f || ratio > 1.25f)
+            world.setCellSize(cellSize);
+    }
+
+    world.reset();
+
+    {   PROFILE_SCOPE("creatures to grid");
+        _creatureSystem.setStage(CreatureSystem::Stage::ADD_TO_WORLD);
+        _ecs.runSystem(_creatureSystem);
+    }
+
+    PROFILE_SCOPE("food to grid");
+    _foodSystem.setStage(FoodSystem::Stage::ADD_TO_WORLD);
+    _ecs.runSystem(_foodSystem);
+}
+
+void Simulation::updateSpatialIndex()
+{
+    auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+
+    bool incremental = config.spatialIndexRebuildInterval > 0;
+    if (incremental != world.isIncremental()) {
+        world.setIncremental(incremental);
+        _indexRebuildPending = true;
+    }
+
+    // spawns, moves and despawns have kept the index up to date
+    if (incremental && !_indexRebuildPending &&
+        world.getTick() - _indexRebuildTick < config.spatialIndexRebuildInterval)
+        return;
+
+    addEntitiesToWorld();
+}
+
+void Simulation::captureRenderSnapshot(RenderSnapshot& snapshot)
+{
+    PROFILE_SCOPE("render snapshot");
+
+    snapshot.tick = _ecs.getSingleton<WorldSingleton>()->getTick();
+    _snapshotSystem.setRenderSnapshot(&snapshot);
+    _snapshotSystem.setStage(SnapshotSystem::Stage::RENDER);
+    _ecs.runSystem(_snapshotSystem);
+    _snapshotSystem.setRenderSnapshot(nullptr);
+
+    {   PROFILE_SCOPE("whisker lines");
+        _creatureSystem.setStage(CreatureSystem::Stage::DRAW_LINES);
+        _ecs.runSystem(_creatureSystem);
+    }
+
+    _ecs.getSingleton<LineSingleton>()->moveLines(snapshot.linePositions, snapshot.lineColors);
+}
+
+bool Simulation::saveSnapshot(const std::string& fileName)
+{
+    _snapshot.capture(_ecs, _snapshotSystem);
+    if (!_snapshot.write(fileName))
+        return false;
+
+    printf("Saved snapshot of tick %lu (%lu creatures, %lu food) to %s\n", _snapshot.getTick(),
+        _snapshot.getNumberOfCreatures(), _snapshot.getNumberOfFood(), fileName.c_str());
+    return true;
+}
+
+bool Simulation::loadSnapshot(const std::string& fileName)
+{
+    if (!_snapshot.load(fileName))
+        return false;
+
+    _snapshot.restore(_ecs, _snapshotSystem);
+    setWorldSize(_ecs.getSingleton<ConfigSingleton>()->worldSize);
+    _compactionSystem.reset();
+    addEntitiesToWorld();
+    processInputs();
+
+    printf("Loaded snapshot of tick %lu (%lu creatures, %lu food) from %s\n", _snapshot.getTick(),
+        _snapshot.getNumberOfCreatures(), _snapshot.getNumberOfFood(), fileName.c_str());
+    return true;
+}
+
+bool Simulation::exportGenomes(const std::string& fileName)
+{
+    _genomeBank.clear();
+    _snapshotSystem.setGenomeBank(&_genomeBank);
+    _snapshotSystem.setStage(SnapshotSystem::Stage::COLLECT_GENOMES);
+    _ecs.runSystem(_snapshotSystem);
+    _snapshotSystem.setGenomeBank(nullptr);
+
+    bool success = _genomeBank.write(fileName);
+    _genomeBank.clear();
+    if (success)
+        printf("Exported genomes to %s\n", fileName.c_str());
+
+    return success;
+}
+
+bool Simulation::importGenomes(const std::string& fileName, uint64_t nCreatures)
+{
+    if (!_genomeBank.load(fileName))
+        return false;
+
+    _genomeBank.populate(_ecs, nCreatures);
+    _compactionSystem.reset();
+    addEntitiesToWorld();
+    processInputs();
+
+    printf("Imported %lu creatures from %lu genomes in %s\n", nCreatures, _genomeBank.size(), fileName.c_str());
+    return true;
+}
+
+void Simulation::emigrate(uint64_t nMigrants, Vector<Migrant>& migrants)
+{
+    auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    auto& world = *_ecs.getSingleton<WorldSingleton>();
+    auto& phylogeny = *_ecs.getSingleton<PhylogenySingleton>();
+    auto& species = *_ecs.getSingleton<SpeciesSingleton>();
+
+    _snapshotSystem.setSample(&_migrantIds, nMigrants);
+    _snapshotSystem.setStage(SnapshotSystem::Stage::SAMPLE_CREATURES);
+    _ecs.runSystem(_snapshotSystem);
+    _snapshotSystem.setSample(nullptr, 0);
+
+    migrants.resize(_migrantIds.size());
+    for (size_t i=0; i<_migrantIds.size(); ++i) {
+        auto eId = _migrantIds[i];
+        auto& creatureComponent = *_ecs.getComponent<CreatureComponent>(eId);
+        creatureComponent.genome.copyTo(migrants[i].genes);
+        migrants[i].mass = creatureComponent.mass;
+        migrants[i].energyRatio = creatureComponent.energy /
+            (creatureComponent.mass*config.massEnergyStorageConstant);
+
+        // the lineage ends in this world
+        phylogeny.addDeath(creatureComponent.lineageSlot, world.getTick());
+        species.remove(creatureComponent.species);
+        world.removeEntity(eId);
+        _ecs.removeEntity(eId);
+        HotPathCounters::add(HotPathCounters::ENTITIES_REMOVED);
+    }
+}
+
+void Simulation::immigrate(const Migrant& migrant)
+{
+    float worldSize = _ecs.getSingleton<ConfigSingleton>()->worldSize;
+
+    // get position using rejection sampling
+    Vec2f p(RNDS*worldSize, RNDS*worldSize);
+    while (gauss2(p, ConfigSingleton::spawnSpread*worldSize) < RND)
+        p << RNDS*worldSize, RNDS*worldSize;
+
+    createCreature(_ecs, Genome(migrant.genes), migrant.mass, migrant.energyRatio, p, RND*M_PI*2.0f, RND);
+}
+
+fug::Ecs& Simulation::getEcs()
+{
+    return _ecs;
+}
+
+const Checkpointer& Simulation::getCheckpointer() const
+{
+    return _checkpointer;
+}
+
+const CompactionSystem& Simulation::getCompactionSystem() const
+{
+    return _compactionSystem;
+}
+
+fug::EntityId Simulation::getRelocatedEntity(fug::EntityId eId) const
+{
+    return _compactionSystem.getRelocated(eId);
+}
+
+double Simulation::getStageTime(Simulation::Stage stage) const
+{
+    return _stageTimes[stage];
+}
+
+const AllocationTracker::Counts& Simulation::getStageAllocations(Simulation::Stage stage) const
+{
+    return _stageAllocations[stage];
+}
+
+const char* Simulation::getStageName(Simulation::Stage stage)
+{
+    static const char* names[] = {
+        "cognition", "dynamics", "reproduction", "food", "spatialIndex", "boundary", "collision",
+        "compaction", "species", "telemetry", "checkpoint", "inputs", "map"
+    };
+    return names[stage];
+}
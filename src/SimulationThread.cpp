@@ -0,0 +1,168 @@
+//
+// Project: evolution_simulator_2
+// File: SimulationThread.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <SimulationThread.hpp>
+#include <Profiler.hpp>
+
+#include <glad/glad.h>
+#include <chrono>
+#include <cstdio>
+
+
+SimulationThread::SimulationThread(Simulation& simulation, TripleBuffer<RenderSnapshot>& renderBuffer) :
+    _simulation     (simulation),
+    _renderBuffer   (renderBuffer),
+    _window         (nullptr),
+    _glContext      (nullptr),
+    _tickRate       (0.0),
+    _paused         (false),
+    _quit           (false),
+    _nWaiting       (0),
+    _lockRequested  (false)
+{
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
+
+bool SimulationThread::start(SDL_Window* window, SDL_GLContext glContext, TickCallback onTick)
+{
+    if (_thread.joinable())
+        return true;
+
+    if (glContext == nullptr) {
+        printf("Error: Simulation thread requires an OpenGL context of its own\n");
+        return false;
+    }
+
+    _window = window;
+    _glContext = glContext;
+    _onTick = std::move(onTick);
+    _quit = false;
+    _lockRequested = false;
+    _thread = std::thread(&SimulationThread::run, this);
+    return true;
+}
+
+void SimulationThread::stop()
+{
+    if (!_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _condition.notify_all();
+    _thread.join();
+}
+
+bool SimulationThread::isRunning() const
+{
+    return _thread.joinable();
+}
+
+void SimulationThread::setTickRate(double tickRate)
+{
+    _tickRate = tickRate;
+}
+
+void SimulationThread::setPaused(bool paused)
+{
+    _paused = paused;
+}
+
+double SimulationThread::getTickRate() const
+{
+    return _tickRate;
+}
+
+bool SimulationThread::isPaused() const
+{
+    return _paused;
+}
+
+void SimulationThread::lock()
+{
+    // keeps the thread from starting another tick once the current one is finished
+    ++_nWaiting;
+    _mutex.lock();
+    --_nWaiting;
+}
+
+bool SimulationThread::try_lock()
+{
+    if (_mutex.try_lock()) {
+        _lockRequested = false;
+        return true;
+    }
+
+    // the thread waits after the current tick until the next attempt
+    _lockRequested = true;
+    return false;
+}
+
+void SimulationThread::unlock()
+{
+    _mutex.unlock();
+    _condition.notify_all();
+}
+
+void SimulationThread::run()
+{
+    PROFILE_THREAD("simulation");
+
+    if (SDL_GL_MakeCurrent(_window, _glContext) != 0) {
+        printf("Error: Could not make the simulation OpenGL context current: %s\n", SDL_GetError());
+        return;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto nextTick = Clock::now();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_quit) {
+        // the lock is handed to waiting threads between ticks
+        _condition.wait(lock, [this]() { return _quit || (_nWaiting == 0 && !_lockRequested && !_paused); });
+        if (_quit)
+            break;
+
+        if (_tickRate > 0.0) {
+            auto now = Clock::now();
+            if (now < nextTick) {
+                _condition.wait_until(lock, nextTick);
+                continue;
+            }
+            // late ticks are not caught up with
+            nextTick = std::max(nextTick + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1.0 / _tickRate)), now);
+        }
+
+        tick();
+    }
+
+    glFinish();
+    SDL_GL_MakeCurrent(_window, nullptr);
+}
+
+void SimulationThread::tick()
+{
+    _simulation.update();
+    // the rendering context waits for the diffusion with a fence (MapSingleton)
+    _simulation.diffuseMap();
+
+    auto& snapshot = _renderBuffer.getBack();
+    _simulation.captureRenderSnapshot(snapshot);
+    if (_onTick)
+        _onTick(snapshot);
+    _renderBuffer.publish();
+}
@@ -0,0 +1,136 @@
+//
+// Project: evolution_simulator_2
+// File: SlabPool.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <SlabPool.hpp>
+
+#include <algorithm>
+#include <array>
+
+
+namespace {
+
+    constexpr size_t minSizeClass = SlabPool::alignment;
+    constexpr size_t nSizeClasses = 11; // 64 B ... 64 KiB
+    static_assert(minSizeClass << (nSizeClasses-1) == SlabPool::maxSizeClass);
+
+    // all live pools, for the statistics
+    struct PoolRegistry {
+        std::mutex          mutex;
+        Vector<SlabPool*>   pools;
+    };
+
+    PoolRegistry& poolRegistry()
+    {
+        static PoolRegistry& registry = *new PoolRegistry;
+        return registry;
+    }
+
+} // namespace
+
+
+SlabPool::SlabPool(size_t slotSize) :
+    _slotSize       ((std::max(slotSize, sizeof(FreeSlot)) + alignment-1) / alignment * alignment),
+    _slotsPerSlab   (std::max(slabSize / _slotSize, (size_t)1)),
+    _freeSlots      (nullptr),
+    _nUsedSlots     (0)
+{
+    auto& registry = poolRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.pools.push_back(this);
+}
+
+SlabPool::~SlabPool()
+{
+    {
+        auto& registry = poolRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.pools.erase(std::find(registry.pools.begin(), registry.pools.end(), this));
+    }
+
+    for (auto* slab : _slabs)
+        ::operator delete(slab, std::align_val_t(alignment));
+}
+
+void* SlabPool::allocate()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_freeSlots == nullptr)
+        addSlab();
+
+    FreeSlot* slot = _freeSlots;
+    _freeSlots = slot->next;
+    ++_nUsedSlots;
+
+    return slot;
+}
+
+void SlabPool::deallocate(void* slot)
+{
+    if (slot == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto* freeSlot = static_cast<FreeSlot*>(slot);
+    freeSlot->next = _freeSlots;
+    _freeSlots = freeSlot;
+    --_nUsedSlots;
+}
+
+SlabPool::Statistics SlabPool::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return Statistics{_slotSize, _slabs.size()*_slotsPerSlab, _nUsedSlots};
+}
+
+SlabPool* SlabPool::sizeClass(size_t size)
+{
+    static std::array<SlabPool*, nSizeClasses>& pools = *[]() {
+        auto* pools = new std::array<SlabPool*, nSizeClasses>;
+        for (size_t c=0; c<nSizeClasses; ++c)
+            (*pools)[c] = new SlabPool(minSizeClass << c);
+        return pools;
+    }();
+
+    if (size > maxSizeClass)
+        return nullptr;
+
+    size_t c = 0;
+    while ((minSizeClass << c) < size)
+        ++c;
+
+    return pools[c];
+}
+
+Vector<SlabPool::Statistics> SlabPool::getAllStatistics()
+{
+    auto& registry = poolRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    Vector<Statistics> statistics;
+    for (auto* pool : registry.pools)
+        statistics.push_back(pool->getStatistics());
+
+    return statistics;
+}
+
+void SlabPool::addSlab()
+{
+    auto* slab = static_cast<char*>(::operator new(_slotsPerSlab*_slotSize, std::align_val_t(alignment)));
+    _slabs.push_back(slab);
+
+    // thread the new slots to the free list, lowest address first
+    for (size_t i=_slotsPerSlab; i>0; --i) {
+        auto* slot = reinterpret_cast<FreeSlot*>(slab + (i-1)*_slotSize);
+        slot->next = _freeSlots;
+        _freeSlots = slot;
+    }
+}
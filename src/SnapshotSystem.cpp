@@ -0,0 +1,118 @@
+//
+// Project: evolution_simulator_2
+// File: SnapshotSystem.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <SnapshotSystem.hpp>
+#include <WorldSnapshot.hpp>
+#include <GenomeBank.hpp>
+#include <RenderSnapshot.hpp>
+#include <CreatureComponent.hpp>
+#include <FoodComponent.hpp>
+#include <WorldSingleton.hpp>
+#include <Utils.hpp>
+
+
+SnapshotSystem::SnapshotSystem(fug::Ecs& ecs) :
+    _ecs            (ecs),
+    _stage          (Stage::CAPTURE),
+    _snapshot       (nullptr),
+    _genomeBank     (nullptr),
+    _renderSnapshot (nullptr),
+    _sample         (nullptr),
+    _sampleSize     (0),
+    _nCreaturesSeen (0)
+{
+}
+
+void SnapshotSystem::setStage(SnapshotSystem::Stage stage)
+{
+    _stage = stage;
+}
+
+void SnapshotSystem::setSnapshot(WorldSnapshot* snapshot)
+{
+    _snapshot = snapshot;
+}
+
+void SnapshotSystem::setGenomeBank(GenomeBank* genomeBank)
+{
+    _genomeBank = genomeBank;
+}
+
+void SnapshotSystem::setRenderSnapshot(RenderSnapshot* renderSnapshot)
+{
+    _renderSnapshot = renderSnapshot;
+    if (_renderSnapshot == nullptr)
+        return;
+
+    _renderSnapshot->positions.clear();
+    _renderSnapshot->rotations.clear();
+    _renderSnapshot->scales.clear();
+    _renderSnapshot->colors.clear();
+    _renderSnapshot->types.clear();
+}
+
+void SnapshotSystem::setSample(Vector<fug::EntityId>* sample, size_t sampleSize)
+{
+    _sample = sample;
+    _sampleSize = sampleSize;
+    _nCreaturesSeen = 0;
+    if (_sample != nullptr)
+        _sample->clear();
+}
+
+void SnapshotSystem::operator()(const fug::EntityId& eId,
+    fug::Orientation2DComponent& orientationComponent,
+    fug::SpriteComponent& spriteComponent)
+{
+    switch (_stage) {
+        case Stage::CAPTURE: {
+            auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+            if (cc != nullptr && !cc->ghost) {
+                _snapshot->addCreature(*cc, orientationComponent, spriteComponent);
+                break;
+            }
+            auto* fc = _ecs.getComponent<FoodComponent>(eId);
+            if (fc != nullptr && !fc->ghost)
+                _snapshot->addFood(*fc, orientationComponent);
+        }   break;
+        case Stage::CLEAR:
+            _ecs.getSingleton<WorldSingleton>()->removeEntity(eId);
+            _ecs.removeEntity(eId);
+            break;
+        case Stage::COLLECT_GENOMES: {
+            auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+            if (cc != nullptr && !cc->ghost)
+                _genomeBank->addGenome(cc->genome);
+        }   break;
+        case Stage::SAMPLE_CREATURES: {
+            auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+            if (cc == nullptr || cc->ghost)
+                break;
+            // the n:th creature replaces a random sampled one with probability sampleSize/n
+            ++_nCreaturesSeen;
+            if (_sample->size() < _sampleSize)
+                _sample->push_back(eId);
+            else {
+                auto i = (size_t)(RND*(double)_nCreaturesSeen);
+                if (i < _sampleSize)
+                    (*_sample)[i] = eId;
+            }
+        }   break;
+        case Stage::RENDER: {
+            auto* cc = _ecs.getComponent<CreatureComponent>(eId);
+            _renderSnapshot->positions.push_back(orientationComponent.getPosition());
+            _renderSnapshot->rotations.push_back(cc != nullptr ? cc->direction : 0.0f);
+            _renderSnapshot->scales.push_back(orientationComponent.getScale());
+            _renderSnapshot->colors.push_back(spriteComponent.getColor());
+            _renderSnapshot->types.push_back(cc != nullptr ?
+                RenderSnapshot::Type::CREATURE : RenderSnapshot::Type::FOOD);
+        }   break;
+    }
+}
@@ -0,0 +1,185 @@
+//
+// Project: evolution_simulator_2
+// File: SocketTransport.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <SocketTransport.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+SocketTransport::SocketTransport(uint32_t rank, Vector<int> sockets) :
+    _rank   (rank),
+    _sockets(std::move(sockets)),
+    _peers  (_sockets.size())
+{
+    // progress on all peers is driven by poll
+    for (uint32_t r=0; r<_sockets.size(); ++r) {
+        if (r != _rank && _sockets[r] >= 0)
+            fcntl(_sockets[r], F_SETFL, fcntl(_sockets[r], F_GETFL) | O_NONBLOCK);
+    }
+}
+
+SocketTransport::~SocketTransport()
+{
+    for (uint32_t r=0; r<_sockets.size(); ++r) {
+        if (r != _rank && _sockets[r] >= 0)
+            close(_sockets[r]);
+    }
+}
+
+bool SocketTransport::connectLocal(uint32_t nRanks, Vector<Vector<int>>& sockets)
+{
+    sockets.assign(nRanks, Vector<int>(nRanks, -1));
+    for (uint32_t i=0; i<nRanks; ++i) {
+        for (uint32_t j=i+1; j<nRanks; ++j) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+                printf("Error: Could not create a socket pair\n");
+                closeOthers(nRanks, sockets); // no rank nRanks, so everything is closed
+                return false;
+            }
+            sockets[i][j] = pair[0];
+            sockets[j][i] = pair[1];
+        }
+    }
+    return true;
+}
+
+void SocketTransport::closeOthers(uint32_t rank, Vector<Vector<int>>& sockets)
+{
+    for (uint32_t i=0; i<sockets.size(); ++i) {
+        if (i == rank)
+            continue;
+        for (auto& s : sockets[i]) {
+            if (s >= 0)
+                close(s);
+            s = -1;
+        }
+    }
+}
+
+uint32_t SocketTransport::getRank() const
+{
+    return _rank;
+}
+
+uint32_t SocketTransport::getNumberOfRanks() const
+{
+    return (uint32_t)_sockets.size();
+}
+
+bool SocketTransport::exchange(const Vector<Vector<char>>& outgoing, Vector<Vector<char>>& incoming)
+{
+    uint32_t nRanks = (uint32_t)_sockets.size();
+    if (outgoing.size() != nRanks) {
+        printf("Error: Expected %u outgoing messages, got %lu\n", nRanks, outgoing.size());
+        return false;
+    }
+
+    incoming.resize(nRanks);
+    for (uint32_t r=0; r<nRanks; ++r) {
+        if (outgoing[r].size() > maxMessageSize) {
+            printf("Error: Message of %lu bytes to rank %u exceeds the maximum size\n", outgoing[r].size(), r);
+            return false;
+        }
+        _peers[r] = Peer{outgoing[r].size(), 0, 0, 0};
+        incoming[r].clear();
+    }
+
+    constexpr uint64_t prefixSize = sizeof(uint64_t);
+    auto sendDone = [&](const Peer& peer) { return peer.nSent == prefixSize + peer.sendLength; };
+    auto recvDone = [&](const Peer& peer) {
+        return peer.nReceived >= prefixSize && peer.nReceived == prefixSize + peer.recvLength;
+    };
+
+    Vector<pollfd> fds;
+    Vector<uint32_t> fdRanks;
+    for (;;) {
+        fds.clear();
+        fdRanks.clear();
+        for (uint32_t r=0; r<nRanks; ++r) {
+            if (r == _rank)
+                continue;
+            short events = (sendDone(_peers[r]) ? 0 : POLLOUT) | (recvDone(_peers[r]) ? 0 : POLLIN);
+            if (events != 0) {
+                fds.push_back(pollfd{_sockets[r], events, 0});
+                fdRanks.push_back(r);
+            }
+        }
+        if (fds.empty())
+            return true;
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("Error: Polling the peer sockets failed\n");
+            return false;
+        }
+
+        for (size_t i=0; i<fds.size(); ++i) {
+            uint32_t r = fdRanks[i];
+            auto& peer = _peers[r];
+            if (fds[i].revents & POLLNVAL) {
+                printf("Error: Socket of rank %u is not open\n", r);
+                return false;
+            }
+
+            if ((fds[i].revents & (POLLOUT | POLLERR)) && !sendDone(peer)) {
+                const char* data = peer.nSent < prefixSize ?
+                    reinterpret_cast<const char*>(&peer.sendLength) + peer.nSent :
+                    outgoing[r].data() + (peer.nSent - prefixSize);
+                uint64_t length = peer.nSent < prefixSize ?
+                    prefixSize - peer.nSent : prefixSize + peer.sendLength - peer.nSent;
+                ssize_t n = send(_sockets[r], data, length, MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    printf("Error: Sending to rank %u failed\n", r);
+                    return false;
+                }
+                peer.nSent += n > 0 ? (uint64_t)n : 0;
+            }
+
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !recvDone(peer)) {
+                char* data;
+                uint64_t length;
+                if (peer.nReceived < prefixSize) {
+                    data = reinterpret_cast<char*>(&peer.recvLength) + peer.nReceived;
+                    length = prefixSize - peer.nReceived;
+                }
+                else {
+                    data = incoming[r].data() + (peer.nReceived - prefixSize);
+                    length = prefixSize + peer.recvLength - peer.nReceived;
+                }
+                ssize_t n = recv(_sockets[r], data, length, 0);
+                if (n == 0) {
+                    printf("Error: Rank %u has disconnected\n", r);
+                    return false;
+                }
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    printf("Error: Receiving from rank %u failed\n", r);
+                    return false;
+                }
+                if (n > 0) {
+                    peer.nReceived += (uint64_t)n;
+                    if (peer.nReceived == prefixSize) {
+                        if (peer.recvLength > maxMessageSize) {
+                            printf("Error: Rank %u sent an invalid message length %lu\n", r, peer.recvLength);
+                            return false;
+                        }
+                        incoming[r].resize(peer.recvLength);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,169 @@
+//
+// Project: evolution_simulator_2
+// File: SpeciesSingleton.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <SpeciesSingleton.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+SpeciesSingleton::SpeciesSingleton() :
+    _projection     (sketchSize, Genome::genomeSize),
+    _centroids      (Centroids::Zero()),
+    _penalty        (SpeciesDistances::Constant(std::numeric_limits<float>::infinity())),
+    _slots          {},
+    _weights        {},
+    _nextLabel      (0),
+    _nAssigned      (0),
+    _tick           (0),
+    _nCreatures     (0),
+    _cursor         (0),
+    _windowSize     (0),
+    _visitIndex     (0),
+    _speciesDirty   (true)
+{
+    // Sparse sign projection with a fixed seed, so that sketches do not consume
+    // the simulation random numbers and are comparable between runs
+    std::mt19937 engine(0x5bec1e5);
+    std::uniform_int_distribution<int> distribution(0, 5);
+    const float scale = std::sqrt(3.0f / (float)(sketchSize*Genome::genomeSize));
+    for (int j=0; j<(int)Genome::genomeSize; ++j) {
+        for (int i=0; i<sketchSize; ++i) {
+            int r = distribution(engine);
+            _projection(i, j) = r == 0 ? scale : (r == 1 ? -scale : 0.0f);
+        }
+    }
+}
+
+void SpeciesSingleton::beginTick(uint64_t nCreatures, uint64_t budget, uint64_t tick)
+{
+    _tick = tick;
+    _cursor = nCreatures > 0 ? (_cursor + _windowSize) % nCreatures : 0;
+    _nCreatures = nCreatures;
+    _windowSize = std::min(budget, nCreatures);
+    _visitIndex = 0;
+}
+
+bool SpeciesSingleton::isSampled()
+{
+    if (_nCreatures == 0)
+        return false;
+
+    uint64_t i = _visitIndex++ % _nCreatures;
+    return (i + _nCreatures - _cursor) % _nCreatures < _windowSize;
+}
+
+void SpeciesSingleton::sample(const Genome& genome, Membership& membership, float distanceThreshold)
+{
+    if (!membership.sketched) {
+        genome.copyTo(_genes.data());
+        membership.sketch.noalias() = _projection *
+            Eigen::Map<const Eigen::VectorXf>(_genes.data(), Genome::genomeSize);
+        membership.sketched = true;
+    }
+
+    // squared distances to all centroids at once, free slots are at infinity
+    SpeciesDistances distances = (_centroids.colwise() - membership.sketch).colwise().squaredNorm() + _penalty;
+    int nearest;
+    float distance2 = distances.minCoeff(&nearest);
+
+    uint32_t slot = nearest;
+    if (distance2 > distanceThreshold*distanceThreshold) {
+        uint32_t newSlot = found(membership.sketch);
+        if (newSlot != noSpecies) { // in case all slots are taken the nearest species is used
+            slot = newSlot;
+            distance2 = 0.0f;
+        }
+    }
+
+    if (membership.slot != slot) {
+        remove(membership);
+        membership.slot = slot;
+        ++_slots[slot].size;
+        ++_nAssigned;
+    }
+
+    // online k-means update
+    auto& species = _slots[slot];
+    float rate = 1.0f / (float)(_weights[slot] = std::min(_weights[slot]+1, maxCentroidWeight));
+    _centroids.col(slot) += rate*(membership.sketch - _centroids.col(slot));
+    species.spread += rate*(std::sqrt(distance2) - species.spread);
+    species.color += rate*(Vec3f(genome[Genome::COLOR_R], genome[Genome::COLOR_G], genome[Genome::COLOR_B]) -
+        species.color);
+
+    _speciesDirty = true;
+}
+
+void SpeciesSingleton::remove(Membership& membership)
+{
+    if (membership.slot == noSpecies)
+        return;
+
+    auto& species = _slots[membership.slot];
+    --_nAssigned;
+    if (--species.size == 0) // species died out, free the slot
+        _penalty(membership.slot) = std::numeric_limits<float>::infinity();
+
+    membership.slot = noSpecies;
+    _speciesDirty = true;
+}
+
+void SpeciesSingleton::reset()
+{
+    _penalty.setConstant(std::numeric_limits<float>::infinity());
+    for (auto& species : _slots)
+        species.size = 0;
+    _nAssigned = 0;
+    _cursor = 0;
+    _windowSize = 0;
+    _speciesDirty = true;
+}
+
+const Vector<SpeciesSingleton::Species>& SpeciesSingleton::getSpecies() const
+{
+    if (_speciesDirty) {
+        _species.clear();
+        for (int i=0; i<maxSpecies; ++i) {
+            if (_slots[i].size > 0)
+                _species.push_back(_slots[i]);
+        }
+        std::sort(_species.begin(), _species.end(), [](const Species& a, const Species& b) {
+            return a.size > b.size;
+        });
+        _speciesDirty = false;
+    }
+
+    return _species;
+}
+
+uint64_t SpeciesSingleton::getNumberOfAssigned() const
+{
+    return _nAssigned;
+}
+
+uint32_t SpeciesSingleton::found(const Sketch& sketch)
+{
+    for (int i=0; i<maxSpecies; ++i) {
+        if (std::isinf(_penalty(i))) {
+            _centroids.col(i) = sketch;
+            _penalty(i) = 0.0f;
+            _weights[i] = 0;
+            _slots[i].label = _nextLabel++;
+            _slots[i].size = 0;
+            _slots[i].foundedTick = _tick;
+            _slots[i].spread = 0.0f;
+            _slots[i].color.setZero();
+            return i;
+        }
+    }
+
+    return noSpecies;
+}
@@ -0,0 +1,397 @@
+//
+// Project: evolution_simulator_2
+// File: TelemetrySingleton.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <TelemetrySingleton.hpp>
+#include <ConfigSingleton.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+
+namespace {
+
+    // below this many creatures the reduction is not worth distributing to threads
+    constexpr size_t    parallelReductionThreshold = 16384;
+    constexpr unsigned  maxReductionThreads = 8;
+
+    inline int histogramBin(int quantity, double value)
+    {
+        double v = 0.0;
+        switch (quantity) {
+            case TelemetrySingleton::MASS:
+                v = value / ConfigSingleton::maxCreatureMass * TelemetrySingleton::nHistogramBins;
+                break;
+            case TelemetrySingleton::AGE:
+                v = std::log2(value + 1.0);
+                break;
+            case TelemetrySingleton::SPEED:
+                v = value / ConfigSingleton::maxObjectRadius * TelemetrySingleton::nHistogramBins;
+                break;
+            default: // quantities in 0-1 range
+                v = value * TelemetrySingleton::nHistogramBins;
+                break;
+        }
+        return std::clamp((int)v, 0, TelemetrySingleton::nHistogramBins-1);
+    }
+
+    const Vector<std::string>& columnNames()
+    {
+        static const Vector<std::string> names = [](){
+            Vector<std::string> names = {
+                "tick", "creatures", "food", "births", "deaths", "kills",
+                "creatureBiomass", "foodBiomass", "totalBiomass", "species", "largestSpecies"
+            };
+            for (int c=0; c<HotPathCounters::N_COUNTERS; ++c)
+                names.push_back(HotPathCounters::getName((HotPathCounters::Counter)c));
+            const char* quantityNames[] = { "mass", "energy", "age", "speed", "metabolicConstant" };
+            for (auto& quantityName : quantityNames) {
+                names.push_back(std::string("mean_") + quantityName);
+                for (int i=0; i<TelemetrySingleton::nHistogramBins; ++i)
+                    names.push_back(std::string("hist_") + quantityName + "_" + std::to_string(i));
+            }
+            return names;
+        }();
+        return names;
+    }
+
+} // namespace
+
+
+TelemetrySingleton::Accumulator::Accumulator() :
+    n           (0),
+    sum         {},
+    histogram   {}
+{
+}
+
+void TelemetrySingleton::Accumulator::add(const double (&values)[N_QUANTITIES])
+{
+    ++n;
+    for (int q=0; q<N_QUANTITIES; ++q) {
+        sum[q] += values[q];
+        ++histogram[q][histogramBin(q, values[q])];
+    }
+}
+
+void TelemetrySingleton::Accumulator::merge(const TelemetrySingleton::Accumulator& other)
+{
+    n += other.n;
+    for (int q=0; q<N_QUANTITIES; ++q) {
+        sum[q] += other.sum[q];
+        for (int i=0; i<nHistogramBins; ++i)
+            histogram[q][i] += other.histogram[q][i];
+    }
+}
+
+TelemetrySingleton::TelemetrySingleton() :
+    _births         (0),
+    _deaths         (0),
+    _kills          (0),
+    _foodBiomass    (0.0),
+    _nSpecies       (0),
+    _largestSpecies (0),
+    _hotPathCounters{},
+    _lastRow        {},
+    _file           (nullptr),
+    _reductionRound     (0),
+    _nReductionsPending (0),
+    _reductionSize      (0),
+    _reductionStopped   (false),
+    _chunk          (nColumns*chunkTicks, 0.0),
+    _chunkSize      (0)
+{
+}
+
+TelemetrySingleton::~TelemetrySingleton()
+{
+    close();
+
+    {
+        std::lock_guard<std::mutex> lock(_reductionMutex);
+        _reductionStopped = true;
+    }
+    _reductionStarted.notify_all();
+    for (auto& thread : _reductionThreads)
+        thread.join();
+}
+
+bool TelemetrySingleton::open(const std::string& fileName)
+{
+    close();
+
+    const auto& names = columnNames();
+
+    // continue an existing stream in case the columns match
+    _file = fopen(fileName.c_str(), "r+b");
+    if (_file != nullptr) {
+        char fileMagic[8];
+        uint32_t fileVersion = 0, fileColumns = 0, fileChunkTicks = 0;
+        bool valid =
+            fread(fileMagic, 1, sizeof(fileMagic), _file) == sizeof(fileMagic) &&
+            fread(&fileVersion, sizeof(uint32_t), 1, _file) == 1 &&
+            fread(&fileColumns, sizeof(uint32_t), 1, _file) == 1 &&
+            fread(&fileChunkTicks, sizeof(uint32_t), 1, _file) == 1 &&
+            memcmp(fileMagic, magic, sizeof(magic)) == 0 &&
+            fileVersion == version && fileColumns == nColumns;
+
+        if (!valid) {
+            printf("Error: %s is not a compatible telemetry file\n", fileName.c_str());
+            fclose(_file);
+            _file = nullptr;
+            return false;
+        }
+
+        fseek(_file, 0, SEEK_END);
+    }
+    else {
+        _file = fopen(fileName.c_str(), "wb");
+        if (_file == nullptr) {
+            printf("Error: Could not open %s for writing\n", fileName.c_str());
+            return false;
+        }
+
+        uint32_t header[3] = { version, (uint32_t)nColumns, chunkTicks };
+        fwrite(magic, 1, sizeof(magic), _file);
+        fwrite(header, sizeof(uint32_t), 3, _file);
+        for (auto& name : names)
+            fwrite(name.c_str(), 1, name.size()+1, _file);
+        fflush(_file);
+    }
+
+    _writer = std::make_unique<WorkerThread>(2, "telemetry writer");
+    _chunkSize = 0;
+
+    return true;
+}
+
+void TelemetrySingleton::close()
+{
+    if (_file == nullptr)
+        return;
+
+    if (_chunkSize > 0)
+        flushChunk();
+
+    _writer.reset(); // finishes the pending writes
+    fclose(_file);
+    _file = nullptr;
+}
+
+bool TelemetrySingleton::isOpen() const
+{
+    return _file != nullptr;
+}
+
+void TelemetrySingleton::countBirth()
+{
+    ++_births;
+}
+
+void TelemetrySingleton::countDeath()
+{
+    ++_deaths;
+}
+
+void TelemetrySingleton::countKill()
+{
+    ++_kills;
+}
+
+void TelemetrySingleton::addCreature(
+    double mass, double energyRatio, double age, float speed, float metabolicConstant)
+{
+    _samples[MASS].push_back(mass);
+    _samples[ENERGY].push_back(energyRatio);
+    _samples[AGE].push_back(age);
+    _samples[SPEED].push_back(std::abs(speed));
+    _samples[METABOLIC_CONSTANT].push_back(metabolicConstant);
+}
+
+void TelemetrySingleton::addFood(double mass)
+{
+    _foodBiomass += mass;
+}
+
+void TelemetrySingleton::setSpecies(uint64_t nSpecies, uint64_t largestSpeciesSize)
+{
+    _nSpecies = nSpecies;
+    _largestSpecies = largestSpeciesSize;
+}
+
+void TelemetrySingleton::setHotPathCounters(const HotPathCounters::Values& values)
+{
+    _hotPathCounters = values;
+}
+
+void TelemetrySingleton::endTick(uint64_t tick, uint64_t nCreatures, uint64_t nFood)
+{
+    Accumulator accumulator = reduce();
+
+    double* row = _lastRow;
+    row[TICK] = (double)tick;
+    row[N_CREATURES] = (double)nCreatures;
+    row[N_FOOD] = (double)nFood;
+    row[BIRTHS] = (double)_births;
+    row[DEATHS] = (double)_deaths;
+    row[KILLS] = (double)_kills;
+    row[CREATURE_BIOMASS] = accumulator.sum[MASS];
+    row[FOOD_BIOMASS] = _foodBiomass;
+    row[TOTAL_BIOMASS] = accumulator.sum[MASS] + _foodBiomass;
+    row[N_SPECIES] = (double)_nSpecies;
+    row[LARGEST_SPECIES] = (double)_largestSpecies;
+    for (int c=0; c<HotPathCounters::N_COUNTERS; ++c)
+        row[hotPathColumn((HotPathCounters::Counter)c)] = (double)_hotPathCounters[c];
+    for (int q=0; q<N_QUANTITIES; ++q) {
+        row[meanColumn((Quantity)q)] = accumulator.n > 0 ? accumulator.sum[q] / (double)accumulator.n : 0.0;
+        for (int i=0; i<nHistogramBins; ++i)
+            row[histogramColumn((Quantity)q, i)] = (double)accumulator.histogram[q][i];
+    }
+
+    // reset the per-tick state
+    for (auto& samples : _samples)
+        samples.clear();
+    _births = 0;
+    _deaths = 0;
+    _kills = 0;
+    _foodBiomass = 0.0;
+
+    if (_file == nullptr)
+        return;
+
+    for (int c=0; c<nColumns; ++c)
+        _chunk[c*chunkTicks + _chunkSize] = row[c];
+
+    if (++_chunkSize == chunkTicks)
+        flushChunk();
+}
+
+double TelemetrySingleton::getLastValue(int column) const
+{
+    return _lastRow[column];
+}
+
+const char* TelemetrySingleton::getColumnName(int column)
+{
+    return columnNames()[column].c_str();
+}
+
+int TelemetrySingleton::meanColumn(TelemetrySingleton::Quantity quantity)
+{
+    return N_SCALAR_COLUMNS + quantity*(1+nHistogramBins);
+}
+
+int TelemetrySingleton::histogramColumn(TelemetrySingleton::Quantity quantity, int bin)
+{
+    return meanColumn(quantity) + 1 + bin;
+}
+
+int TelemetrySingleton::hotPathColumn(HotPathCounters::Counter counter)
+{
+    return HOT_PATH_COUNTERS + (int)counter;
+}
+
+TelemetrySingleton::Accumulator TelemetrySingleton::reduce()
+{
+    size_t n = _samples[0].size();
+    unsigned nThreads = 1;
+    if (n >= parallelReductionThreshold)
+        nThreads = std::clamp(std::thread::hardware_concurrency(), 1u, maxReductionThreads);
+
+    _partials.assign(nThreads, Accumulator());
+    if (nThreads == 1) {
+        reduceRange(0, 1, n);
+        return _partials[0];
+    }
+
+    // threads are created once and reused, a steady-state reduction does not allocate
+    if (_reductionThreads.empty()) {
+        _reductionThreads.reserve(nThreads-1);
+        for (unsigned t=1; t<nThreads; ++t)
+            _reductionThreads.emplace_back(&TelemetrySingleton::reductionLoop, this, t, nThreads);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_reductionMutex);
+        _reductionSize = n;
+        _nReductionsPending = nThreads-1;
+        ++_reductionRound;
+    }
+    _reductionStarted.notify_all();
+
+    reduceRange(0, nThreads, n);
+
+    {
+        std::unique_lock<std::mutex> lock(_reductionMutex);
+        _reductionFinished.wait(lock, [&](){ return _nReductionsPending == 0; });
+    }
+
+    for (unsigned t=1; t<nThreads; ++t)
+        _partials[0].merge(_partials[t]);
+
+    return _partials[0];
+}
+
+void TelemetrySingleton::reduceRange(unsigned threadId, unsigned nThreads, size_t n)
+{
+    size_t begin = n*threadId/nThreads;
+    size_t end = n*(threadId+1)/nThreads;
+    auto& partial = _partials[threadId];
+    double values[N_QUANTITIES];
+    for (size_t i=begin; i<end; ++i) {
+        for (int q=0; q<N_QUANTITIES; ++q)
+            values[q] = _samples[q][i];
+        partial.add(values);
+    }
+}
+
+void TelemetrySingleton::reductionLoop(unsigned threadId, unsigned nThreads)
+{
+    uint64_t round = 0;
+    for (;;) {
+        size_t n;
+        {
+            std::unique_lock<std::mutex> lock(_reductionMutex);
+            _reductionStarted.wait(lock, [&](){ return _reductionStopped || _reductionRound != round; });
+            if (_reductionStopped)
+                return;
+            round = _reductionRound;
+            n = _reductionSize;
+        }
+
+        reduceRange(threadId, nThreads, n);
+
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(_reductionMutex);
+            finished = --_nReductionsPending == 0;
+        }
+        if (finished)
+            _reductionFinished.notify_one();
+    }
+}
+
+void TelemetrySingleton::flushChunk()
+{
+    // compact the columns in case the chunk is partial
+    Vector<double> chunk(nColumns*_chunkSize);
+    for (int c=0; c<nColumns; ++c)
+        std::copy_n(&_chunk[c*chunkTicks], _chunkSize, &chunk[c*_chunkSize]);
+
+    uint32_t chunkHeader[2] = { chunkMagic, _chunkSize };
+    _chunkSize = 0;
+
+    _writer->push([file = _file, chunkHeader, chunk = std::move(chunk)]() {
+        fwrite(chunkHeader, sizeof(uint32_t), 2, file);
+        fwrite(chunk.data(), sizeof(double), chunk.size(), file);
+        fflush(file);
+    });
+}
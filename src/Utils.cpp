@@ -12,6 +12,9 @@
 #include "ResourceSingleton.hpp"
 #include "CreatureComponent.hpp"
 #include "EventHandlers.hpp"
+#include "PhylogenySingleton.hpp"
+#include "WorldSingleton.hpp"
+#include "HotPathCounters.hpp"
 
 #include <graphics/Orientation2DComponent.hpp>
 #include <engine/EventComponent.hpp>
@@ -20,6 +23,7 @@
 fug::EntityId createFood(fug::Ecs& ecs, FoodComponent::Type type, double mass, const Vec2f& position)
 {
     fug::EntityId id = ecs.getEmptyEntityId();
+    HotPathCounters::add(HotPathCounters::ENTITIES_CREATED);
 
     ecs.setComponent(id, FoodComponent(type, mass));
     ecs.setComponent(id, fug::Orientation2DComponent(position, 0.0f,
@@ -35,6 +39,7 @@ fug::EntityId createFood(fug::Ecs& ecs, FoodComponent::Type type, double mass, c
             break;
     }
     ecs.setComponent(id, std::move(spriteComponent));
+    ecs.getSingleton<WorldSingleton>()->updateEntity(id, position, WorldSingleton::EntityType::FOOD);
 
     return id;
 }
@@ -45,6 +50,7 @@ fug::EntityId createCreature(fug::Ecs& ecs, Genome&& genome, double mass, double
     static auto& config = *ecs.getSingleton<ConfigSingleton>();
 
     fug::EntityId id = ecs.getEmptyEntityId();
+    HotPathCounters::add(HotPathCounters::ENTITIES_CREATED);
 
     ecs.setComponent(id, fug::Orientation2DComponent(position, direction,
         sqrtf((float)mass) / ConfigSingleton::spriteRadius));
@@ -55,8 +61,12 @@ fug::EntityId createCreature(fug::Ecs& ecs, Genome&& genome, double mass, double
     ecs.setComponent(id, std::move(spriteComponent));
     ecs.addComponent<fug::EventComponent>(id)->addHandler<EventHandler_Creature_CollisionEvent>();
 
-    ecs.setComponent(id, CreatureComponent(std::move(genome),
-        energyRatio*mass*config.massEnergyStorageConstant, mass, direction, speed));
+    CreatureComponent creatureComponent(std::move(genome),
+        energyRatio*mass*config.massEnergyStorageConstant, mass, direction, speed);
+    creatureComponent.lineageSlot = ecs.getSingleton<PhylogenySingleton>()->addBirth(
+        PhylogenySingleton::invalidSlot, ecs.getSingleton<WorldSingleton>()->getTick());
+    ecs.setComponent(id, std::move(creatureComponent));
+    ecs.getSingleton<WorldSingleton>()->updateEntity(id, position, WorldSingleton::EntityType::CREATURE);
 
     return id;
 }
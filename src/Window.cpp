@@ -19,7 +19,15 @@
 #include <ResourceSingleton.hpp>
 #include <MapSingleton.hpp>
 #include <EventHandlers.hpp>
+#include <TelemetrySingleton.hpp>
+#include <PhylogenySingleton.hpp>
+#include <SpeciesSingleton.hpp>
+#include <HotPathCounters.hpp>
+#include <AllocationTracker.hpp>
+#include <SlabPool.hpp>
+#include <Profiler.hpp>
 #include <imgui.h>
+#include <cstring>
 #include <backends/imgui_impl_sdl.h>
 #include <backends/imgui_impl_opengl3.h>
 
@@ -28,30 +36,54 @@
 #include <graphics/SpriteSingleton.hpp>
 
 
+namespace {
+
+    // share of the frame time fast-forward may spend on ticks, the rest is left for rendering
+    constexpr double fastForwardFrameShare = 0.75;
+
+} // namespace
+
+
 Window::Window(
     const Window::Settings &settings
 ) :
     _settings               (settings),
     _window                 (nullptr),
+    _simulationGlCtx        (nullptr),
     _quit                   (false),
     _paused                 (false),
+    _threaded               (false),
+    _tickRate               (0.0),
+    _fastForward            (false),
+    _speedMultiplier        (10),
+    _frameTicks             (0),
+    _renderPending          (true),
     _viewport               (_settings.window.width, _settings.window.height,
                              Vec2f(_settings.window.width*0.5f, _settings.window.height*0.5f), 32.0f),
     _cursorPosition         (0.0f, 0.0f),
     _activeCreature         (-1),
+    _activeCreatureLineageId(0),
     _activeCreatureFollow   (false),
-    _lastTicks              (0),
-    _frameTicks             (0),
+    _configEdited           (false),
+    _lockRequested          (false),
+    _lastCounter            (0),
+    _frameTime              (0.0),
+    _tickRateCounter        (0),
+    _tickRateTick           (0),
+    _ticksPerSecond         (0.0),
     _windowContext          (*this),
-    _eventSystem            (_ecs),
-    _creatureSystem         (_ecs),
-    _foodSystem             (_ecs),
-    _collisionSystem        (_ecs, _eventSystem),
-    _spriteSystem           (_ecs),
+    _ecs                    (_simulation.getEcs()),
+    _simulationThread       (_simulation, _renderBuffer),
     _spriteSheetId          (-1)
 {
     int err;
 
+    strncpy(_snapshotFileName, "world.snapshot", sizeof(_snapshotFileName));
+    strncpy(_telemetryFileName, "telemetry.bin", sizeof(_telemetryFileName));
+    strncpy(_genomeBankFileName, "genomes.bank", sizeof(_genomeBankFileName));
+    strncpy(_phylogenyFileName, "lineage.phylo", sizeof(_phylogenyFileName));
+    strncpy(_traceFileName, "trace.json", sizeof(_traceFileName));
+
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("Error: Could not initialize SDL!\n");
@@ -87,6 +119,14 @@ Window::Window(
         return;
     }
 
+    // Second context for stepping the simulation on its own thread
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    _simulationGlCtx = SDL_GL_CreateContext(_window);
+    if (_simulationGlCtx == nullptr)
+        printf("Warning: Shared OpenGL context could not be created, simulation thread disabled: %s\n",
+               SDL_GetError());
+    SDL_GL_MakeCurrent(_window, _glCtx);
+
     // Load OpenGL extensions
     if (!gladLoadGL()) {
         printf("Error: gladLoadGL failed\n");
@@ -113,7 +153,11 @@ Window::Window(
 
 Window::~Window()
 {
+    _simulationThread.stop();
+
     // Destroy window and quit SDL subsystems
+    if (_simulationGlCtx != nullptr)
+        SDL_GL_DeleteContext(_simulationGlCtx);
     SDL_GL_DeleteContext(_glCtx);
     SDL_DestroyWindow(_window);
     SDL_Quit();
@@ -127,96 +171,237 @@ void Window::init(void)
     _spriteSheetId = _ecs.getSingleton<fug::SpriteSingleton>()->addSpriteSheetFromFile(
         EVOLUTION_SIMULATOR_RES("sprites/sprites.png"), 128, 128);
 
-    _ecs.getSingleton<LineSingleton>()->init();
-    _ecs.getSingleton<LineSingleton>()->setWindowSize(
-        (int)_settings.window.width, (int)_settings.window.height);
+    _worldRenderer.init((int)_settings.window.width, (int)_settings.window.height);
 
-    _ecs.getSingleton<ResourceSingleton>()->init(_spriteSheetId);
-    _ecs.getSingleton<MapSingleton>();
+    _simulation.init(_spriteSheetId);
+    _simulation.setWorldSize(_settings.worldSize);
+    _simulation.setSpatialIndex(_settings.spatialIndex);
+    _simulation.populate(2000, 5000);
+}
 
-    fug::SpriteComponent creatureSpriteComponent(_spriteSheetId, 0);
-    creatureSpriteComponent.setOrigin(Vec2f(ConfigSingleton::spriteRadius, ConfigSingleton::spriteRadius));
-    fug::SpriteComponent foodSpriteComponent(_spriteSheetId, 1);
-    foodSpriteComponent.setOrigin(Vec2f(ConfigSingleton::spriteRadius, ConfigSingleton::spriteRadius));
-    foodSpriteComponent.setColor(Vec3f(0.2f, 0.6f, 0.0f));
+void Window::loop(void)
+{
+    static auto& map = *_ecs.getSingleton<MapSingleton>();
 
-    auto& config = *_ecs.getSingleton<ConfigSingleton>();
-    auto& map = *_ecs.getSingleton<MapSingleton>();
+    PROFILE_THREAD("main");
 
-    // Create creatures
-    constexpr int nCreatures = 2000;
-    for (int i=0; i<nCreatures; ++i) {
-        // get position using rejection sampling
-        Vec2f p(RNDS*1024.0f, RNDS*1024.0f);
-        while (gauss2(p, 256.0f) < RND)
-            p << RNDS*1024.0f, RNDS*1024.0f;
+    // Application main loop
+    while (!_quit) {
+        {   PROFILE_SCOPE("frame");
 
-        double mass = ConfigSingleton::minCreatureMass + RND*(
-            ConfigSingleton::maxCreatureMass-ConfigSingleton::minCreatureMass);
+            {   PROFILE_SCOPE("event handling");
+                SDL_Event event;
+                while (SDL_PollEvent(&event) != 0) {
+                    handleEvent(event);
+                }
+            }
 
-        createCreature(_ecs, Genome(), mass, 1.0, p, RND*M_PI*2.0f, RND);
-    }
+            {   // The simulation thread is only locked when there's something to apply, without waiting
+                // for its tick. After a failed attempt it waits for the next frame once the tick is done.
+                _frameTicks = 0;
+                std::unique_lock<SimulationThread> lock(_simulationThread, std::defer_lock);
+                if (!_threaded || _lockRequested || !_worldActions.empty() || _configEdited ||
+                    _paused != _simulationThread.isPaused() || _tickRate != _simulationThread.getTickRate())
+                    _lockRequested = !lock.try_lock(); // retried until the thread is released
 
-    // Create food
-    constexpr int nFoods = 5000;
-    auto foodPositions = map.sampleFertility(nFoods);
-    for (auto& p : foodPositions) {
-        double mass = RNDRANGE(ConfigSingleton::minFoodMass, ConfigSingleton::maxFoodMass);
-        createFood(_ecs, FoodComponent::Type::PLANT, mass, p);
-    }
-}
+                if (lock.owns_lock())
+                    updateWorld();
+            }
+            setThreaded(_threaded);
 
-void Window::loop(void)
-{
-    auto& map = *_ecs.getSingleton<MapSingleton>();
+            if (_renderBuffer.update())
+                _worldRenderer.setSnapshot(_renderBuffer.getFront());
 
-    // Application main loop
-    while (!_quit) {
-        // Event handling
-        SDL_Event event;
-        while (SDL_PollEvent(&event) != 0) {
-            handleEvent(event);
-        }
+            {   PROFILE_SCOPE("gui");
+                updateGUI();
+            }
+
+            {   PROFILE_SCOPE("rendering");
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                // the map texture is swapped by the diffusion
+                map.render(_viewport);
 
-        // Render
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                // Render world
+                _worldRenderer.render(_viewport);
 
-        if (!_paused)
-            updateWorld();
+                // Render ImGui
+                ImGui::Render();
+                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            }
+
+            {   PROFILE_SCOPE("swap");
+                // Swap draw and display buffers
+                SDL_GL_SwapWindow(_window);
+            }
 
-        _creatureSystem.setStage(CreatureSystem::Stage::PROCESS_INPUTS);
-        _ecs.runSystem(_creatureSystem);
+            if (_frameTicks > 0) {
+                // Map update (GPGPU pass) of the last tick
+                _simulation.diffuseMap();
+            }
+        }
 
-        updateGUI();
+        PROFILE_FRAME();
 
-        // Render world
-        map.render(_viewport);
-        _ecs.runSystem(_spriteSystem);
-        _ecs.getSingleton<fug::SpriteSingleton>()->render(_viewport);
-        _ecs.getSingleton<LineSingleton>()->render(_viewport);
+        uint64_t counter = SDL_GetPerformanceCounter();
+        _frameTime = (double)(counter - _lastCounter) / (double)SDL_GetPerformanceFrequency();
+        _lastCounter = counter;
+    }
 
-        // Render ImGui
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    auto& profiler = Profiler::instance();
+    if (profiler.isTracing()) {
+        profiler.stopTrace();
+        profiler.writeTrace(_traceFileName);
+    }
+}
 
-        // Swap draw and display buffers
-        SDL_GL_SwapWindow(_window);
+void Window::updateWorld()
+{
+    static auto& config = *_ecs.getSingleton<ConfigSingleton>();
 
-        if (!_paused) {
-            // Map update (GPGPU pass)
-            map.diffuseFertility();
+    if (_configEdited)
+        config = _config;
+    for (auto& action : _worldActions)
+        action();
+    _worldActions.clear();
+    _config = config; // the actions may have replaced it
+    _configEdited = false;
+
+    _simulationThread.setPaused(_paused);
+    _simulationThread.setTickRate(_tickRate);
+
+    if (!_threaded && !_paused) {
+        // fast-forward runs up to _speedMultiplier ticks, as many as fit the frame budget
+        uint64_t nTicks = _fastForward ? std::max(_speedMultiplier, (uint64_t)1) : 1;
+        uint64_t budgetEnd = SDL_GetPerformanceCounter() + (uint64_t)(fastForwardFrameShare *
+            (double)SDL_GetPerformanceFrequency() / (double)std::max(_settings.window.framerateLimit, (int64_t)1));
+        for (;;) {
+            _simulation.update();
+            ++_frameTicks;
+            // compaction may have moved the selected creature to another id
+            if (_activeCreature >= 0)
+                _activeCreature = _simulation.getRelocatedEntity(_activeCreature);
+
+            if (_frameTicks >= nTicks || SDL_GetPerformanceCounter() >= budgetEnd)
+                break;
+
+            // the diffusion of the last tick runs after the swap
+            _simulation.diffuseMap();
         }
+        _renderPending = true;
+    }
 
-        uint32_t curTicks = SDL_GetTicks();
-        _frameTicks = curTicks - _lastTicks;
-        _lastTicks = curTicks;
+    // captured only when changed, so a paused world costs nothing
+    if (_renderPending) {
+        auto& snapshot = _renderBuffer.getBack();
+        _simulation.captureRenderSnapshot(snapshot);
+        captureStatus(snapshot.status);
+        _renderBuffer.publish();
+        _renderPending = false;
     }
 }
 
-void Window::handleEvent(SDL_Event& event)
+void Window::captureStatus(RenderSnapshot::Status& status)
+{
+    static auto& world = *_ecs.getSingleton<WorldSingleton>();
+    static auto& telemetry = *_ecs.getSingleton<TelemetrySingleton>();
+    static auto& phylogeny = *_ecs.getSingleton<PhylogenySingleton>();
+    static auto& species = *_ecs.getSingleton<SpeciesSingleton>();
+
+    status.nCreatures = world.getNumberOf(WorldSingleton::EntityType::CREATURE);
+    status.nFood = world.getNumberOf(WorldSingleton::EntityType::FOOD);
+
+    status.telemetry.resize(TelemetrySingleton::nColumns);
+    for (int i=0; i<TelemetrySingleton::nColumns; ++i)
+        status.telemetry[i] = telemetry.getLastValue(i);
+    status.telemetryRecording = telemetry.isOpen();
+
+    status.stageAllocations.resize(Simulation::N_STAGES);
+    for (int s=0; s<Simulation::N_STAGES; ++s)
+        status.stageAllocations[s] = _simulation.getStageAllocations((Simulation::Stage)s);
+    status.compactionTime = _simulation.getStageTime(Simulation::COMPACTION);
+    status.compactionProgress = _simulation.getCompactionSystem().getProgress();
+
+    status.gridIndex = world.getIndexType() == WorldSingleton::IndexType::GRID;
+    status.gridCellSize = world.getCellSize();
+    status.nGridChunks = world.getNumberOfChunks();
+    status.nQuadtreeNodes = world.getNumberOfQuadtreeNodes();
+
+    const auto& speciesList = species.getSpecies();
+    status.nSpecies = speciesList.size();
+    status.nAssigned = species.getNumberOfAssigned();
+    status.species.assign(speciesList.begin(),
+        speciesList.begin() + std::min(speciesList.size(), RenderSnapshot::Status::maxListedSpecies));
+
+    status.nPhylogenyNodes = phylogeny.getNumberOfNodes();
+    status.nPhylogenyRecords = phylogeny.getNumberOfRecordsWritten();
+    status.lineageRecording = phylogeny.isOpen();
+
+    auto& checkpointer = _simulation.getCheckpointer();
+    status.lastCheckpointTick = checkpointer.getLastCheckpointTick();
+    status.checkpointCaptureTime = checkpointer.getLastCaptureTime();
+    status.checkpointWriteTime = checkpointer.getLastWriteTime();
+
+    if (_activeCreature >= 0) {
+        auto* cc = _ecs.getComponent<CreatureComponent>(_activeCreature);
+        auto* oc = _ecs.getComponent<fug::Orientation2DComponent>(_activeCreature);
+        auto* sc = _ecs.getComponent<fug::SpriteComponent>(_activeCreature);
+        if (cc == nullptr || sc == nullptr || phylogeny.getId(cc->lineageSlot) != _activeCreatureLineageId)
+            _activeCreature = -1; // creature has been removed
+        else {
+            status.activeCreatureEnergy = cc->energy;
+            status.activeCreaturePosition = oc->getPosition();
+            status.activeCreatureColor = sc->getColor();
+        }
+    }
+    status.activeCreature = _activeCreature;
+}
+
+void Window::pickCreature(const Vec2f& position)
 {
     static auto& world = *_ecs.getSingleton<WorldSingleton>();
+    static Vec2f maxRadiusVec(ConfigSingleton::maxObjectRadius, ConfigSingleton::maxObjectRadius);
+
+    // Find the clicked creature (if any)
+    _pickedEntities.clear();
+    world.getEntities(_pickedEntities, position-maxRadiusVec, position+maxRadiusVec);
+    for (auto& eId : _pickedEntities) {
+        if (_ecs.getComponent<FoodComponent>(eId) != nullptr)
+            continue;
+        auto* oc = _ecs.getComponent<fug::Orientation2DComponent>(eId);
+        if ((oc->getPosition()-position).norm() < oc->getScale()*ConfigSingleton::spriteRadius) {
+            _activeCreature = eId;
+            _activeCreatureLineageId = _ecs.getSingleton<PhylogenySingleton>()->getId(
+                _ecs.getComponent<CreatureComponent>(eId)->lineageSlot);
+            break;
+        }
+    }
+    _renderPending = true; // the selection is shown from the status
+}
+
+void Window::setThreaded(bool threaded)
+{
+    if (threaded == _simulationThread.isRunning())
+        return;
 
+    if (!threaded) {
+        _simulationThread.stop();
+        return;
+    }
+
+    // the thread isn't running, no locking needed
+    _simulationThread.setPaused(_paused);
+    _simulationThread.setTickRate(_tickRate);
+    _threaded = _simulationThread.start(_window, _simulationGlCtx, [this](RenderSnapshot& snapshot) {
+        // compaction may have moved the selected creature to another id
+        if (_activeCreature >= 0)
+            _activeCreature = _simulation.getRelocatedEntity(_activeCreature);
+        captureStatus(snapshot.status);
+    });
+}
+
+void Window::handleEvent(SDL_Event& event)
+{
     switch (event.type) {
         case SDL_WINDOWEVENT:
             switch (event.window.event) {
@@ -236,6 +421,16 @@ void Window::handleEvent(SDL_Event& event)
                 case SDLK_F12:
                     SDL_SetWindowFullscreen(_window, SDL_GetWindowFlags(_window) ^ SDL_WINDOW_FULLSCREEN);
                     break;
+                case SDLK_F5: // quicksave
+                    _worldActions.push_back([this, fileName = std::string(_snapshotFileName)]() {
+                        _simulation.saveSnapshot(fileName);
+                    });
+                    break;
+                case SDLK_F9: // quickload
+                    _worldActions.push_back([this, fileName = std::string(_snapshotFileName)]() {
+                        loadSnapshot(fileName);
+                    });
+                    break;
             }
         case SDL_MOUSEWHEEL:
             _viewport.zoom(std::pow(1.414213562373f, (float)event.wheel.y), _cursorPosition);
@@ -247,21 +442,7 @@ void Window::handleEvent(SDL_Event& event)
             switch (event.button.button) {
                 case SDL_BUTTON_LEFT: {
                     Vec2f clickWorldPos = _viewport.toWorld(_cursorPosition);
-                    static Vec2f maxRadiusVec(
-                        ConfigSingleton::maxObjectRadius, ConfigSingleton::maxObjectRadius);
-                    // Find the clicked creature (if any)
-                    Vector<fug::EntityId> entities;
-                    world.getEntities(entities, clickWorldPos-maxRadiusVec, clickWorldPos+maxRadiusVec);
-                    for (auto& eId : entities) {
-                        if (_ecs.getComponent<FoodComponent>(eId) != nullptr)
-                            continue;
-                        auto* oc = _ecs.getComponent<fug::Orientation2DComponent>(eId);
-                        if ((oc->getPosition()-clickWorldPos).norm() <
-                            oc->getScale()*ConfigSingleton::spriteRadius) {
-                            _activeCreature = eId;
-                            break;
-                        }
-                    }
+                    _worldActions.push_back([this, clickWorldPos]() { pickCreature(clickWorldPos); });
                 } break;
             }
     }
@@ -269,8 +450,14 @@ void Window::handleEvent(SDL_Event& event)
 
 void Window::updateGUI()
 {
-    static auto& world = *_ecs.getSingleton<WorldSingleton>();
-    static auto& config = *_ecs.getSingleton<ConfigSingleton>();
+    // the world is read from the latest snapshot, changes are queued as world actions or
+    // made to the config copy
+    const auto& snapshot = _renderBuffer.getFront();
+    const auto& status = snapshot.status;
+    auto& config = _config;
+    auto telemetryValue = [&](int column) {
+        return column < (int)status.telemetry.size() ? status.telemetry[column] : 0.0;
+    };
 
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -280,23 +467,248 @@ void Window::updateGUI()
     {   // Main simulation controls
         ImGui::Begin("Simulation Controls");
 
-        auto nCreatures = world.getNumberOf(WorldSingleton::EntityType::CREATURE);
-        auto nFood = world.getNumberOf(WorldSingleton::EntityType::FOOD);
+        auto nCreatures = status.nCreatures;
+        auto nFood = status.nFood;
 
         ImGui::Text("N. Creatures: %lu\n", nCreatures);
         ImGui::Text("N. Food: %lu\n", nFood);
+        ImGui::Text("Frame time: %0.2f ms\n", _frameTime*1000.0);
+
+        // achieved simulation speed, averaged over half a second
+        uint64_t counter = SDL_GetPerformanceCounter();
+        double tickRateTime = (double)(counter - _tickRateCounter) / (double)SDL_GetPerformanceFrequency();
+        if (tickRateTime >= 0.5) {
+            uint64_t tick = snapshot.tick;
+            _ticksPerSecond = tick >= _tickRateTick ? (double)(tick - _tickRateTick) / tickRateTime : 0.0;
+            _tickRateTick = tick;
+            _tickRateCounter = counter;
+        }
+        ImGui::Text("Ticks per second: %0.1f\n", _ticksPerSecond);
 
         ImGui::Checkbox("Paused", &_paused);
+        if (_simulationGlCtx != nullptr)
+            ImGui::Checkbox("Simulation thread", &_threaded);
+        if (!_threaded) {
+            ImGui::Checkbox("Fast-forward", &_fastForward);
+            if (_fastForward) {
+                static uint64_t speedMultiplierMin = 1;
+                static uint64_t speedMultiplierMax = 1000;
+                ImGui::SliderScalar("Speed multiplier", ImGuiDataType_U64, &_speedMultiplier,
+                    &speedMultiplierMin, &speedMultiplierMax, "%lux", ImGuiSliderFlags_Logarithmic);
+                ImGui::Text("Ticks on the last frame: %lu\n", _frameTicks);
+            }
+        }
+        else {
+            static double tickRateStep = 10.0;
+            ImGui::InputScalar("Target tick rate", ImGuiDataType_Double, &_tickRate, &tickRateStep, nullptr, "%.0f");
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Ticks per second, 0 for as fast as possible");
+            _tickRate = std::max(_tickRate, 0.0);
+        }
+
+        if (ImGui::CollapsingHeader("Snapshot")) {
+            ImGui::InputText("File", _snapshotFileName, sizeof(_snapshotFileName));
+            if (ImGui::Button("Save (F5)")) {
+                _worldActions.push_back([this, fileName = std::string(_snapshotFileName)]() {
+                    _simulation.saveSnapshot(fileName);
+                });
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Load (F9)")) {
+                _worldActions.push_back([this, fileName = std::string(_snapshotFileName)]() {
+                    loadSnapshot(fileName);
+                });
+            }
+
+            static uint64_t checkpointIntervalStep = 100;
+            _configEdited |= ImGui::InputScalar("Checkpoint interval", ImGuiDataType_U64, &config.checkpointInterval,
+                &checkpointIntervalStep);
+            if (config.checkpointInterval > 0) {
+                ImGui::Text("Last checkpoint: tick %lu\n", status.lastCheckpointTick);
+                ImGui::Text("Capture: %0.1f ms, write: %0.1f ms\n",
+                    status.checkpointCaptureTime*1000.0, status.checkpointWriteTime*1000.0);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Genome Bank")) {
+            ImGui::InputText("Genome bank file", _genomeBankFileName, sizeof(_genomeBankFileName));
+            if (ImGui::Button("Export genomes")) {
+                _worldActions.push_back([this, fileName = std::string(_genomeBankFileName)]() {
+                    _simulation.exportGenomes(fileName);
+                });
+            }
+
+            static uint64_t nImportCreatures = 1000;
+            ImGui::InputScalar("Creatures to import", ImGuiDataType_U64, &nImportCreatures);
+            if (ImGui::Button("Import genomes")) {
+                _worldActions.push_back([this, fileName = std::string(_genomeBankFileName), n = nImportCreatures]() {
+                    _renderPending |= _simulation.importGenomes(fileName, n);
+                });
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Telemetry")) {
+            ImGui::Text("Births: %.0f, deaths: %.0f, kills: %.0f\n",
+                telemetryValue(TelemetrySingleton::BIRTHS),
+                telemetryValue(TelemetrySingleton::DEATHS),
+                telemetryValue(TelemetrySingleton::KILLS));
+            ImGui::Text("Biomass: %0.1f (creatures: %0.1f, food: %0.1f)\n",
+                telemetryValue(TelemetrySingleton::TOTAL_BIOMASS),
+                telemetryValue(TelemetrySingleton::CREATURE_BIOMASS),
+                telemetryValue(TelemetrySingleton::FOOD_BIOMASS));
+
+            // histograms of the per-creature quantities
+            static const char* quantityNames[] = { "Mass", "Energy", "Age (log2)", "Speed", "Metabolic constant" };
+            float histogram[TelemetrySingleton::nHistogramBins];
+            for (int q=0; q<TelemetrySingleton::N_QUANTITIES; ++q) {
+                for (int i=0; i<TelemetrySingleton::nHistogramBins; ++i) {
+                    histogram[i] = (float)telemetryValue(
+                        TelemetrySingleton::histogramColumn((TelemetrySingleton::Quantity)q, i));
+                }
+                ImGui::PlotHistogram(quantityNames[q], histogram, TelemetrySingleton::nHistogramBins,
+                    0, nullptr, 0.0f, (float)nCreatures, ImVec2(0.0f, 40.0f));
+            }
+
+            ImGui::InputText("Telemetry file", _telemetryFileName, sizeof(_telemetryFileName));
+            if (status.telemetryRecording) {
+                if (ImGui::Button("Stop recording")) {
+                    _worldActions.push_back([this]() {
+                        _ecs.getSingleton<TelemetrySingleton>()->close();
+                        _renderPending = true;
+                    });
+                }
+            }
+            else if (ImGui::Button("Start recording")) {
+                _worldActions.push_back([this, fileName = std::string(_telemetryFileName)]() {
+                    _ecs.getSingleton<TelemetrySingleton>()->open(fileName);
+                    _renderPending = true;
+                });
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Hot paths")) {
+            auto hotPath = [&](HotPathCounters::Counter counter) {
+                return telemetryValue(TelemetrySingleton::hotPathColumn(counter));
+            };
+            auto ratio = [](double a, double b) { return b > 0.0 ? a/b : 0.0; };
+
+            double nQueries = hotPath(HotPathCounters::GRID_QUERIES);
+            ImGui::Text("Grid queries: %.0f, cells / query: %.2f, candidates / query: %.2f", nQueries,
+                ratio(hotPath(HotPathCounters::GRID_CELLS_VISITED), nQueries),
+                ratio(hotPath(HotPathCounters::GRID_CANDIDATES), nQueries));
+            ImGui::Text("Collision tests: %.0f, hits: %.0f (%.1f%%)",
+                hotPath(HotPathCounters::COLLISION_TESTS), hotPath(HotPathCounters::COLLISION_HITS),
+                100.0*ratio(hotPath(HotPathCounters::COLLISION_HITS), hotPath(HotPathCounters::COLLISION_TESTS)));
+            ImGui::Text("Whisker tests: %.0f, hits: %.0f (%.1f%%)",
+                hotPath(HotPathCounters::WHISKER_TESTS), hotPath(HotPathCounters::WHISKER_HITS),
+                100.0*ratio(hotPath(HotPathCounters::WHISKER_HITS), hotPath(HotPathCounters::WHISKER_TESTS)));
+            ImGui::Text("Events dispatched: %.0f in %.0f rounds",
+                hotPath(HotPathCounters::EVENTS_DISPATCHED), hotPath(HotPathCounters::EVENT_ROUNDS));
+            ImGui::Text("Entities created: %.0f, removed: %.0f",
+                hotPath(HotPathCounters::ENTITIES_CREATED), hotPath(HotPathCounters::ENTITIES_REMOVED));
+        }
+
+        if (ImGui::CollapsingHeader("Memory")) {
+            if (AllocationTracker::isEnabled()) {
+                ImGui::Text("%-14s %12s %12s", "Stage", "Allocations", "Bytes");
+                for (int s=0; s<(int)status.stageAllocations.size(); ++s) {
+                    const auto& allocations = status.stageAllocations[s];
+                    ImGui::Text("%-14s %12lu %12lu", Simulation::getStageName((Simulation::Stage)s),
+                        allocations.allocations, allocations.bytes);
+                }
+                ImGui::Separator();
+            }
+
+            if (status.gridIndex) {
+                static uint64_t gridCellSizeTuningIntervalStep = 16;
+                _configEdited |= ImGui::InputScalar("Cell size tuning interval", ImGuiDataType_U64,
+                    &config.gridCellSizeTuningInterval, &gridCellSizeTuningIntervalStep);
+                ImGui::Text("Grid cell size: %.1f", status.gridCellSize);
+                ImGui::Text("Grid chunks: %lu (%lu KiB)", status.nGridChunks,
+                    status.nGridChunks*sizeof(Vector<fug::EntityId>)*WorldSingleton::chunkSize*
+                    WorldSingleton::chunkSize/1024);
+            }
+            else
+                ImGui::Text("Quadtree nodes: %lu", status.nQuadtreeNodes);
+            static uint64_t spatialIndexRebuildIntervalStep = 16;
+            _configEdited |= ImGui::InputScalar("Index rebuild interval", ImGuiDataType_U64,
+                &config.spatialIndexRebuildInterval, &spatialIndexRebuildIntervalStep);
+            ImGui::Separator();
+
+            ImGui::Text("%-14s %12s %12s", "Pool slot size", "Used slots", "Slots");
+            for (auto& pool : SlabPool::getAllStatistics()) {
+                if (pool.nSlots > 0)
+                    ImGui::Text("%-14lu %12lu %12lu", pool.slotSize, pool.nUsedSlots, pool.nSlots);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Compaction")) {
+            static uint64_t compactionIntervalStep = 64;
+            _configEdited |= ImGui::InputScalar("Compaction interval", ImGuiDataType_U64, &config.compactionInterval,
+                &compactionIntervalStep);
+            static uint64_t compactionSwapsPerTickMin = 1;
+            static uint64_t compactionSwapsPerTickMax = 65536;
+            _configEdited |= ImGui::SliderScalar("compactionSwapsPerTick", ImGuiDataType_U64,
+                &config.compactionSwapsPerTick, &compactionSwapsPerTickMin, &compactionSwapsPerTickMax, "%lu",
+                ImGuiSliderFlags_Logarithmic);
+            ImGui::Text("Pass progress: %.1f%%, time: %0.3f ms", 100.0*status.compactionProgress,
+                status.compactionTime*1000.0);
+        }
+
+        if (ImGui::CollapsingHeader("Species")) {
+            ImGui::Text("Species: %lu (%lu / %lu creatures assigned)", status.nSpecies,
+                status.nAssigned, nCreatures);
+
+            static float speciesDistanceThresholdMin = 0.001f;
+            static float speciesDistanceThresholdMax = 1.0f;
+            _configEdited |= ImGui::SliderScalar("speciesDistanceThreshold", ImGuiDataType_Float,
+                &config.speciesDistanceThreshold,
+                &speciesDistanceThresholdMin, &speciesDistanceThresholdMax, "%.4f", ImGuiSliderFlags_Logarithmic);
+            static uint64_t speciesSamplesPerTickMin = 1;
+            static uint64_t speciesSamplesPerTickMax = 4096;
+            _configEdited |= ImGui::SliderScalar("speciesSamplesPerTick", ImGuiDataType_U64,
+                &config.speciesSamplesPerTick,
+                &speciesSamplesPerTickMin, &speciesSamplesPerTickMax, "%lu", ImGuiSliderFlags_Logarithmic);
+
+            // largest species first
+            for (const auto& s : status.species) {
+                ImGui::ColorButton("##species", ImVec4(s.color(0), s.color(1), s.color(2), 1.0f));
+                ImGui::SameLine();
+                ImGui::Text("#%lu: %lu creatures, founded on tick %lu, spread %.4f",
+                    s.label, s.size, s.foundedTick, s.spread);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("Phylogeny")) {
+            ImGui::Text("Retained nodes: %lu", status.nPhylogenyNodes);
+            ImGui::Text("Records written: %lu", status.nPhylogenyRecords);
+
+            ImGui::InputText("Lineage file", _phylogenyFileName, sizeof(_phylogenyFileName));
+            if (status.lineageRecording) {
+                if (ImGui::Button("Stop lineage recording")) {
+                    _worldActions.push_back([this]() {
+                        _ecs.getSingleton<PhylogenySingleton>()->close();
+                        _renderPending = true;
+                    });
+                }
+            }
+            else if (ImGui::Button("Start lineage recording")) {
+                _worldActions.push_back([this, fileName = std::string(_phylogenyFileName)]() {
+                    _ecs.getSingleton<PhylogenySingleton>()->open(fileName);
+                    _renderPending = true;
+                });
+            }
+        }
 
         if (ImGui::CollapsingHeader("Food Controls")) {
             static double foodPerTickMin = 0.001;
             static double foodPerTickMax = 100.0;
-            ImGui::SliderScalar("foodPerTick", ImGuiDataType_Double, &config.foodPerTick,
+            _configEdited |= ImGui::SliderScalar("foodPerTick", ImGuiDataType_Double, &config.foodPerTick,
                                 &foodPerTickMin, &foodPerTickMax, "%.5f", ImGuiSliderFlags_Logarithmic);
 
             static double foodGrowthRateMin = 0.0001;
             static double foodGrowthRateMax = 0.1;
-            ImGui::SliderScalar("foodGrowthRate", ImGuiDataType_Double, &config.foodGrowthRate,
+            _configEdited |= ImGui::SliderScalar("foodGrowthRate", ImGuiDataType_Double, &config.foodGrowthRate,
                                 &foodGrowthRateMin, &foodGrowthRateMax, "%.5f", ImGuiSliderFlags_Logarithmic);
         }
 
@@ -313,33 +725,35 @@ void Window::updateGUI()
             // list all stages
             for (auto stageIt = config.mutationStages.begin(); stageIt < config.mutationStages.end(); ++stageIt) {
                 auto& stage = *stageIt;
-                std::stringstream stageName;
-                stageName << "Stage " << ++stageId;
+                char stageName[32];
+                snprintf(stageName, sizeof(stageName), "Stage %d", ++stageId);
                 bool stageEnabled = true; // the following CollapsingHeader will set this to false to signify stage deletion
 
-                if (ImGui::CollapsingHeader(stageName.str().c_str(), &stageEnabled)) {
+                if (ImGui::CollapsingHeader(stageName, &stageEnabled)) {
 
                     // element names
-                    std::stringstream probabilityName, amplitudeName, modeName;
-                    probabilityName << "Probability##evolution" << stageId;
-                    amplitudeName << "Amplitude##evolution" << stageId;
-                    modeName << "Mode##evolution" << stageId;
+                    char probabilityName[48], amplitudeName[48], modeName[48];
+                    snprintf(probabilityName, sizeof(probabilityName), "Probability##evolution%d", stageId);
+                    snprintf(amplitudeName, sizeof(amplitudeName), "Amplitude##evolution%d", stageId);
+                    snprintf(modeName, sizeof(modeName), "Mode##evolution%d", stageId);
 
                     // sliders for probability and amplitude
-                    ImGui::SliderScalar(probabilityName.str().c_str(), ImGuiDataType_Float, &stage.probability,
+                    _configEdited |= ImGui::SliderScalar(probabilityName, ImGuiDataType_Float, &stage.probability,
                                         probabilityBounds, probabilityBounds+1, "%.5f", ImGuiSliderFlags_Logarithmic);
 
-                    ImGui::SliderScalar(amplitudeName.str().c_str(), ImGuiDataType_Float, &stage.amplitude,
+                    _configEdited |= ImGui::SliderScalar(amplitudeName, ImGuiDataType_Float, &stage.amplitude,
                                         amplitudeBounds, amplitudeBounds+1, "%.5f", ImGuiSliderFlags_Logarithmic);
 
                     // drop menu for the mutation mode
                     const char* currentModeTitle = modeTitles[stage.mode];
-                    if (ImGui::BeginCombo(modeName.str().c_str(), currentModeTitle)) {
+                    if (ImGui::BeginCombo(modeName, currentModeTitle)) {
                         for (int n = 0; n < IM_ARRAYSIZE(modeTitles); n++)
                         {
                             bool isSelected = (currentModeTitle == modeTitles[n]);
-                            if (ImGui::Selectable(modeTitles[n], isSelected))
+                            if (ImGui::Selectable(modeTitles[n], isSelected)) {
                                 stage.mode = static_cast<Genome::MutationMode>(n);
+                                _configEdited = true;
+                            }
                             if (isSelected)
                                 ImGui::SetItemDefaultFocus();
                         }
@@ -348,13 +762,24 @@ void Window::updateGUI()
                 }
 
                 // stage is deleted
-                if (!stageEnabled)
+                if (!stageEnabled) {
                     stageIt = config.mutationStages.erase(stageIt);
+                    _configEdited = true;
+                }
             }
 
             // button for adding new stages
             if (ImGui::Button("Add Stage")) {
                 config.mutationStages.emplace_back(0.1f, 0.1f, Genome::MutationMode::ADDITIVE);
+                _configEdited = true;
+            }
+
+            _configEdited |= ImGui::Checkbox("Delta genome storage", &config.genomeDeltaStorage);
+            if (config.genomeDeltaStorage) {
+                static uint64_t compactionThresholdMin = 0;
+                static uint64_t compactionThresholdMax = Genome::genomeSize;
+                _configEdited |= ImGui::SliderScalar("Compaction threshold", ImGuiDataType_U64,
+                    &config.genomeDeltaCompactionThreshold, &compactionThresholdMin, &compactionThresholdMax);
             }
 
             ImGui::Unindent();
@@ -363,105 +788,120 @@ void Window::updateGUI()
         ImGui::End();
     }
 
-    if (_activeCreature >= 0) {
-        // Selected creature controls
-        auto* cc = _ecs.getComponent<CreatureComponent>(_activeCreature);
-        auto* oc = _ecs.getComponent<fug::Orientation2DComponent>(_activeCreature);
-        auto* sc = _ecs.getComponent<fug::SpriteComponent>(_activeCreature);
-
-        if (cc != nullptr && sc != nullptr) {
-            ImGui::Begin("Creature");
-
-            ImGui::Text("Creature %lu", _activeCreature);
-            ImGui::Text("Energy: %0.5f", cc->energy);
-
-            ImGui::Checkbox("Follow", &_activeCreatureFollow);
-            if (_activeCreatureFollow)
-                _viewport.centerTo(oc->getPosition());
-
-            Vec3f color = sc->getColor();
-            ImGui::ColorPicker3("Creature color", color.data());
-            sc->setColor(color);
-
-            ImGui::End();
+#ifdef EVOLUTION_SIMULATOR_PROFILING
+    {   // Profiler statistics and timeline of the last frame
+        auto& profiler = Profiler::instance();
+        ImGui::Begin("Profiler");
+
+        if (ImGui::CollapsingHeader("Trace")) {
+            ImGui::InputText("Trace file", _traceFileName, sizeof(_traceFileName));
+            if (profiler.isTracing()) {
+                ImGui::Text("Capturing, %lu events", profiler.getNumberOfTraceEvents());
+                if (ImGui::Button("Stop and write trace")) {
+                    profiler.stopTrace();
+                    profiler.writeTrace(_traceFileName);
+                }
+            }
+            else if (ImGui::Button("Start trace"))
+                profiler.startTrace();
         }
-        else // creature has been removed
-            _activeCreature = -1;
-    }
-
-}
-
-void Window::updateWorld(void)
-{
-    static auto& world = *_ecs.getSingleton<WorldSingleton>();
-    static auto& config = *_ecs.getSingleton<ConfigSingleton>();
-    static auto& map = *_ecs.getSingleton<MapSingleton>();
-
-    // initiate pixel data transfer from GPU
-    map.prefetch();
-
-    _creatureSystem.setStage(CreatureSystem::Stage::COGNITION);
-    _ecs.runSystem(_creatureSystem);
-    _creatureSystem.setStage(CreatureSystem::Stage::DYNAMICS);
-    _ecs.runSystem(_creatureSystem);
 
-    // map the pixel data memory
-    map.map();
-
-    if (_activeCreature >= 0 && _ecs.getComponent<CreatureComponent>(_activeCreature) == nullptr)
-        _activeCreature = -1;
-    _creatureSystem.setStage(CreatureSystem::Stage::REPRODUCTION);
-    _ecs.runSystem(_creatureSystem);
-
-    {   // Create new food
-        static double nNewFood = 0.0;
-        nNewFood += config.foodPerTick;
-        auto foodPositions = map.sampleFertility((int)nNewFood);
-        for (auto& p : foodPositions) {
-            createFood(_ecs, FoodComponent::Type::PLANT, ConfigSingleton::minFoodMass, p);
+        if (ImGui::CollapsingHeader("Stages (ms per frame)")) {
+            ImGui::Text("%-20s %8s %8s %8s %8s", "Stage", "Last", "p50", "p95", "p99");
+            for (uint32_t s=0; s<profiler.getNumberOfStages(); ++s) {
+                auto statistics = profiler.getStatistics(s);
+                ImGui::Text("%-20s %8.3f %8.3f %8.3f %8.3f", profiler.getStageName(s).c_str(),
+                    statistics.last*1000.0, statistics.p50*1000.0, statistics.p95*1000.0, statistics.p99*1000.0);
+            }
         }
-        nNewFood -= (int)nNewFood;
-    }
-
-    if (world.getNumberOf(WorldSingleton::EntityType::CREATURE) < 1000) {
-        for (int i = 0l; i < 1000; ++i) {   // create a new creatures
-            if (RND > 0.0001) continue;
 
-            Vec2f p(RNDS * 1024.0f, RNDS * 1024.0f);
-            while (gauss2(p, 256.0f) < RND)
-                p << RNDS * 1024.0f, RNDS * 1024.0f;
-
-            double mass = ConfigSingleton::minCreatureMass + RND * (
-                ConfigSingleton::maxCreatureMass - ConfigSingleton::minCreatureMass);
+        if (ImGui::CollapsingHeader("Timeline")) {
+            const auto& spans = profiler.getLastFrameSpans();
+            uint64_t frameBegin = profiler.getLastFrameBegin();
+            uint64_t frameEnd = profiler.getLastFrameEnd();
+
+            // one row of lanes (one lane per nesting depth) for each thread
+            constexpr float laneHeight = 18.0f;
+            uint32_t nLanes = 0;
+            Vector<uint32_t> laneOffsets; // per thread
+            for (auto& span : spans) {
+                if (span.thread >= laneOffsets.size())
+                    laneOffsets.resize(span.thread+1, 0);
+                laneOffsets[span.thread] = std::max(laneOffsets[span.thread], span.depth+1);
+            }
+            for (auto& offset : laneOffsets) {
+                uint32_t nThreadLanes = offset;
+                offset = nLanes;
+                nLanes += nThreadLanes;
+            }
 
-            createCreature(_ecs, Genome(1.0f, RNDRANGE(0.001f, 0.005f)),
-                mass, 1.0, p, RND * M_PI * 2.0f, RND);
+            ImVec2 origin = ImGui::GetCursorScreenPos();
+            float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+            float scale = width / (float)std::max(frameEnd-frameBegin, (uint64_t)1);
+            auto* drawList = ImGui::GetWindowDrawList();
+            for (auto& span : spans) {
+                float x0 = origin.x + (float)((int64_t)span.begin-(int64_t)frameBegin)*scale;
+                float x1 = origin.x + (float)((int64_t)span.end-(int64_t)frameBegin)*scale;
+                x0 = std::max(x0, origin.x);
+                x1 = std::max(x1, x0+1.0f);
+                float y0 = origin.y + (float)(laneOffsets[span.thread]+span.depth)*laneHeight;
+                ImVec2 p0(x0, y0), p1(x1, y0+laneHeight-1.0f);
+
+                uint32_t hash = span.stage*2654435761u;
+                drawList->AddRectFilled(p0, p1, IM_COL32(64+(hash>>24)%160, 64+(hash>>16)%160, 64+(hash>>8)%160, 255));
+                auto name = profiler.getStageName(span.stage);
+                if (x1-x0 > 7.0f*(float)name.size())
+                    drawList->AddText(ImVec2(x0+2.0f, y0+2.0f), IM_COL32(0, 0, 0, 255), name.c_str());
+                if (ImGui::IsMouseHoveringRect(p0, p1))
+                    ImGui::SetTooltip("%s (thread %u): %0.3f ms", name.c_str(), span.thread,
+                        (double)(span.end-span.begin)*1.0e-6);
+            }
+            ImGui::Dummy(ImVec2(width, (float)nLanes*laneHeight));
         }
-    }
 
-    _foodSystem.setStage(FoodSystem::Stage::GROW);
-    _ecs.runSystem(_foodSystem);
-
-    // unmap the pixel data memory
-    map.unmap();
-
-    addEntitiesToWorld();
+        ImGui::End();
+    }
+#endif
 
-    _ecs.runSystem(_collisionSystem);
+    if (status.activeCreature >= 0) {
+        // Selected creature controls
+        ImGui::Begin("Creature");
+
+        ImGui::Text("Creature %lu", status.activeCreature);
+        ImGui::Text("Energy: %0.5f", status.activeCreatureEnergy);
+
+        ImGui::Checkbox("Follow", &_activeCreatureFollow);
+        if (_activeCreatureFollow)
+            _viewport.centerTo(status.activeCreaturePosition);
+
+        Vec3f color = status.activeCreatureColor;
+        if (ImGui::ColorPicker3("Creature color", color.data())) {
+            _worldActions.push_back([this, color]() {
+                // the creature may have been removed in the meantime
+                auto* sc = _activeCreature >= 0 ? _ecs.getComponent<fug::SpriteComponent>(_activeCreature) : nullptr;
+                if (sc != nullptr)
+                    sc->setColor(color);
+                _renderPending = true;
+            });
+        }
 
-    while (_eventSystem.swap())
-        _ecs.runSystem(_eventSystem);
+        ImGui::End();
+    }
 
-    addEntitiesToWorld();
 }
 
-void Window::addEntitiesToWorld(void)
+bool Window::loadSnapshot(const std::string& fileName)
 {
-    _ecs.getSingleton<WorldSingleton>()->reset();
+    if (!_simulation.loadSnapshot(fileName))
+        return false;
 
-    _creatureSystem.setStage(CreatureSystem::Stage::ADD_TO_WORLD);
-    _ecs.runSystem(_creatureSystem);
+    _activeCreature = -1;
+    _renderPending = true;
+    return true;
+}
 
-    _foodSystem.setStage(FoodSystem::Stage::ADD_TO_WORLD);
-    _ecs.runSystem(_foodSystem);
+void Window::startTrace(const std::string& fileName, size_t capacity)
+{
+    strncpy(_traceFileName, fileName.c_str(), sizeof(_traceFileName)-1);
+    Profiler::instance().startTrace(capacity);
 }
@@ -0,0 +1,85 @@
+//
+// Project: evolution_simulator_2
+// File: WorkerThread.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <WorkerThread.hpp>
+#include <Profiler.hpp>
+
+
+WorkerThread::WorkerThread(size_t maxQueuedJobs, const std::string& name) :
+    _maxQueuedJobs  (maxQueuedJobs),
+    _name           (name),
+    _running        (false),
+    _quit           (false),
+    _thread         (&WorkerThread::run, this)
+{
+}
+
+WorkerThread::~WorkerThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _jobAvailable.notify_all();
+    _thread.join();
+}
+
+bool WorkerThread::tryPush(Job&& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_jobs.size() >= _maxQueuedJobs)
+            return false;
+        _jobs.push_back(std::move(job));
+    }
+    _jobAvailable.notify_one();
+    return true;
+}
+
+void WorkerThread::push(Job&& job)
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _jobFinished.wait(lock, [&](){ return _jobs.size() < _maxQueuedJobs; });
+        _jobs.push_back(std::move(job));
+    }
+    _jobAvailable.notify_one();
+}
+
+void WorkerThread::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _jobFinished.wait(lock, [&](){ return _jobs.empty() && !_running; });
+}
+
+void WorkerThread::run()
+{
+    PROFILE_THREAD(_name);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _jobAvailable.wait(lock, [&](){ return _quit || !_jobs.empty(); });
+        if (_jobs.empty()) // quit requested and all jobs finished
+            return;
+
+        Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _running = true;
+
+        lock.unlock();
+        {   PROFILE_SCOPE("worker job");
+            job();
+        }
+        lock.lock();
+
+        _running = false;
+        _jobFinished.notify_all();
+    }
+}
@@ -0,0 +1,77 @@
+//
+// Project: evolution_simulator_2
+// File: WorldRenderer.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <WorldRenderer.hpp>
+#include <ResourceSingleton.hpp>
+#include <LineSingleton.hpp>
+#include <Utils.hpp>
+#include <Profiler.hpp>
+
+#include <graphics/SpriteSingleton.hpp>
+
+
+WorldRenderer::WorldRenderer() :
+    _spriteSystem   (_ecs)
+{
+}
+
+void WorldRenderer::init(int windowWidth, int windowHeight)
+{
+    auto& sprites = *_ecs.getSingleton<fug::SpriteSingleton>();
+    sprites.init();
+    sprites.setWindowSize(windowWidth, windowHeight);
+    auto spriteSheetId = sprites.addSpriteSheetFromFile(EVOLUTION_SIMULATOR_RES("sprites/sprites.png"), 128, 128);
+    _ecs.getSingleton<ResourceSingleton>()->init(spriteSheetId);
+
+    _ecs.getSingleton<LineSingleton>()->init();
+    _ecs.getSingleton<LineSingleton>()->setWindowSize(windowWidth, windowHeight);
+}
+
+void WorldRenderer::setSnapshot(const RenderSnapshot& snapshot)
+{
+    PROFILE_SCOPE("sprite update");
+
+    auto& resources = *_ecs.getSingleton<ResourceSingleton>();
+
+    // entities are reused, only the surplus is created or removed
+    size_t nEntities = snapshot.positions.size();
+    while (_entities.size() > nEntities) {
+        _ecs.removeEntity(_entities.back());
+        _entities.pop_back();
+    }
+
+    for (size_t i=0; i<nEntities; ++i) {
+        if (i == _entities.size())
+            _entities.push_back(_ecs.getEmptyEntityId());
+        auto id = _entities[i];
+
+        _ecs.setComponent(id, fug::Orientation2DComponent(
+            snapshot.positions[i], snapshot.rotations[i], snapshot.scales[i]));
+        fug::SpriteComponent spriteComponent = snapshot.types[i] == RenderSnapshot::Type::CREATURE ?
+            resources.creatureSpriteComponent : resources.foodSpriteComponent;
+        spriteComponent.setColor(snapshot.colors[i]);
+        _ecs.setComponent(id, std::move(spriteComponent));
+    }
+
+    _linePositions = snapshot.linePositions;
+    _lineColors = snapshot.lineColors;
+}
+
+void WorldRenderer::render(const Viewport& viewport)
+{
+    PROFILE_SCOPE("world rendering");
+
+    _ecs.runSystem(_spriteSystem);
+    _ecs.getSingleton<fug::SpriteSingleton>()->render(viewport);
+
+    auto& lines = *_ecs.getSingleton<LineSingleton>();
+    lines.drawLines(_linePositions, _lineColors);
+    lines.render(viewport);
+}
@@ -9,51 +9,439 @@
 //
 
 #include <WorldSingleton.hpp>
+#include <HotPathCounters.hpp>
 
+#include <algorithm>
+#include <cmath>
 
-WorldSingleton::WorldSingleton() :
-    _entityGrid (gridSize*gridSize)
+
+WorldSingleton::WorldSingleton(float cellSize) :
+    _indexType          (IndexType::GRID),
+    _quadtree           (ConfigSingleton::defaultWorldSize, minCellSize),
+    _cellSize           (cellSize),
+    _lastChunk          (nullptr),
+    _nGridEntities      (0),
+    _occupancySquares   (0),
+    _nQueries           (0),
+    _queryExtentSum     (0.0),
+    _incremental        (false),
+    _numberOfEntities   {},
+    _numberOfGhosts     {},
+    _tick               (0)
+{
+}
+
+void WorldSingleton::setIndexType(WorldSingleton::IndexType indexType)
+{
+    if (indexType == _indexType)
+        return;
+
+    releaseChunks();
+    reset();
+    _indexType = indexType;
+}
+
+void WorldSingleton::setWorldSize(float worldSize)
+{
+    _quadtree.setHalfSize(worldSize);
+    if (_indexType == IndexType::QUADTREE)
+        reset();
+}
+
+WorldSingleton::IndexType WorldSingleton::getIndexType() const
+{
+    return _indexType;
+}
+
+void WorldSingleton::setIncremental(bool incremental)
+{
+    _incremental = incremental;
+}
+
+bool WorldSingleton::isIncremental() const
 {
+    return _incremental;
 }
 
 void WorldSingleton::reset()
 {
-    for (auto& c : _entityGrid)
-        c.clear();
-    _numberOfEntities.clear();
+    _quadtree.reset();
+    for (auto& slot : _slots)
+        slot.indexed = false;
+
+    for (size_t i=0; i<_chunks.size();) {
+        auto& chunk = _chunks[i];
+        if (chunk->nEntities == 0) {
+            // empty since the last reset, release
+            _chunkIndex.erase(chunkKey(chunk->x, chunk->y));
+            _freeChunks.push_back(std::move(chunk));
+            if (i+1 < _chunks.size()) {
+                chunk = std::move(_chunks.back());
+                _chunkIndex[chunkKey(chunk->x, chunk->y)] = (uint32_t)i;
+            }
+            _chunks.pop_back();
+            continue;
+        }
+
+        // cells retain their capacity
+        for (auto& c : chunk->cells)
+            c.clear();
+        chunk->nEntities = 0;
+        ++i;
+    }
+    _lastChunk = nullptr;
+    _nGridEntities = 0;
+    _occupancySquares = 0;
+
+    for (auto& n : _numberOfEntities)
+        n = 0;
 }
 
 void WorldSingleton::addEntity(const fug::EntityId& eId, const Vec2f& position, EntityType entityType)
 {
-    auto x = posToGridCoord(position(0));
-    auto y = posToGridCoord(position(1));
+    if (_incremental) {
+        updateEntity(eId, position, entityType);
+        return;
+    }
+
+    ++_numberOfEntities[(int)entityType];
+
+    if (_indexType == IndexType::QUADTREE)
+        _quadtree.insert(eId, position);
+    else
+        gridInsert(eId, position);
+}
+
+void WorldSingleton::updateEntity(const fug::EntityId& eId, const Vec2f& position, EntityType entityType)
+{
+    if (!_incremental)
+        return;
+
+    if ((size_t)eId >= _slots.size())
+        _slots.resize((size_t)eId+1, Slot{Vec2f(0.0f, 0.0f), 0, EntityType::CREATURE, false});
+    auto& slot = _slots[eId];
 
-    ++_numberOfEntities[entityType];
+    if (!slot.indexed) {
+        ++_numberOfEntities[(int)entityType];
+        if (_indexType == IndexType::QUADTREE)
+            _quadtree.insert(eId, position);
+        else
+            slot.index = gridInsert(eId, position);
+        slot = Slot{position, slot.index, entityType, true};
+        return;
+    }
 
-    if (x < 0 || y < 0 || x >= gridSize || y>=gridSize)
+    if (slot.type != entityType) {
+        --_numberOfEntities[(int)slot.type];
+        ++_numberOfEntities[(int)entityType];
+        slot.type = entityType;
+    }
+
+    if (_indexType == IndexType::QUADTREE) {
+        _quadtree.move(eId, slot.position, position);
+    }
+    else if (posToGridCoord(position(0)) != posToGridCoord(slot.position(0)) ||
+        posToGridCoord(position(1)) != posToGridCoord(slot.position(1))) {
+        // crossed a cell boundary
+        gridRemove(slot.position, slot.index);
+        slot.index = gridInsert(eId, position);
+    }
+    slot.position = position;
+}
+
+void WorldSingleton::removeEntity(const fug::EntityId& eId)
+{
+    if (!_incremental || (size_t)eId >= _slots.size() || !_slots[eId].indexed)
         return;
 
-    _entityGrid[y*gridSize + x].push_back(eId);
+    auto& slot = _slots[eId];
+    --_numberOfEntities[(int)slot.type];
+    if (_indexType == IndexType::QUADTREE)
+        _quadtree.remove(eId, slot.position);
+    else
+        gridRemove(slot.position, slot.index);
+    slot.indexed = false;
 }
 
 void WorldSingleton::getEntities(Vector<fug::EntityId>& entities,
     const Vec2f& begin, const Vec2f& end) const
 {
-    auto xBegin = std::max(posToGridCoord(begin(0)), (int64_t)0);
-    auto yBegin = std::max(posToGridCoord(begin(1)), (int64_t)0);
-    auto xEnd = std::min(posToGridCoord(end(0)), gridSize-1);
-    auto yEnd = std::min(posToGridCoord(end(1)), gridSize-1);
+    size_t nEntities = entities.size();
+    float extent = 0.5f*(end(0)-begin(0) + end(1)-begin(1));
+    if (_indexType == IndexType::QUADTREE) {
+        uint64_t nNodesVisited = _quadtree.getEntities(entities, begin, end);
+        countQuery(nEntities, entities.size(), nNodesVisited, extent);
+        return;
+    }
+
+    auto xBegin = posToGridCoord(begin(0));
+    auto yBegin = posToGridCoord(begin(1));
+    auto xEnd = posToGridCoord(end(0));
+    auto yEnd = posToGridCoord(end(1));
+
+    uint64_t nCellsVisited = 0;
+    if (xEnd >= xBegin && yEnd >= yBegin) {
+        auto cxBegin = xBegin >> chunkShift;
+        auto cyBegin = yBegin >> chunkShift;
+        auto cxEnd = xEnd >> chunkShift;
+        auto cyEnd = yEnd >> chunkShift;
+
+        if ((double)(cxEnd-cxBegin+1)*(double)(cyEnd-cyBegin+1) <= (double)_chunks.size()) {
+            for (int64_t cy=cyBegin; cy<=cyEnd; ++cy) {
+                for (int64_t cx=cxBegin; cx<=cxEnd; ++cx) {
+                    auto* chunk = findChunk(cx, cy);
+                    if (chunk != nullptr)
+                        nCellsVisited += getEntities(entities, *chunk, xBegin, yBegin, xEnd, yEnd);
+                }
+            }
+        }
+        else {
+            // the range spans more chunks than there are allocated
+            for (auto& chunk : _chunks) {
+                if (chunk->x >= cxBegin && chunk->x <= cxEnd && chunk->y >= cyBegin && chunk->y <= cyEnd)
+                    nCellsVisited += getEntities(entities, *chunk, xBegin, yBegin, xEnd, yEnd);
+            }
+        }
+    }
+
+    countQuery(nEntities, entities.size(), nCellsVisited, extent);
+}
+
+void WorldSingleton::getEntitiesAlongRay(Vector<fug::EntityId>& entities,
+    const Vec2f& begin, const Vec2f& end, float radius) const
+{
+    size_t nEntities = entities.size();
+    Vec2f d = end-begin;
+    float extent = 0.5f*(std::abs(d(0)) + std::abs(d(1))) + 2.0f*radius;
+    if (_indexType == IndexType::QUADTREE) {
+        uint64_t nNodesVisited = _quadtree.getEntitiesAlongRay(entities, begin, end, radius);
+        countQuery(nEntities, entities.size(), nNodesVisited, extent);
+        return;
+    }
+
+    // row by row, cells overlapping the part of the segment within the row expanded by the radius
+    uint64_t nCellsVisited = 0;
+    auto yBegin = posToGridCoord(std::min(begin(1), end(1))-radius);
+    auto yEnd = posToGridCoord(std::max(begin(1), end(1))+radius);
+    for (int64_t y=yBegin; y<=yEnd; ++y) {
+        float rowBegin = (float)y*_cellSize - radius;
+        float rowEnd = (float)(y+1)*_cellSize + radius;
+        float t0 = 0.0f;
+        float t1 = 1.0f;
+        if (d(1) != 0.0f) {
+            float ta = (rowBegin-begin(1)) / d(1);
+            float tb = (rowEnd-begin(1)) / d(1);
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+            if (t0 > t1)
+                continue;
+        }
 
-    for (int64_t j=yBegin; j<=yEnd; ++j) {
-        for (int64_t i=xBegin; i<=xEnd; ++i) {
-            entities.insert(entities.end(),
-                _entityGrid[j*gridSize + i].begin(),
-                _entityGrid[j*gridSize + i].end());
+        float x0 = begin(0) + t0*d(0);
+        float x1 = begin(0) + t1*d(0);
+        auto xBegin = posToGridCoord(std::min(x0, x1)-radius);
+        auto xEnd = posToGridCoord(std::max(x0, x1)+radius);
+        for (int64_t cx=(xBegin >> chunkShift); cx<=(xEnd >> chunkShift); ++cx) {
+            auto* chunk = findChunk(cx, y >> chunkShift);
+            if (chunk != nullptr)
+                nCellsVisited += getEntities(entities, *chunk, xBegin, y, xEnd, y);
         }
     }
+
+    countQuery(nEntities, entities.size(), nCellsVisited, extent);
 }
 
 uint64_t WorldSingleton::getNumberOf(WorldSingleton::EntityType entityType)
 {
-    return _numberOfEntities[entityType];
+    return _numberOfEntities[(int)entityType];
+}
+
+void WorldSingleton::setNumberOfGhosts(WorldSingleton::EntityType entityType, uint64_t nGhosts)
+{
+    _numberOfGhosts[(int)entityType] = nGhosts;
+}
+
+uint64_t WorldSingleton::getNumberOfOwned(WorldSingleton::EntityType entityType)
+{
+    uint64_t n = _numberOfEntities[(int)entityType];
+    uint64_t nGhosts = _numberOfGhosts[(int)entityType];
+    return n > nGhosts ? n - nGhosts : 0;
+}
+
+uint64_t WorldSingleton::getTick() const
+{
+    return _tick;
+}
+
+void WorldSingleton::setTick(uint64_t tick)
+{
+    _tick = tick;
+}
+
+void WorldSingleton::advanceTick()
+{
+    ++_tick;
+}
+
+float WorldSingleton::getCellSize() const
+{
+    return _cellSize;
+}
+
+void WorldSingleton::setCellSize(float cellSize)
+{
+    if (cellSize == _cellSize)
+        return;
+
+    // all chunks map to different areas now
+    releaseChunks();
+    reset();
+    _cellSize = cellSize;
+}
+
+float WorldSingleton::estimateOptimalCellSize()
+{
+    double nQueries = (double)_nQueries;
+    double queryExtent = _nQueries > 0 ? _queryExtentSum / nQueries : 0.0;
+    _nQueries = 0;
+    _queryExtentSum = 0.0;
+    if (_nGridEntities == 0 || nQueries == 0.0)
+        return _cellSize;
+
+    // Density of neighbours around an entity from the expected occupancy of its own cell
+    double cellSize = _cellSize;
+    double neighbourDensity = std::max((double)_occupancySquares/(double)_nGridEntities - 1.0, 0.0) /
+        (cellSize*cellSize);
+    if (neighbourDensity <= 0.0)
+        return maxCellSize;
+
+    // A query with extent q visits (q/c+1)^2 cells covering (q+c)^2 area on average,
+    // cost(c) = cellCost*(q/c+1)^2 + candidateCost*density*(q+c)^2 is minimized at
+    // c^3 = cellCost*q / (candidateCost*density)
+    double optimum = std::cbrt(cellCost*queryExtent / (candidateCost*neighbourDensity));
+    return std::clamp((float)optimum, minCellSize, maxCellSize);
+}
+
+size_t WorldSingleton::getNumberOfChunks() const
+{
+    return _chunks.size();
+}
+
+size_t WorldSingleton::getNumberOfQuadtreeNodes() const
+{
+    return _quadtree.getNumberOfNodes();
+}
+
+void WorldSingleton::countQuery(size_t nEntitiesBefore, size_t nEntitiesAfter,
+    uint64_t nCellsVisited, float extent) const
+{
+    ++_nQueries;
+    _queryExtentSum += std::max((double)extent, 0.0);
+
+    HotPathCounters::add(HotPathCounters::GRID_QUERIES);
+    HotPathCounters::add(HotPathCounters::GRID_CELLS_VISITED, nCellsVisited);
+    HotPathCounters::add(HotPathCounters::GRID_CANDIDATES, nEntitiesAfter-nEntitiesBefore);
+}
+
+const WorldSingleton::Chunk* WorldSingleton::findChunk(int64_t x, int64_t y) const
+{
+    auto it = _chunkIndex.find(chunkKey(x, y));
+    if (it == _chunkIndex.end())
+        return nullptr;
+
+    return _chunks[it->second].get();
+}
+
+WorldSingleton::Chunk& WorldSingleton::getChunk(int64_t x, int64_t y)
+{
+    auto it = _chunkIndex.find(chunkKey(x, y));
+    if (it != _chunkIndex.end())
+        return *_chunks[it->second];
+
+    if (_freeChunks.empty()) {
+        _chunks.push_back(std::make_unique<Chunk>());
+    }
+    else {
+        _chunks.push_back(std::move(_freeChunks.back()));
+        _freeChunks.pop_back();
+    }
+    _chunkIndex[chunkKey(x, y)] = (uint32_t)_chunks.size()-1;
+
+    auto& chunk = *_chunks.back();
+    chunk.x = x;
+    chunk.y = y;
+    chunk.nEntities = 0;
+    return chunk;
+}
+
+uint32_t WorldSingleton::gridInsert(const fug::EntityId& eId, const Vec2f& position)
+{
+    auto x = posToGridCoord(position(0));
+    auto y = posToGridCoord(position(1));
+
+    auto cx = x >> chunkShift;
+    auto cy = y >> chunkShift;
+    if (_lastChunk == nullptr || _lastChunk->x != cx || _lastChunk->y != cy)
+        _lastChunk = &getChunk(cx, cy);
+
+    auto& cell = _lastChunk->cells[(y & (chunkSize-1))*chunkSize + (x & (chunkSize-1))];
+    // (n+1)^2 - n^2
+    _occupancySquares += 2*cell.size() + 1;
+    cell.push_back(eId);
+    ++_lastChunk->nEntities;
+    ++_nGridEntities;
+
+    return (uint32_t)cell.size()-1;
+}
+
+void WorldSingleton::gridRemove(const Vec2f& position, uint32_t index)
+{
+    auto x = posToGridCoord(position(0));
+    auto y = posToGridCoord(position(1));
+
+    // chunks are retained until the next reset, the entity's chunk exists
+    auto& chunk = getChunk(x >> chunkShift, y >> chunkShift);
+    auto& cell = chunk.cells[(y & (chunkSize-1))*chunkSize + (x & (chunkSize-1))];
+
+    // n^2 - (n-1)^2
+    _occupancySquares -= 2*cell.size() - 1;
+    cell[index] = cell.back();
+    cell.pop_back();
+    if (index < cell.size())
+        _slots[cell[index]].index = index;
+    --chunk.nEntities;
+    --_nGridEntities;
+}
+
+void WorldSingleton::releaseChunks()
+{
+    for (auto& chunk : _chunks) {
+        for (auto& c : chunk->cells)
+            c.clear();
+        _freeChunks.push_back(std::move(chunk));
+    }
+    _chunks.clear();
+    _chunkIndex.clear();
+    _lastChunk = nullptr;
+    _nGridEntities = 0;
+    _occupancySquares = 0;
+}
+
+uint64_t WorldSingleton::getEntities(Vector<fug::EntityId>& entities, const WorldSingleton::Chunk& chunk,
+    int64_t xBegin, int64_t yBegin, int64_t xEnd, int64_t yEnd) const
+{
+    // cell range in chunk-local coordinates
+    auto iBegin = std::max(xBegin - (chunk.x << chunkShift), (int64_t)0);
+    auto jBegin = std::max(yBegin - (chunk.y << chunkShift), (int64_t)0);
+    auto iEnd = std::min(xEnd - (chunk.x << chunkShift), chunkSize-1);
+    auto jEnd = std::min(yEnd - (chunk.y << chunkShift), chunkSize-1);
+
+    for (int64_t j=jBegin; j<=jEnd; ++j) {
+        for (int64_t i=iBegin; i<=iEnd; ++i) {
+            auto& cell = chunk.cells[j*chunkSize + i];
+            entities.insert(entities.end(), cell.begin(), cell.end());
+        }
+    }
+
+    return (uint64_t)((iEnd-iBegin+1)*(jEnd-jBegin+1));
 }
@@ -0,0 +1,439 @@
+//
+// Project: evolution_simulator_2
+// File: WorldSnapshot.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <WorldSnapshot.hpp>
+#include <SnapshotSystem.hpp>
+#include <CreatureComponent.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <MapSingleton.hpp>
+#include <ResourceSingleton.hpp>
+#include <PhylogenySingleton.hpp>
+#include <SpeciesSingleton.hpp>
+#include <EventHandlers.hpp>
+#include <Utils.hpp>
+
+#include <engine/EventComponent.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static_assert(std::is_trivially_copyable_v<WorldSnapshot::Header>);
+static_assert(std::is_trivially_copyable_v<WorldSnapshot::ConfigRecord>);
+static_assert(std::is_trivially_copyable_v<WorldSnapshot::MutationStageRecord>);
+static_assert(std::is_trivially_copyable_v<WorldSnapshot::CreatureRecord>);
+static_assert(std::is_trivially_copyable_v<WorldSnapshot::FoodRecord>);
+
+
+namespace {
+
+    inline uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + WorldSnapshot::blockAlignment - 1) & ~(WorldSnapshot::blockAlignment - 1);
+    }
+
+    // pad the file with zeros up to offset and write a block of data there
+    inline bool writeBlock(FILE* file, uint64_t& position, uint64_t offset, const void* data, uint64_t size)
+    {
+        static const char zeros[WorldSnapshot::blockAlignment] = {};
+        if (offset - position > 0 && fwrite(zeros, 1, offset - position, file) != offset - position)
+            return false;
+        if (size > 0 && fwrite(data, 1, size, file) != size)
+            return false;
+        position = offset + size;
+        return true;
+    }
+
+    // check that an aligned block of count elements at offset lies within a file of fileSize bytes
+    inline bool blockFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+    {
+        return offset % WorldSnapshot::blockAlignment == 0 && offset <= fileSize &&
+            (elementSize == 0 || count <= (fileSize - offset) / elementSize);
+    }
+
+} // namespace
+
+
+WorldSnapshot::WorldSnapshot() :
+    _header         (),
+    _configRecord   (),
+    _config         (nullptr),
+    _mutationStages (nullptr),
+    _rng            (nullptr),
+    _creatures      (nullptr),
+    _genomes        (nullptr),
+    _food           (nullptr),
+    _fertility      (nullptr),
+    _mapping        (nullptr),
+    _mappingSize    (0),
+    _valid          (false)
+{
+}
+
+WorldSnapshot::~WorldSnapshot()
+{
+    releaseMapping();
+}
+
+void WorldSnapshot::capture(fug::Ecs& ecs, SnapshotSystem& snapshotSystem)
+{
+    auto& config = *ecs.getSingleton<ConfigSingleton>();
+    auto& world = *ecs.getSingleton<WorldSingleton>();
+    auto& map = *ecs.getSingleton<MapSingleton>();
+
+    releaseMapping();
+
+    // clear() retains the capacity, repeated captures do not reallocate
+    _creatureRecords.clear();
+    _genomeData.clear();
+    _foodRecords.clear();
+
+    // entities
+    snapshotSystem.setSnapshot(this);
+    snapshotSystem.setStage(SnapshotSystem::Stage::CAPTURE);
+    ecs.runSystem(snapshotSystem);
+    snapshotSystem.setSnapshot(nullptr);
+
+    // config
+    _configRecord.creatureEnergyUseConstant = config.creatureEnergyUseConstant;
+    _configRecord.creatureAccelerationEnergyUseConstant = config.creatureAccelerationEnergyUseConstant;
+    _configRecord.creatureTurnEnergyUseConstant = config.creatureTurnEnergyUseConstant;
+    _configRecord.creatureMassIncreaseFactor = config.creatureMassIncreaseFactor;
+    _configRecord.creatureFeedRate = config.creatureFeedRate;
+    _configRecord.massEnergyStorageConstant = config.massEnergyStorageConstant;
+    _configRecord.foodPlantMassToEnergyConstant = config.foodPlantMassToEnergyConstant;
+    _configRecord.foodMeatMassToEnergyConstant = config.foodMeatMassToEnergyConstant;
+    _configRecord.foodPerTick = config.foodPerTick;
+    _configRecord.foodGrowthRate = config.foodGrowthRate;
+    _configRecord.foodSpoilRate = config.foodSpoilRate;
+    _configRecord.creatureDragCoefficient = config.creatureDragCoefficient;
+    _configRecord.worldSize = config.worldSize;
+
+    _mutationStageRecords.clear();
+    for (auto& stage : config.mutationStages) {
+        _mutationStageRecords.push_back(MutationStageRecord{
+            stage.probability, stage.amplitude, (uint32_t)stage.mode, 0 });
+    }
+
+    // RNG state in the textual format of the standard library
+    std::stringstream rngStream;
+    rngStream << randomEngine();
+    _rngState = rngStream.str();
+
+    // fertility map
+    _header.mapWidth = (uint32_t)map.width();
+    _header.mapHeight = (uint32_t)map.height();
+    _fertilityData.resize((size_t)_header.mapWidth*_header.mapHeight);
+    map.readFertility(_fertilityData.data());
+
+    memcpy(_header.magic, magic, sizeof(magic));
+    _header.version = version;
+    _header.headerSize = sizeof(Header);
+    _header.genomeSize = Genome::genomeSize;
+    _header.memorySize = CreatureCognition::memorySize;
+    _header.tick = world.getTick();
+    _header.nMutationStages = _mutationStageRecords.size();
+    _header.rngStateSize = _rngState.size();
+    _header.nCreatures = _creatureRecords.size();
+    _header.nFood = _foodRecords.size();
+    computeOffsets();
+
+    updateOwnedViews();
+    _valid = true;
+}
+
+void WorldSnapshot::restore(fug::Ecs& ecs, SnapshotSystem& snapshotSystem) const
+{
+    if (!_valid) {
+        printf("Error: Snapshot is empty\n");
+        return;
+    }
+
+    auto& config = *ecs.getSingleton<ConfigSingleton>();
+    auto& world = *ecs.getSingleton<WorldSingleton>();
+    auto& map = *ecs.getSingleton<MapSingleton>();
+    auto& resources = *ecs.getSingleton<ResourceSingleton>();
+    auto& phylogeny = *ecs.getSingleton<PhylogenySingleton>();
+
+    // remove all existing entities, the restored creatures start new lineages
+    snapshotSystem.setStage(SnapshotSystem::Stage::CLEAR);
+    ecs.runSystem(snapshotSystem);
+    phylogeny.reset();
+    ecs.getSingleton<SpeciesSingleton>()->reset();
+
+    // config
+    config.creatureEnergyUseConstant = _config->creatureEnergyUseConstant;
+    config.creatureAccelerationEnergyUseConstant = _config->creatureAccelerationEnergyUseConstant;
+    config.creatureTurnEnergyUseConstant = _config->creatureTurnEnergyUseConstant;
+    config.creatureMassIncreaseFactor = _config->creatureMassIncreaseFactor;
+    config.creatureFeedRate = _config->creatureFeedRate;
+    config.massEnergyStorageConstant = _config->massEnergyStorageConstant;
+    config.foodPlantMassToEnergyConstant = _config->foodPlantMassToEnergyConstant;
+    config.foodMeatMassToEnergyConstant = _config->foodMeatMassToEnergyConstant;
+    config.foodPerTick = _config->foodPerTick;
+    config.foodGrowthRate = _config->foodGrowthRate;
+    config.foodSpoilRate = _config->foodSpoilRate;
+    config.creatureDragCoefficient = _config->creatureDragCoefficient;
+    config.worldSize = _config->worldSize > 0.0f ? _config->worldSize : ConfigSingleton::defaultWorldSize;
+
+    config.mutationStages.clear();
+    for (uint64_t i=0; i<_header.nMutationStages; ++i) {
+        config.mutationStages.emplace_back(_mutationStages[i].probability, _mutationStages[i].amplitude,
+            static_cast<Genome::MutationMode>(_mutationStages[i].mode));
+    }
+
+    // RNG state
+    std::stringstream rngStream(std::string(_rng, _header.rngStateSize));
+    rngStream >> randomEngine();
+
+    world.setTick(_header.tick);
+
+    // fertility map
+    if ((int)_header.mapWidth == map.width() && (int)_header.mapHeight == map.height())
+        map.writeFertility(_fertility);
+    else
+        printf("Warning: Snapshot fertility map size does not match, map not restored\n");
+
+    // creatures, components are constructed directly from the (mapped) records
+    for (uint64_t i=0; i<_header.nCreatures; ++i) {
+        const auto& record = _creatures[i];
+        fug::EntityId id = ecs.getEmptyEntityId();
+
+        CreatureComponent creatureComponent(Genome(_genomes + i*Genome::genomeSize),
+            record.energy, record.mass, record.direction, record.speed);
+        creatureComponent.age = record.age;
+        creatureComponent.agingFactor = record.agingFactor;
+        creatureComponent.cognition.setMemory(
+            Eigen::Map<const CreatureCognition::Memory>(record.memory));
+        creatureComponent.lineageSlot = phylogeny.addBirth(PhylogenySingleton::invalidSlot, _header.tick);
+
+        fug::SpriteComponent spriteComponent = resources.creatureSpriteComponent;
+        spriteComponent.setColor(Vec3f(record.color[0], record.color[1], record.color[2]));
+
+        ecs.setComponent(id, fug::Orientation2DComponent(
+            Vec2f(record.position[0], record.position[1]), record.direction, record.scale));
+        ecs.setComponent(id, std::move(spriteComponent));
+        ecs.addComponent<fug::EventComponent>(id)->addHandler<EventHandler_Creature_CollisionEvent>();
+        ecs.setComponent(id, std::move(creatureComponent));
+    }
+
+    // food
+    for (uint64_t i=0; i<_header.nFood; ++i) {
+        const auto& record = _food[i];
+        createFood(ecs, static_cast<FoodComponent::Type>(record.type), record.mass,
+            Vec2f(record.position[0], record.position[1]));
+    }
+}
+
+bool WorldSnapshot::write(const std::string& fileName, bool sync) const
+{
+    if (!_valid) {
+        printf("Error: Snapshot is empty\n");
+        return false;
+    }
+
+    FILE* file = fopen(fileName.c_str(), "wb");
+    if (file == nullptr) {
+        printf("Error: Could not open %s for writing\n", fileName.c_str());
+        return false;
+    }
+
+    uint64_t position = 0;
+    bool success =
+        writeBlock(file, position, 0, &_header, sizeof(Header)) &&
+        writeBlock(file, position, _header.configOffset, _config, sizeof(ConfigRecord)) &&
+        writeBlock(file, position, _header.mutationStagesOffset, _mutationStages,
+            _header.nMutationStages*sizeof(MutationStageRecord)) &&
+        writeBlock(file, position, _header.rngStateOffset, _rng, _header.rngStateSize) &&
+        writeBlock(file, position, _header.creaturesOffset, _creatures,
+            _header.nCreatures*sizeof(CreatureRecord)) &&
+        writeBlock(file, position, _header.genomesOffset, _genomes,
+            _header.nCreatures*Genome::genomeSize*sizeof(float)) &&
+        writeBlock(file, position, _header.foodOffset, _food, _header.nFood*sizeof(FoodRecord)) &&
+        writeBlock(file, position, _header.mapOffset, _fertility,
+            (uint64_t)_header.mapWidth*_header.mapHeight*sizeof(float));
+
+    if (success && sync)
+        success = fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+    if (fclose(file) != 0)
+        success = false;
+
+    if (!success)
+        printf("Error: Could not write snapshot to %s\n", fileName.c_str());
+
+    return success;
+}
+
+bool WorldSnapshot::load(const std::string& fileName)
+{
+    releaseMapping();
+    _valid = false;
+
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Could not open %s for reading\n", fileName.c_str());
+        return false;
+    }
+
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 || (uint64_t)fileStat.st_size < sizeof(Header)) {
+        printf("Error: %s is not a valid snapshot\n", fileName.c_str());
+        close(fd);
+        return false;
+    }
+
+    _mappingSize = (size_t)fileStat.st_size;
+    _mapping = mmap(nullptr, _mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid after closing the file descriptor
+    if (_mapping == MAP_FAILED) {
+        printf("Error: Could not map %s\n", fileName.c_str());
+        _mapping = nullptr;
+        _mappingSize = 0;
+        return false;
+    }
+
+    // the whole file is read front to back during restore
+    madvise(_mapping, _mappingSize, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    const char* base = static_cast<const char*>(_mapping);
+    memcpy(&_header, base, sizeof(Header));
+
+    if (memcmp(_header.magic, magic, sizeof(magic)) != 0 ||
+        _header.version != version ||
+        _header.headerSize != sizeof(Header) ||
+        _header.genomeSize != Genome::genomeSize ||
+        _header.memorySize != CreatureCognition::memorySize ||
+        _header.fileSize != _mappingSize) {
+        printf("Error: %s is not a compatible snapshot (version %u, genome size %u)\n",
+            fileName.c_str(), _header.version, _header.genomeSize);
+        releaseMapping();
+        return false;
+    }
+
+    if (!blockFits(_header.configOffset, 1, sizeof(ConfigRecord), _mappingSize) ||
+        !blockFits(_header.mutationStagesOffset, _header.nMutationStages, sizeof(MutationStageRecord),
+            _mappingSize) ||
+        !blockFits(_header.rngStateOffset, _header.rngStateSize, 1, _mappingSize) ||
+        !blockFits(_header.creaturesOffset, _header.nCreatures, sizeof(CreatureRecord), _mappingSize) ||
+        !blockFits(_header.genomesOffset, _header.nCreatures, Genome::genomeSize*sizeof(float), _mappingSize) ||
+        !blockFits(_header.foodOffset, _header.nFood, sizeof(FoodRecord), _mappingSize) ||
+        !blockFits(_header.mapOffset, (uint64_t)_header.mapWidth*_header.mapHeight, sizeof(float), _mappingSize)) {
+        printf("Error: %s is truncated or corrupted\n", fileName.c_str());
+        releaseMapping();
+        return false;
+    }
+
+    _config = reinterpret_cast<const ConfigRecord*>(base + _header.configOffset);
+    _mutationStages = reinterpret_cast<const MutationStageRecord*>(base + _header.mutationStagesOffset);
+    _rng = base + _header.rngStateOffset;
+    _creatures = reinterpret_cast<const CreatureRecord*>(base + _header.creaturesOffset);
+    _genomes = reinterpret_cast<const float*>(base + _header.genomesOffset);
+    _food = reinterpret_cast<const FoodRecord*>(base + _header.foodOffset);
+    _fertility = reinterpret_cast<const float*>(base + _header.mapOffset);
+    _valid = true;
+
+    return true;
+}
+
+void WorldSnapshot::addCreature(const CreatureComponent& creatureComponent,
+    const fug::Orientation2DComponent& orientationComponent,
+    const fug::SpriteComponent& spriteComponent)
+{
+    CreatureRecord record {};
+    record.energy = creatureComponent.energy;
+    record.mass = creatureComponent.mass;
+    record.age = creatureComponent.age;
+    record.agingFactor = creatureComponent.agingFactor;
+    record.position[0] = orientationComponent.getPosition()(0);
+    record.position[1] = orientationComponent.getPosition()(1);
+    record.scale = orientationComponent.getScale();
+    record.direction = creatureComponent.direction;
+    record.speed = creatureComponent.speed;
+    auto& color = spriteComponent.getColor();
+    record.color[0] = color(0);
+    record.color[1] = color(1);
+    record.color[2] = color(2);
+    Eigen::Map<CreatureCognition::Memory>(record.memory) = creatureComponent.cognition.getMemory();
+    _creatureRecords.push_back(record);
+
+    size_t genomeOffset = _genomeData.size();
+    _genomeData.resize(genomeOffset + Genome::genomeSize);
+    creatureComponent.genome.copyTo(&_genomeData[genomeOffset]);
+}
+
+void WorldSnapshot::addFood(const FoodComponent& foodComponent,
+    const fug::Orientation2DComponent& orientationComponent)
+{
+    FoodRecord record {};
+    record.mass = foodComponent.mass;
+    record.position[0] = orientationComponent.getPosition()(0);
+    record.position[1] = orientationComponent.getPosition()(1);
+    record.scale = orientationComponent.getScale();
+    record.type = (uint32_t)foodComponent.type;
+    _foodRecords.push_back(record);
+}
+
+uint64_t WorldSnapshot::getTick() const
+{
+    return _header.tick;
+}
+
+uint64_t WorldSnapshot::getNumberOfCreatures() const
+{
+    return _valid ? _header.nCreatures : 0;
+}
+
+uint64_t WorldSnapshot::getNumberOfFood() const
+{
+    return _valid ? _header.nFood : 0;
+}
+
+void WorldSnapshot::updateOwnedViews()
+{
+    _config = &_configRecord;
+    _mutationStages = _mutationStageRecords.data();
+    _rng = _rngState.data();
+    _creatures = _creatureRecords.data();
+    _genomes = _genomeData.data();
+    _food = _foodRecords.data();
+    _fertility = _fertilityData.data();
+}
+
+void WorldSnapshot::computeOffsets()
+{
+    _header.configOffset = alignOffset(sizeof(Header));
+    _header.mutationStagesOffset = alignOffset(_header.configOffset + sizeof(ConfigRecord));
+    _header.rngStateOffset = alignOffset(_header.mutationStagesOffset +
+        _header.nMutationStages*sizeof(MutationStageRecord));
+    _header.creaturesOffset = alignOffset(_header.rngStateOffset + _header.rngStateSize);
+    _header.genomesOffset = alignOffset(_header.creaturesOffset +
+        _header.nCreatures*sizeof(CreatureRecord));
+    _header.foodOffset = alignOffset(_header.genomesOffset +
+        _header.nCreatures*Genome::genomeSize*sizeof(float));
+    _header.mapOffset = alignOffset(_header.foodOffset + _header.nFood*sizeof(FoodRecord));
+    _header.fileSize = _header.mapOffset + (uint64_t)_header.mapWidth*_header.mapHeight*sizeof(float);
+}
+
+void WorldSnapshot::releaseMapping()
+{
+    if (_mapping != nullptr) {
+        munmap(_mapping, _mappingSize);
+        _mapping = nullptr;
+        _mappingSize = 0;
+        _valid = false;
+    }
+}
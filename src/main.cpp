@@ -10,17 +10,64 @@
 
 
 #include "Window.hpp"
+#include "Profiler.hpp"
 
+#include <cstring>
+#include <cstdlib>
 
-int main()
+
+int main(int argc, char** argv)
 {
+    const char* traceFileName = nullptr;
+    size_t traceCapacity = Profiler::defaultTraceCapacity;
+    float worldSize = ConfigSingleton::defaultWorldSize;
+    auto spatialIndex = WorldSingleton::IndexType::GRID;
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "--trace") == 0 && i+1 < argc)
+            traceFileName = argv[++i];
+        else if (strcmp(argv[i], "--trace-capacity") == 0 && i+1 < argc)
+            traceCapacity = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--world-size") == 0 && i+1 < argc)
+            worldSize = strtof(argv[++i], nullptr);
+        else if (strcmp(argv[i], "--spatial-index") == 0 && i+1 < argc && strcmp(argv[i+1], "grid") == 0) {
+            spatialIndex = WorldSingleton::IndexType::GRID;
+            ++i;
+        }
+        else if (strcmp(argv[i], "--spatial-index") == 0 && i+1 < argc && strcmp(argv[i+1], "quadtree") == 0) {
+            spatialIndex = WorldSingleton::IndexType::QUADTREE;
+            ++i;
+        }
+        else {
+            printf("Usage: %s [--trace FILE] [--trace-capacity EVENTS] [--world-size SIZE] "
+                "[--spatial-index grid|quadtree]\n", argv[0]);
+            return 1;
+        }
+    }
+
+#ifndef EVOLUTION_SIMULATOR_PROFILING
+    if (traceFileName != nullptr) {
+        printf("Error: Tracing requires building with EVOLUTION_SIMULATOR_PROFILING\n");
+        return 1;
+    }
+#endif
+
+    if (!(worldSize > 0.0f)) {
+        printf("Error: World size must be positive\n");
+        return 1;
+    }
+
     Window::Settings settings;
     settings.window.width = 1920;
     settings.window.height = 1080;
     settings.window.name = "Evolution Simulator";
+    settings.worldSize = worldSize;
+    settings.spatialIndex = spatialIndex;
 
     Window window(settings);
 
+    if (traceFileName != nullptr)
+        window.startTrace(traceFileName, traceCapacity);
+
     window.loop();
 
     return 0;
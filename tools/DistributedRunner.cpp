@@ -0,0 +1,259 @@
+//
+// Project: evolution_simulator_2
+// File: DistributedRunner.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Simulation.hpp>
+#include <HeadlessContext.hpp>
+#include <DomainDecomposition.hpp>
+#include <SocketTransport.hpp>
+#include <ConfigSingleton.hpp>
+#include <Utils.hpp>
+#include <Profiler.hpp>
+
+#include <glad/glad.h>
+#include <graphics/SpriteSingleton.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace {
+
+    struct Options {
+        uint32_t    nRegionsX = 2;
+        uint32_t    nRegionsY = 2;
+        uint64_t    ticks = 10000;
+        uint64_t    nCreatures = 4000; // whole world
+        uint64_t    nFood = 10000;
+        float       spread = -1.0f; // negative to scale with the world size
+        float       worldSize = ConfigSingleton::defaultWorldSize;
+        uint64_t    seed = 1;
+    };
+
+    // written by the region process to the pipe
+    struct RegionResult {
+        bool        success;
+        double      ticksPerSecond;
+        double      boundaryTime; // share of the update time spent on the boundary exchange
+        uint64_t    nCreatures; // owned, after the last tick
+        uint64_t    nFood;
+        uint64_t    nGhosts;
+        uint64_t    emigrants; // over the run
+        uint64_t    immigrants;
+    };
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options]\n"
+            "  --regions-x N    regions along the x axis, one process each (default 2)\n"
+            "  --regions-y N    regions along the y axis (default 2)\n"
+            "  --ticks N        ticks to simulate (default 10000)\n"
+            "  --creatures N    initial creatures in the whole world (default 4000)\n"
+            "  --food N         initial food in the whole world (default 10000)\n"
+            "  --spread X       std. dev. of the initial creature placement (default 0.25x the world size)\n"
+            "  --world-size X   world half extent (default %.0f)\n"
+            "  --seed N         random seed (default 1)\n",
+            program, ConfigSingleton::defaultWorldSize);
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i+1 < argc;
+            if (arg == "--regions-x" && hasValue)
+                options.nRegionsX = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            else if (arg == "--regions-y" && hasValue)
+                options.nRegionsY = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            else if (arg == "--ticks" && hasValue)
+                options.ticks = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--creatures" && hasValue)
+                options.nCreatures = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--food" && hasValue)
+                options.nFood = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--spread" && hasValue)
+                options.spread = strtof(argv[++i], nullptr);
+            else if (arg == "--world-size" && hasValue)
+                options.worldSize = strtof(argv[++i], nullptr);
+            else if (arg == "--seed" && hasValue)
+                options.seed = strtoull(argv[++i], nullptr, 10);
+            else {
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+
+        if (options.nRegionsX*options.nRegionsY < 2 || options.worldSize <= 0.0f) {
+            printf("Error: At least two regions and a positive world size are required\n");
+            return false;
+        }
+        return true;
+    }
+
+    // Simulate a region in the current process, requires a fresh process since the systems
+    // cache singleton references of the first Ecs they are used with
+    RegionResult runRegion(Transport& transport, const Options& options)
+    {
+        RegionResult result {};
+        uint32_t nRegions = transport.getNumberOfRanks();
+
+        HeadlessContext context;
+        if (!context.init("evolution_simulator_distributed"))
+            return result;
+
+        Simulation simulation;
+        auto& ecs = simulation.getEcs();
+        auto& config = *ecs.getSingleton<ConfigSingleton>();
+
+        // the initial world is generated identically on all ranks, each keeps its own region
+        randomEngine().seed(options.seed);
+        ecs.getSingleton<fug::SpriteSingleton>()->init();
+        auto spriteSheetId = ecs.getSingleton<fug::SpriteSingleton>()->addSpriteSheetFromFile(
+            EVOLUTION_SIMULATOR_RES("sprites/sprites.png"), 128, 128);
+        simulation.init(spriteSheetId);
+        simulation.setWorldSize(options.worldSize);
+        simulation.populate(options.nCreatures, options.nFood, options.spread);
+
+        DomainDecomposition decomposition(simulation, transport, options.nRegionsX, options.nRegionsY);
+        if (!decomposition.init())
+            return result;
+        decomposition.claimRegion();
+        randomEngine().seed(options.seed + 1 + transport.getRank());
+
+        // every rank samples new food over the whole world, it's migrated to the owner
+        config.foodPerTick /= (double)nRegions;
+
+        double updateTime = 0.0;
+        double boundaryTime = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i=0; i<options.ticks && !decomposition.hasFailed(); ++i) {
+            auto updateStart = std::chrono::steady_clock::now();
+            simulation.update();
+            updateTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - updateStart).count();
+            boundaryTime += simulation.getStageTime(Simulation::BOUNDARY);
+            simulation.diffuseMap();
+            PROFILE_FRAME(); // the spans are buffered until the frame is closed
+        }
+        glFinish();
+        double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        result.success = !decomposition.hasFailed();
+        result.ticksPerSecond = (double)options.ticks / duration;
+        result.boundaryTime = updateTime > 0.0 ? boundaryTime / updateTime : 0.0;
+        result.nCreatures = decomposition.getNumberOfCreatures();
+        result.nFood = decomposition.getNumberOfFood();
+        result.nGhosts = decomposition.getNumberOfGhosts();
+        result.emigrants = decomposition.getNumberOfEmigrants();
+        result.immigrants = decomposition.getNumberOfImmigrants();
+
+        return result;
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 2;
+
+    uint32_t nRegions = options.nRegionsX*options.nRegionsY;
+    Vector<Vector<int>> sockets;
+    if (!SocketTransport::connectLocal(nRegions, sockets))
+        return 2;
+
+    fprintf(stderr, "Running %ux%u regions for %lu ticks\n", options.nRegionsX, options.nRegionsY, options.ticks);
+
+    // All regions run at once since they exchange boundaries every tick
+    Vector<pid_t> pids(nRegions, -1);
+    Vector<int> fds(nRegions, -1);
+    bool failed = false;
+    for (uint32_t i=0; i<nRegions; ++i) {
+        int pipeFds[2];
+        if (pipe(pipeFds) != 0) {
+            printf("Error: Could not create a pipe\n");
+            failed = true;
+            break;
+        }
+
+        fflush(nullptr); // nothing buffered may be duplicated into the child
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("Error: Could not fork a region process\n");
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+            failed = true;
+            break;
+        }
+
+        if (pid == 0) {
+            close(pipeFds[0]);
+            dup2(STDERR_FILENO, STDOUT_FILENO); // keep the results table clean
+            SocketTransport::closeOthers(i, sockets);
+            RegionResult result;
+            {   SocketTransport transport(i, sockets[i]);
+                result = runRegion(transport, options);
+            }
+            bool written = write(pipeFds[1], &result, sizeof(result)) == sizeof(result);
+            close(pipeFds[1]);
+            fflush(stdout);
+            _exit(written && result.success ? 0 : 1);
+        }
+
+        close(pipeFds[1]);
+        pids[i] = pid;
+        fds[i] = pipeFds[0];
+    }
+    // the regions hold the only remaining ends, a failing region disconnects its peers
+    SocketTransport::closeOthers(nRegions, sockets);
+
+    Vector<RegionResult> results(nRegions, RegionResult{});
+    Vector<long> peakRss(nRegions, 0);
+    for (uint32_t i=0; i<nRegions; ++i) {
+        if (pids[i] < 0)
+            continue;
+
+        int status = 0;
+        struct rusage usage {};
+        wait4(pids[i], &status, 0, &usage);
+        bool received = read(fds[i], &results[i], sizeof(RegionResult)) == sizeof(RegionResult);
+        close(fds[i]);
+        peakRss[i] = usage.ru_maxrss; // KiB
+        if (!received || !results[i].success || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Error: Region %u failed\n", i);
+            results[i].success = false;
+            failed = true;
+        }
+    }
+
+    printf("%8s %12s %12s %12s %12s %12s %12s %12s %12s\n", "region", "creatures", "food", "ghosts",
+        "emigrants", "immigrants", "boundary%", "ticksPerSec", "peakRssKiB");
+    uint64_t nCreatures = 0;
+    uint64_t nFood = 0;
+    for (uint32_t i=0; i<nRegions; ++i) {
+        auto& r = results[i];
+        if (!r.success) {
+            printf("%8u %12s\n", i, "failed");
+            continue;
+        }
+        printf("%8u %12lu %12lu %12lu %12lu %12lu %12.1f %12.1f %12ld\n", i, r.nCreatures, r.nFood, r.nGhosts,
+            r.emigrants, r.immigrants, 100.0*r.boundaryTime, r.ticksPerSecond, peakRss[i]);
+        nCreatures += r.nCreatures;
+        nFood += r.nFood;
+    }
+    printf("%8s %12lu %12lu\n", "total", nCreatures, nFood);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,459 @@
+//
+// Project: evolution_simulator_2
+// File: EnsembleRunner.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Simulation.hpp>
+#include <HeadlessContext.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <TelemetrySingleton.hpp>
+#include <Utils.hpp>
+#include <Profiler.hpp>
+
+#include <glad/glad.h>
+#include <graphics/SpriteSingleton.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace {
+
+    // values of a swept ConfigSingleton parameter
+    struct Axis {
+        std::string     name;
+        Vector<double>  values;
+    };
+
+    // runs are the cartesian product of the seeds and the parameter axes
+    struct Sweep {
+        uint64_t            ticks = 10000;
+        uint64_t            nCreatures = 2000;
+        uint64_t            nFood = 5000;
+        float               spread = -1.0f; // negative to scale with the world size
+        float               worldSize = ConfigSingleton::defaultWorldSize;
+        Vector<uint64_t>    seeds = {1};
+        Vector<Axis>        axes;
+
+        size_t size() const
+        {
+            size_t n = seeds.size();
+            for (auto& axis : axes)
+                n *= axis.values.size();
+            return n;
+        }
+
+        // seed of a run and its value on each axis, seeds vary fastest
+        uint64_t getRun(size_t run, Vector<double>& values) const
+        {
+            uint64_t seed = seeds[run % seeds.size()];
+            run /= seeds.size();
+            values.resize(axes.size());
+            for (size_t i=axes.size(); i-- > 0;) {
+                values[i] = axes[i].values[run % axes[i].values.size()];
+                run /= axes[i].values.size();
+            }
+            return seed;
+        }
+    };
+
+    struct Options {
+        std::string     sweepFileName;
+        size_t          nJobs = std::max(std::thread::hardware_concurrency(), 1u);
+        std::string     outputFileName; // CSV, empty for none
+        std::string     telemetryDirectory; // empty for no telemetry files
+    };
+
+    // written by the world process to the pipe
+    struct RunResult {
+        bool        success;
+        double      ticksPerSecond;
+        uint64_t    nCreatures; // after the last tick
+        uint64_t    nFood;
+        uint64_t    minCreatures; // over the run
+        uint64_t    maxCreatures;
+        double      creatureBiomass;
+        double      foodBiomass;
+        uint64_t    nSpecies;
+        double      meanMass;
+        double      meanEnergy;
+        uint64_t    births; // over the run
+        uint64_t    deaths;
+        uint64_t    kills;
+    };
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options] SWEEP_FILE\n"
+            "  --jobs N           worlds simulated concurrently (default: number of cores)\n"
+            "  --output FILE      also write the results table as CSV\n"
+            "  --telemetry DIR    stream the telemetry of each run to DIR/run<N>.bin\n"
+            "Sweep file lines (# starts a comment):\n"
+            "  ticks N | creatures N | food N | spread X | worldSize X\n"
+            "  seeds S1 S2 ...\n"
+            "  <parameter> V1 V2 ...   ConfigSingleton member, e.g. foodPerTick or mutationStage0.amplitude\n",
+            program);
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i+1 < argc;
+            if (arg == "--jobs" && hasValue)
+                options.nJobs = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--output" && hasValue)
+                options.outputFileName = argv[++i];
+            else if (arg == "--telemetry" && hasValue)
+                options.telemetryDirectory = argv[++i];
+            else if (options.sweepFileName.empty() && arg.compare(0, 2, "--") != 0)
+                options.sweepFileName = arg;
+            else {
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+
+        if (options.sweepFileName.empty() || options.nJobs == 0) {
+            printUsage(argv[0]);
+            return false;
+        }
+        return true;
+    }
+
+    bool readSweep(const std::string& fileName, Sweep& sweep)
+    {
+        FILE* file = fopen(fileName.c_str(), "r");
+        if (file == nullptr) {
+            printf("Error: Could not open %s\n", fileName.c_str());
+            return false;
+        }
+
+        ConfigSingleton config; // for validating the parameter names
+        bool success = true;
+        char line[4096];
+        for (int lineNumber=1; success && fgets(line, sizeof(line), file) != nullptr; ++lineNumber) {
+            char* comment = strchr(line, '#');
+            if (comment != nullptr)
+                *comment = '\0';
+
+            std::istringstream stream(line);
+            std::string key;
+            if (!(stream >> key))
+                continue;
+
+            Vector<double> values;
+            std::string token;
+            while (stream >> token) {
+                char* end = nullptr;
+                values.push_back(strtod(token.c_str(), &end));
+                if (*end != '\0') {
+                    printf("Error: %s:%d: Invalid value %s\n", fileName.c_str(), lineNumber, token.c_str());
+                    success = false;
+                }
+            }
+            if (values.empty()) {
+                printf("Error: %s:%d: No values for %s\n", fileName.c_str(), lineNumber, key.c_str());
+                success = false;
+                continue;
+            }
+
+            bool single = values.size() == 1;
+            if (key == "seeds") {
+                sweep.seeds.clear();
+                for (auto& v : values)
+                    sweep.seeds.push_back((uint64_t)v);
+                continue;
+            }
+            else if (key == "ticks" && single)
+                sweep.ticks = (uint64_t)values[0];
+            else if (key == "creatures" && single)
+                sweep.nCreatures = (uint64_t)values[0];
+            else if (key == "food" && single)
+                sweep.nFood = (uint64_t)values[0];
+            else if (key == "spread" && single)
+                sweep.spread = (float)values[0];
+            else if (key == "worldSize" && single && values[0] > 0.0)
+                sweep.worldSize = (float)values[0];
+            else if (key == "ticks" || key == "creatures" || key == "food" || key == "spread" ||
+                key == "worldSize") {
+                printf("Error: %s:%d: %s takes a single (positive) value\n",
+                    fileName.c_str(), lineNumber, key.c_str());
+                success = false;
+            }
+            else if (config.setParameter(key, values[0]))
+                sweep.axes.push_back(Axis{key, std::move(values)});
+            else {
+                printf("Error: %s:%d: %s is not a sweepable parameter\n", fileName.c_str(), lineNumber, key.c_str());
+                success = false;
+            }
+        }
+
+        fclose(file);
+        return success;
+    }
+
+    // Simulate a world in the current process, requires a fresh process since the systems
+    // cache singleton references of the first Ecs they are used with
+    RunResult runWorld(const Sweep& sweep, size_t run, const Options& options)
+    {
+        RunResult result {};
+
+        HeadlessContext context;
+        if (!context.init("evolution_simulator_ensemble"))
+            return result;
+
+        Simulation simulation;
+        auto& ecs = simulation.getEcs();
+        auto& config = *ecs.getSingleton<ConfigSingleton>();
+        auto& world = *ecs.getSingleton<WorldSingleton>();
+        auto& telemetry = *ecs.getSingleton<TelemetrySingleton>();
+
+        Vector<double> values;
+        randomEngine().seed(sweep.getRun(run, values));
+        for (size_t i=0; i<sweep.axes.size(); ++i)
+            config.setParameter(sweep.axes[i].name, values[i]);
+
+        if (!options.telemetryDirectory.empty() &&
+            !telemetry.open(options.telemetryDirectory + "/run" + std::to_string(run) + ".bin"))
+            return result;
+
+        ecs.getSingleton<fug::SpriteSingleton>()->init();
+        auto spriteSheetId = ecs.getSingleton<fug::SpriteSingleton>()->addSpriteSheetFromFile(
+            EVOLUTION_SIMULATOR_RES("sprites/sprites.png"), 128, 128);
+        simulation.init(spriteSheetId);
+        simulation.setWorldSize(sweep.worldSize);
+        simulation.populate(sweep.nCreatures, sweep.nFood, sweep.spread);
+
+        result.minCreatures = world.getNumberOf(WorldSingleton::EntityType::CREATURE);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i=0; i<sweep.ticks; ++i) {
+            simulation.update();
+            simulation.diffuseMap();
+            PROFILE_FRAME(); // the spans are buffered until the frame is closed
+
+            uint64_t nCreatures = world.getNumberOf(WorldSingleton::EntityType::CREATURE);
+            result.minCreatures = std::min(result.minCreatures, nCreatures);
+            result.maxCreatures = std::max(result.maxCreatures, nCreatures);
+            result.births += (uint64_t)telemetry.getLastValue(TelemetrySingleton::BIRTHS);
+            result.deaths += (uint64_t)telemetry.getLastValue(TelemetrySingleton::DEATHS);
+            result.kills += (uint64_t)telemetry.getLastValue(TelemetrySingleton::KILLS);
+        }
+        glFinish();
+        double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        telemetry.close();
+
+        result.success = true;
+        result.ticksPerSecond = (double)sweep.ticks / duration;
+        result.nCreatures = world.getNumberOf(WorldSingleton::EntityType::CREATURE);
+        result.nFood = world.getNumberOf(WorldSingleton::EntityType::FOOD);
+        result.creatureBiomass = telemetry.getLastValue(TelemetrySingleton::CREATURE_BIOMASS);
+        result.foodBiomass = telemetry.getLastValue(TelemetrySingleton::FOOD_BIOMASS);
+        result.nSpecies = (uint64_t)telemetry.getLastValue(TelemetrySingleton::N_SPECIES);
+        result.meanMass = telemetry.getLastValue(TelemetrySingleton::meanColumn(TelemetrySingleton::MASS));
+        result.meanEnergy = telemetry.getLastValue(TelemetrySingleton::meanColumn(TelemetrySingleton::ENERGY));
+
+        return result;
+    }
+
+    struct Job {
+        pid_t   pid;
+        int     fd; // read end of the result pipe
+        size_t  run;
+    };
+
+    // Fork a world process, the result is read once it has exited
+    bool startJob(const Sweep& sweep, size_t run, const Options& options, Job& job)
+    {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            printf("Error: Could not create a pipe\n");
+            return false;
+        }
+
+        fflush(nullptr); // nothing buffered may be duplicated into the child
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("Error: Could not fork a world process\n");
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+
+        if (pid == 0) {
+            close(fds[0]);
+            dup2(STDERR_FILENO, STDOUT_FILENO); // keep the results table clean
+            RunResult result = runWorld(sweep, run, options);
+            bool written = write(fds[1], &result, sizeof(result)) == sizeof(result);
+            close(fds[1]);
+            fflush(stdout);
+            _exit(written && result.success ? 0 : 1);
+        }
+
+        close(fds[1]);
+        job = Job{pid, fds[0], run};
+        return true;
+    }
+
+    void writeTable(FILE* output, const Sweep& sweep, const Vector<RunResult>& results,
+        const Vector<long>& peakRss, bool csv)
+    {
+        const char* separator = csv ? "," : " ";
+        auto column = [&](const char* text, bool first = false) {
+            fprintf(output, csv ? "%s%s" : "%s%12s", first ? "" : separator, text);
+        };
+
+        column("run", true);
+        column("seed");
+        for (auto& axis : sweep.axes)
+            fprintf(output, csv ? "%s%s" : "%s%24s", separator, axis.name.c_str());
+        for (auto* name : {"creatures", "food", "minCreatures", "maxCreatures", "creatureMass", "foodMass",
+            "species", "meanMass", "meanEnergy", "births", "deaths", "kills", "ticksPerSec", "peakRssKiB"})
+            column(name);
+        fprintf(output, "\n");
+
+        Vector<double> values;
+        char text[64];
+        for (size_t run=0; run<results.size(); ++run) {
+            auto& r = results[run];
+            uint64_t seed = sweep.getRun(run, values);
+            snprintf(text, sizeof(text), "%lu", run);
+            column(text, true);
+            snprintf(text, sizeof(text), "%lu", seed);
+            column(text);
+            for (auto& v : values)
+                fprintf(output, csv ? "%s%g" : "%s%24g", separator, v);
+
+            if (!r.success) {
+                column("failed");
+                fprintf(output, "\n");
+                continue;
+            }
+
+            for (uint64_t v : {r.nCreatures, r.nFood, r.minCreatures, r.maxCreatures}) {
+                snprintf(text, sizeof(text), "%lu", v);
+                column(text);
+            }
+            for (double v : {r.creatureBiomass, r.foodBiomass}) {
+                snprintf(text, sizeof(text), "%.1f", v);
+                column(text);
+            }
+            snprintf(text, sizeof(text), "%lu", r.nSpecies);
+            column(text);
+            for (double v : {r.meanMass, r.meanEnergy}) {
+                snprintf(text, sizeof(text), "%.4f", v);
+                column(text);
+            }
+            for (uint64_t v : {r.births, r.deaths, r.kills}) {
+                snprintf(text, sizeof(text), "%lu", v);
+                column(text);
+            }
+            snprintf(text, sizeof(text), "%.1f", r.ticksPerSecond);
+            column(text);
+            snprintf(text, sizeof(text), "%ld", peakRss[run]);
+            column(text);
+            fprintf(output, "\n");
+        }
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 2;
+
+    Sweep sweep;
+    if (!readSweep(options.sweepFileName, sweep))
+        return 2;
+
+    size_t nRuns = sweep.size();
+    if (nRuns == 0) {
+        printf("Error: The sweep has no runs\n");
+        return 2;
+    }
+    fprintf(stderr, "Running %lu worlds of %lu ticks, %lu at a time\n", nRuns, sweep.ticks,
+        std::min(options.nJobs, nRuns));
+
+    // Bounded pool of world processes, a new one is started whenever one exits
+    Vector<RunResult> results(nRuns, RunResult{});
+    Vector<long> peakRss(nRuns, 0);
+    Vector<Job> jobs;
+    size_t nextRun = 0;
+    size_t nFinished = 0;
+    bool failed = false;
+    while (nFinished < nRuns) {
+        while (jobs.size() < options.nJobs && nextRun < nRuns) {
+            Job job;
+            if (!startJob(sweep, nextRun, options, job)) {
+                failed = true;
+                ++nFinished;
+            }
+            else
+                jobs.push_back(job);
+            ++nextRun;
+        }
+        if (jobs.empty())
+            continue;
+
+        int status = 0;
+        struct rusage usage {};
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0 && errno != EINTR) {
+            printf("Error: Could not wait for the world processes\n");
+            return 2;
+        }
+        auto job = std::find_if(jobs.begin(), jobs.end(), [pid](const Job& j) { return j.pid == pid; });
+        if (job == jobs.end())
+            continue;
+
+        auto& result = results[job->run];
+        bool received = read(job->fd, &result, sizeof(result)) == sizeof(result);
+        close(job->fd);
+        peakRss[job->run] = usage.ru_maxrss; // KiB
+        if (!received || !result.success || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Error: Run %lu failed\n", job->run);
+            result.success = false;
+            failed = true;
+        }
+        else {
+            fprintf(stderr, "[%lu/%lu] run %lu: %lu creatures, %.1f ticks/s\n", nFinished+1, nRuns,
+                job->run, result.nCreatures, result.ticksPerSecond);
+        }
+
+        ++nFinished;
+        jobs.erase(job);
+    }
+
+    writeTable(stdout, sweep, results, peakRss, false);
+
+    if (!options.outputFileName.empty()) {
+        FILE* output = fopen(options.outputFileName.c_str(), "w");
+        if (output == nullptr) {
+            printf("Error: Could not open %s for writing\n", options.outputFileName.c_str());
+            return 2;
+        }
+        writeTable(output, sweep, results, peakRss, true);
+        fclose(output);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+//
+// Project: evolution_simulator_2
+// File: IslandRunner.cpp
+//
+// Copyright (c) 2021 Miika 'Lehdari' Lehtimäki
+// You may use, distribute and modify this code under the terms
+// of the licence specified in file LICENSE which is distributed
+// with this source code package.
+//
+
+#include <Simulation.hpp>
+#include <HeadlessContext.hpp>
+#include <MigrationQueue.hpp>
+#include <ConfigSingleton.hpp>
+#include <WorldSingleton.hpp>
+#include <TelemetrySingleton.hpp>
+#include <Utils.hpp>
+#include <Profiler.hpp>
+
+#include <glad/glad.h>
+#include <graphics/SpriteSingleton.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace {
+
+    struct Options {
+        uint64_t        nIslands = 4;
+        uint64_t        ticks = 10000;
+        uint64_t        nCreatures = 2000; // per island
+        uint64_t        nFood = 5000;
+        uint64_t        seed = 1; // island i uses seed+i
+        uint64_t        migrationInterval = 500; // ticks
+        uint64_t        nMigrants = 16; // per island and migration
+        uint32_t        queueCapacity = 64; // migrants
+        std::string     telemetryDirectory; // empty for no telemetry files
+    };
+
+    // written by the island process to the pipe
+    struct IslandResult {
+        bool        success;
+        double      ticksPerSecond;
+        uint64_t    nCreatures; // after the last tick
+        uint64_t    nFood;
+        uint64_t    nSpecies;
+        double      meanMass;
+        double      meanEnergy;
+        uint64_t    births; // over the run
+        uint64_t    deaths;
+        uint64_t    emigrants;
+        uint64_t    immigrants;
+    };
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options]\n"
+            "  --islands N            worlds evolving in parallel, connected in a ring (default 4)\n"
+            "  --ticks N              ticks simulated by each island (default 10000)\n"
+            "  --creatures N          initial creatures per island (default 2000)\n"
+            "  --food N               initial food per island (default 5000)\n"
+            "  --seed N               random seed of the first island, the others use the following\n"
+            "                         seeds (default 1)\n"
+            "  --migration-interval N ticks between migrations (default 500)\n"
+            "  --migrants N           creatures each island sends per migration (default 16)\n"
+            "  --queue-capacity N     migrants buffered between two islands (default 64)\n"
+            "  --telemetry DIR        stream the telemetry of each island to DIR/island<N>.bin\n",
+            program);
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i+1 < argc;
+            if (arg == "--islands" && hasValue)
+                options.nIslands = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--ticks" && hasValue)
+                options.ticks = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--creatures" && hasValue)
+                options.nCreatures = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--food" && hasValue)
+                options.nFood = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--seed" && hasValue)
+                options.seed = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--migration-interval" && hasValue)
+                options.migrationInterval = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--migrants" && hasValue)
+                options.nMigrants = strtoull(argv[++i], nullptr, 10);
+            else if (arg == "--queue-capacity" && hasValue)
+                options.queueCapacity = (uint32_t)strtoul(argv[++i], nullptr, 10);
+            else if (arg == "--telemetry" && hasValue)
+                options.telemetryDirectory = argv[++i];
+            else {
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+
+        if (options.nIslands < 2 || options.migrationInterval == 0 || options.queueCapacity == 0) {
+            printf("Error: At least two islands, a nonzero migration interval and queue capacity are required\n");
+            return false;
+        }
+        return true;
+    }
+
+    // Simulate an island in the current process, requires a fresh process since the systems
+    // cache singleton references of the first Ecs they are used with
+    IslandResult runIsland(uint64_t island, const Options& options,
+        MigrationQueue& inbound, MigrationQueue& outbound)
+    {
+        IslandResult result {};
+
+        HeadlessContext context;
+        if (!context.init("evolution_simulator_islands"))
+            return result;
+
+        Simulation simulation;
+        auto& ecs = simulation.getEcs();
+        auto& world = *ecs.getSingleton<WorldSingleton>();
+        auto& telemetry = *ecs.getSingleton<TelemetrySingleton>();
+
+        randomEngine().seed(options.seed + island);
+        if (!options.telemetryDirectory.empty() &&
+            !telemetry.open(options.telemetryDirectory + "/island" + std::to_string(island) + ".bin"))
+            return result;
+
+        ecs.getSingleton<fug::SpriteSingleton>()->init();
+        auto spriteSheetId = ecs.getSingleton<fug::SpriteSingleton>()->addSpriteSheetFromFile(
+            EVOLUTION_SIMULATOR_RES("sprites/sprites.png"), 128, 128);
+        simulation.init(spriteSheetId);
+        simulation.populate(options.nCreatures, options.nFood);
+
+        Vector<Migrant> migrants;
+        Migrant migrant;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i=0; i<options.ticks; ++i) {
+            simulation.update();
+            simulation.diffuseMap();
+            PROFILE_FRAME(); // the spans are buffered until the frame is closed
+            result.births += (uint64_t)telemetry.getLastValue(TelemetrySingleton::BIRTHS);
+            result.deaths += (uint64_t)telemetry.getLastValue(TelemetrySingleton::DEATHS);
+
+            if ((i+1) % options.migrationInterval != 0)
+                continue;
+
+            // only as many emigrate as fit the queue, neither end waits for the other
+            simulation.emigrate(std::min(options.nMigrants, (uint64_t)outbound.getFreeSlots()), migrants);
+            for (auto& m : migrants)
+                result.emigrants += outbound.tryPush(m) ? 1 : 0;
+
+            while (inbound.tryPop(migrant)) {
+                simulation.immigrate(migrant);
+                ++result.immigrants;
+            }
+        }
+        glFinish();
+        double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        telemetry.close();
+
+        result.success = true;
+        result.ticksPerSecond = (double)options.ticks / duration;
+        result.nCreatures = world.getNumberOf(WorldSingleton::EntityType::CREATURE);
+        result.nFood = world.getNumberOf(WorldSingleton::EntityType::FOOD);
+        result.nSpecies = (uint64_t)telemetry.getLastValue(TelemetrySingleton::N_SPECIES);
+        result.meanMass = telemetry.getLastValue(TelemetrySingleton::meanColumn(TelemetrySingleton::MASS));
+        result.meanEnergy = telemetry.getLastValue(TelemetrySingleton::meanColumn(TelemetrySingleton::ENERGY));
+
+        return result;
+    }
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 2;
+
+    // Queue i carries migrants from island i to island i+1, the mapping is shared with
+    // the island processes
+    size_t queueSize = (MigrationQueue::requiredSize(options.queueCapacity) + 63) & ~(size_t)63;
+    size_t mappingSize = options.nIslands*queueSize;
+    void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        printf("Error: Could not map %lu bytes of shared memory for the migration queues\n", mappingSize);
+        return 2;
+    }
+
+    Vector<MigrationQueue> queues(options.nIslands);
+    for (uint64_t i=0; i<options.nIslands; ++i)
+        queues[i].init(static_cast<char*>(mapping) + i*queueSize, options.queueCapacity);
+
+    fprintf(stderr, "Running %lu islands of %lu ticks, %lu migrants every %lu ticks\n", options.nIslands,
+        options.ticks, options.nMigrants, options.migrationInterval);
+
+    // All islands run at once since they exchange migrants
+    Vector<pid_t> pids(options.nIslands, -1);
+    Vector<int> fds(options.nIslands, -1);
+    bool failed = false;
+    for (uint64_t i=0; i<options.nIslands; ++i) {
+        int pipeFds[2];
+        if (pipe(pipeFds) != 0) {
+            printf("Error: Could not create a pipe\n");
+            failed = true;
+            break;
+        }
+
+        fflush(nullptr); // nothing buffered may be duplicated into the child
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("Error: Could not fork an island process\n");
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+            failed = true;
+            break;
+        }
+
+        if (pid == 0) {
+            close(pipeFds[0]);
+            dup2(STDERR_FILENO, STDOUT_FILENO); // keep the results table clean
+            IslandResult result = runIsland(i, options,
+                queues[(i+options.nIslands-1) % options.nIslands], queues[i]);
+            bool written = write(pipeFds[1], &result, sizeof(result)) == sizeof(result);
+            close(pipeFds[1]);
+            fflush(stdout);
+            _exit(written && result.success ? 0 : 1);
+        }
+
+        close(pipeFds[1]);
+        pids[i] = pid;
+        fds[i] = pipeFds[0];
+    }
+
+    Vector<IslandResult> results(options.nIslands, IslandResult{});
+    Vector<long> peakRss(options.nIslands, 0);
+    for (uint64_t i=0; i<options.nIslands; ++i) {
+        if (pids[i] < 0)
+            continue;
+
+        int status = 0;
+        struct rusage usage {};
+        wait4(pids[i], &status, 0, &usage);
+        bool received = read(fds[i], &results[i], sizeof(IslandResult)) == sizeof(IslandResult);
+        close(fds[i]);
+        peakRss[i] = usage.ru_maxrss; // KiB
+        if (!received || !results[i].success || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Error: Island %lu failed\n", i);
+            results[i].success = false;
+            failed = true;
+        }
+    }
+    munmap(mapping, mappingSize);
+
+    printf("%8s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s\n", "island", "seed", "creatures",
+        "food", "species", "meanMass", "meanEnergy", "births", "deaths", "emigrants", "immigrants", "ticksPerSec",
+        "peakRssKiB");
+    for (uint64_t i=0; i<options.nIslands; ++i) {
+        auto& r = results[i];
+        if (!r.success) {
+            printf("%8lu %12lu %12s\n", i, options.seed+i, "failed");
+            continue;
+        }
+        printf("%8lu %12lu %12lu %12lu %12lu %12.4f %12.4f %12lu %12lu %12lu %12lu %12.1f %12ld\n", i,
+            options.seed+i, r.nCreatures, r.nFood, r.nSpecies, r.meanMass, r.meanEnergy, r.births, r.deaths,
+            r.emigrants, r.immigrants, r.ticksPerSecond, peakRss[i]);
+    }
+
+    return failed ? 1 : 0;
+}